@@ -0,0 +1,76 @@
+#include "Arduino.h"
+#include "backoff.h"
+
+Backoff::Backoff(uint32_t min_delay, uint32_t max_delay)
+{
+  this->min_delay = min_delay;
+  this->max_delay = (max_delay > min_delay) ? max_delay : min_delay;
+  active = false;
+  attempts = 0;
+  lost_time = 0;
+  next_attempt = 0;
+  current_delay = 0;
+  connects = 0;
+  last_outage = 0;
+}
+
+bool Backoff::due(uint32_t now)
+{
+  if (!active)
+  {
+    // Connection was just lost, all devices of a fleet notice it at the same time
+    active = true;
+    attempts = 0;
+    lost_time = now;
+    current_delay = random(min_delay);
+    next_attempt = now + current_delay;
+  }
+  return ((int32_t)(now - next_attempt) >= 0);
+}
+
+void Backoff::failed(uint32_t now)
+{
+  uint32_t limit = min_delay;
+  uint8_t i;
+
+  if (attempts < 0xFF)
+  {
+    attempts++;
+  }
+  for (i = 0; (i < attempts) && (limit < max_delay); i++)
+  {
+    limit *= 2;
+  }
+  if (limit > max_delay)
+  {
+    limit = max_delay;
+  }
+
+  current_delay = (limit / 2) + random(limit - (limit / 2));
+  next_attempt = now + current_delay;
+}
+
+void Backoff::succeeded(uint32_t now)
+{
+  if (active)
+  {
+    last_outage = now - lost_time;
+    active = false;
+  }
+  connects++;
+}
+
+uint32_t Backoff::get_connects(void)
+{
+  return connects;
+}
+
+uint32_t Backoff::get_last_outage(void)
+{
+  return last_outage;
+}
+
+uint32_t Backoff::get_delay(void)
+{
+  return current_delay;
+}
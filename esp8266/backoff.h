@@ -0,0 +1,34 @@
+#ifndef Backoff_h
+#define Backoff_h
+
+#include "Arduino.h"
+
+/*
+ * Spreads reconnect attempts of many devices which lost their broker at
+ * the same time. The first attempt is at a random time within min_delay,
+ * every failed attempt doubles the delay up to max_delay and the next
+ * attempt is at a random time within the upper half of it.
+ */
+class Backoff
+{
+  public:
+    Backoff(uint32_t min_delay, uint32_t max_delay);
+    bool due(uint32_t now);
+    void failed(uint32_t now);
+    void succeeded(uint32_t now);
+    uint32_t get_connects();
+    uint32_t get_last_outage();
+    uint32_t get_delay();
+  private:
+    uint32_t min_delay;
+    uint32_t max_delay;
+    bool active;
+    uint8_t attempts;
+    uint32_t lost_time;
+    uint32_t next_attempt;
+    uint32_t current_delay;
+    uint32_t connects;
+    uint32_t last_outage;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "Arduino.h"
+#include "bme280_compensation.h"
+
+#define BME280_SKIPPED_20BIT  0x80000   // Value of a temperature or pressure measurement which was skipped
+#define BME280_SKIPPED_16BIT  0x8000    // Same for humidity
+
+static uint16_t get_u16(const uint8_t *p_data)
+{
+  return (uint16_t)(p_data[0] | (p_data[1] << 8));
+}
+
+Bme280Compensation::Bme280Compensation()
+{
+  dig_t1 = 0;
+  dig_t2 = 0;
+  dig_t3 = 0;
+  dig_p1 = 0;
+  memset(dig_p, 0, sizeof(dig_p));
+  dig_h1 = 0;
+  dig_h2 = 0;
+  dig_h3 = 0;
+  dig_h4 = 0;
+  dig_h5 = 0;
+  dig_h6 = 0;
+  t_fine = 0;
+}
+
+void Bme280Compensation::set_calibration(const uint8_t *calib_00, const uint8_t *calib_26)
+{
+  dig_t1 = get_u16(&calib_00[0]);
+  dig_t2 = (int16_t)get_u16(&calib_00[2]);
+  dig_t3 = (int16_t)get_u16(&calib_00[4]);
+  dig_p1 = get_u16(&calib_00[6]);
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    dig_p[i] = (int16_t)get_u16(&calib_00[8 + 2 * i]);
+  }
+  dig_h1 = calib_00[25];
+
+  // dig_H4 and dig_H5 are 12 bit and share the register 0xE5
+  dig_h2 = (int16_t)get_u16(&calib_26[0]);
+  dig_h3 = calib_26[2];
+  dig_h4 = (int16_t)(((int8_t)calib_26[3] * 16) | (calib_26[4] & 0x0F));
+  dig_h5 = (int16_t)(((int8_t)calib_26[5] * 16) | (calib_26[4] >> 4));
+  dig_h6 = (int8_t)calib_26[6];
+}
+
+bme_sample_t Bme280Compensation::compensate(const uint8_t *data)
+{
+  int32_t adc_p = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+  int32_t adc_t = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+  int32_t adc_h = ((int32_t)data[6] << 8) | data[7];
+  bme_sample_t sample;
+
+  // Pressure and humidity depend on t_fine of the temperature
+  if (adc_t == BME280_SKIPPED_20BIT)
+  {
+    sample.temperature = NAN;
+    sample.humidity = NAN;
+    sample.pressure = NAN;
+    return sample;
+  }
+  sample.temperature = temperature(adc_t) / 100.0F;
+  sample.pressure = (adc_p == BME280_SKIPPED_20BIT) ? NAN : (pressure(adc_p) / 256.0F / 100.0F);
+  sample.humidity = (adc_h == BME280_SKIPPED_16BIT) ? NAN : (humidity(adc_h) / 1024.0F);
+  return sample;
+}
+
+/* In 0.01 °C */
+int32_t Bme280Compensation::temperature(int32_t adc)
+{
+  int32_t var1;
+  int32_t var2;
+
+  var1 = ((((adc >> 3) - ((int32_t)dig_t1 << 1))) * ((int32_t)dig_t2)) >> 11;
+  var2 = (((((adc >> 4) - ((int32_t)dig_t1)) * ((adc >> 4) - ((int32_t)dig_t1))) >> 12) * ((int32_t)dig_t3)) >> 14;
+  t_fine = var1 + var2;
+  return (t_fine * 5 + 128) >> 8;
+}
+
+/* In Pa as Q24.8 */
+uint32_t Bme280Compensation::pressure(int32_t adc)
+{
+  int64_t var1;
+  int64_t var2;
+  int64_t p;
+
+  var1 = ((int64_t)t_fine) - 128000;
+  var2 = var1 * var1 * (int64_t)dig_p[4];
+  var2 = var2 + ((var1 * (int64_t)dig_p[3]) * 131072);
+  var2 = var2 + (((int64_t)dig_p[2]) * 34359738368LL);
+  var1 = ((var1 * var1 * (int64_t)dig_p[1]) / 256) + ((var1 * (int64_t)dig_p[0]) * 4096);
+  var1 = ((((int64_t)1) << 47) + var1) * ((int64_t)dig_p1) >> 33;
+  if (var1 == 0)
+  {
+    // Avoids a division by zero with an empty calibration
+    return 0;
+  }
+  p = 1048576 - adc;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)dig_p[7]) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)dig_p[6]) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (((int64_t)dig_p[5]) << 4);
+  return (uint32_t)p;
+}
+
+/* In % as Q22.10 */
+uint32_t Bme280Compensation::humidity(int32_t adc)
+{
+  int32_t v;
+
+  v = t_fine - ((int32_t)76800);
+  v = (((((adc << 14) - (((int32_t)dig_h4) << 20) - (((int32_t)dig_h5) * v)) + ((int32_t)16384)) >> 15) *
+       (((((((v * ((int32_t)dig_h6)) >> 10) * (((v * ((int32_t)dig_h3)) >> 11) + ((int32_t)32768))) >> 10) +
+          ((int32_t)2097152)) * ((int32_t)dig_h2) + 8192) >> 14));
+  v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)dig_h1)) >> 4));
+  v = (v < 0) ? 0 : v;
+  v = (v > 419430400) ? 419430400 : v;
+  return (uint32_t)(v >> 12);
+}
@@ -0,0 +1,48 @@
+#ifndef Bme280Compensation_h
+#define Bme280Compensation_h
+
+#include "Arduino.h"
+
+#define BME280_CALIB_00_ADDRESS   0x88
+#define BME280_CALIB_00_LENGTH    26    // 0x88 to 0xA1, temperature, pressure and dig_H1
+#define BME280_CALIB_26_ADDRESS   0xE1
+#define BME280_CALIB_26_LENGTH    7     // 0xE1 to 0xE7, rest of humidity
+#define BME280_DATA_ADDRESS       0xF7
+#define BME280_DATA_LENGTH        8     // 0xF7 to 0xFE, pressure, temperature and humidity
+
+typedef struct
+{
+  float temperature;  // °C
+  float humidity;     // %
+  float pressure;     // hPa
+} bme_sample_t;
+
+/*
+ * Integer compensation of the BME280 datasheet, chapter 4.2.3, applied to one
+ * burst read of all data registers. Skipped measurements are NAN.
+ */
+class Bme280Compensation
+{
+  public:
+    Bme280Compensation();
+    void set_calibration(const uint8_t *calib_00, const uint8_t *calib_26);
+    bme_sample_t compensate(const uint8_t *data);
+  private:
+    uint16_t dig_t1;
+    int16_t dig_t2;
+    int16_t dig_t3;
+    uint16_t dig_p1;
+    int16_t dig_p[8];     // dig_P2 to dig_P9
+    uint8_t dig_h1;
+    int16_t dig_h2;
+    uint8_t dig_h3;
+    int16_t dig_h4;
+    int16_t dig_h5;
+    int8_t dig_h6;
+    int32_t t_fine;
+    int32_t temperature(int32_t adc);
+    uint32_t pressure(int32_t adc);
+    uint32_t humidity(int32_t adc);
+};
+
+#endif
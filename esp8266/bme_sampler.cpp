@@ -0,0 +1,183 @@
+#include "Arduino.h"
+#include <Wire.h>
+#include "bme_sampler.h"
+
+#define BME280_REGISTER_STATUS    0xF3
+#define BME280_REGISTER_CTRL_MEAS 0xF4
+#define BME280_STATUS_MEASURING   0x08
+#define BME280_TIMEOUT_FACTOR     2     // Multiple of the maximum measurement time until a conversion is given up
+
+BmeSampler::BmeSampler(Adafruit_BME280 *sensor, uint8_t address)
+{
+  bme = sensor;
+  i2c_address = address;
+  osrs_t = Adafruit_BME280::SAMPLING_X1;
+  osrs_h = Adafruit_BME280::SAMPLING_X1;
+  osrs_p = Adafruit_BME280::SAMPLING_X1;
+  iir_filter = Adafruit_BME280::FILTER_OFF;
+  deadband.temperature = 0.0F;
+  deadband.humidity = 0.0F;
+  deadband.pressure = 0.0F;
+  max_publish_interval = 0;
+  last_publish_time = 0;
+  published = false;
+  trigger_time = 0;
+}
+
+void BmeSampler::set_sampling(Adafruit_BME280::sensor_sampling temperature, Adafruit_BME280::sensor_sampling humidity, Adafruit_BME280::sensor_sampling pressure, Adafruit_BME280::sensor_filter filter)
+{
+  osrs_t = temperature;
+  osrs_h = humidity;
+  osrs_p = pressure;
+  iir_filter = filter;
+}
+
+void BmeSampler::set_publish_policy(float temperature, float humidity, float pressure, uint32_t max_interval)
+{
+  deadband.temperature = temperature;
+  deadband.humidity = humidity;
+  deadband.pressure = pressure;
+  max_publish_interval = max_interval;
+}
+
+bool BmeSampler::begin(void)
+{
+  uint8_t calib_00[BME280_CALIB_00_LENGTH];
+  uint8_t calib_26[BME280_CALIB_26_LENGTH];
+
+  if (!bme->begin(i2c_address))
+  {
+    return false;
+  }
+
+  /* Own copy of the calibration, read() compensates without the library */
+  if (!read_registers(BME280_CALIB_00_ADDRESS, calib_00, sizeof(calib_00)) ||
+      !read_registers(BME280_CALIB_26_ADDRESS, calib_26, sizeof(calib_26)))
+  {
+    return false;
+  }
+  compensation.set_calibration(calib_00, calib_26);
+
+  /* Sensor sleeps between forced measurements, this avoids self-heating */
+  bme->setSampling(Adafruit_BME280::MODE_FORCED, osrs_t, osrs_p, osrs_h, iir_filter);
+  return true;
+}
+
+bool BmeSampler::trigger(void)
+{
+  /* Same as Adafruit_BME280::takeForcedMeasurement() but without waiting for the result */
+  trigger_time = millis();
+  return write_register(BME280_REGISTER_CTRL_MEAS, (uint8_t)((osrs_t << 5) | (osrs_p << 2) | Adafruit_BME280::MODE_FORCED));
+}
+
+bme_status_t BmeSampler::get_status(void)
+{
+  uint8_t status;
+
+  /* A sensor which dropped off the bus mid-conversion must not be polled forever */
+  if (!read_register(BME280_REGISTER_STATUS, &status))
+  {
+    return bme_error;
+  }
+  if ((status & BME280_STATUS_MEASURING) == 0)
+  {
+    return bme_ready;
+  }
+  if ((millis() - trigger_time) > (BME280_TIMEOUT_FACTOR * get_measurement_time()))
+  {
+    return bme_error;
+  }
+  return bme_busy;
+}
+
+uint32_t BmeSampler::get_measurement_time(void)
+{
+  /* Maximum measurement time according to datasheet, chapter 9.1, in us */
+  uint32_t duration = 1250;
+
+  if (osrs_t != Adafruit_BME280::SAMPLING_NONE)
+  {
+    duration += 2300 * (1 << (osrs_t - 1));
+  }
+  if (osrs_p != Adafruit_BME280::SAMPLING_NONE)
+  {
+    duration += 2300 * (1 << (osrs_p - 1)) + 575;
+  }
+  if (osrs_h != Adafruit_BME280::SAMPLING_NONE)
+  {
+    duration += 2300 * (1 << (osrs_h - 1)) + 575;
+  }
+
+  return (duration + 999) / 1000;
+}
+
+bool BmeSampler::read(bme_sample_t *sample)
+{
+  uint8_t data[BME280_DATA_LENGTH];
+
+  /* One burst of all data registers, the readXXX() of the library read the temperature again for every value */
+  if (!read_registers(BME280_DATA_ADDRESS, data, sizeof(data)))
+  {
+    return false;
+  }
+  *sample = compensation.compensate(data);
+  return true;
+}
+
+bool BmeSampler::needs_publish(bme_sample_t sample)
+{
+  if (!published)
+  {
+    return true;
+  }
+  if ((max_publish_interval > 0) && ((millis() - last_publish_time) >= max_publish_interval))
+  {
+    return true;
+  }
+  if ((fabsf(sample.temperature - last_published.temperature) >= deadband.temperature) ||
+      (fabsf(sample.humidity - last_published.humidity) >= deadband.humidity) ||
+      (fabsf(sample.pressure - last_published.pressure) >= deadband.pressure))
+  {
+    return true;
+  }
+  return false;
+}
+
+void BmeSampler::mark_published(bme_sample_t sample)
+{
+  last_published = sample;
+  last_publish_time = millis();
+  published = true;
+}
+
+bool BmeSampler::write_register(uint8_t reg, uint8_t value)
+{
+  Wire.beginTransmission(i2c_address);
+  Wire.write(reg);
+  Wire.write(value);
+  return (Wire.endTransmission() == 0);
+}
+
+bool BmeSampler::read_register(uint8_t reg, uint8_t *value)
+{
+  return read_registers(reg, value, 1);
+}
+
+bool BmeSampler::read_registers(uint8_t reg, uint8_t *data, uint8_t length)
+{
+  Wire.beginTransmission(i2c_address);
+  Wire.write(reg);
+  if (Wire.endTransmission() != 0)
+  {
+    return false;
+  }
+  if (Wire.requestFrom(i2c_address, length) != length)
+  {
+    return false;
+  }
+  for (uint8_t i = 0; i < length; i++)
+  {
+    data[i] = (uint8_t)Wire.read();
+  }
+  return true;
+}
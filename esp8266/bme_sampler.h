@@ -0,0 +1,47 @@
+#ifndef BmeSampler_h
+#define BmeSampler_h
+
+#include "Arduino.h"
+#include <Adafruit_BME280.h>
+#include "bme280_compensation.h"
+
+typedef enum
+{
+  bme_ready = 0,
+  bme_busy,
+  bme_error     // I2C failure or the conversion took too long
+} bme_status_t;
+
+class BmeSampler
+{
+  public:
+    BmeSampler(Adafruit_BME280 *sensor, uint8_t address);
+    void set_sampling(Adafruit_BME280::sensor_sampling temperature, Adafruit_BME280::sensor_sampling humidity, Adafruit_BME280::sensor_sampling pressure, Adafruit_BME280::sensor_filter filter);
+    void set_publish_policy(float temperature, float humidity, float pressure, uint32_t max_interval);
+    bool begin();
+    bool trigger();
+    bme_status_t get_status();
+    uint32_t get_measurement_time();
+    bool read(bme_sample_t *sample);
+    bool needs_publish(bme_sample_t sample);
+    void mark_published(bme_sample_t sample);
+  private:
+    Adafruit_BME280 *bme;
+    uint8_t i2c_address;
+    Adafruit_BME280::sensor_sampling osrs_t;
+    Adafruit_BME280::sensor_sampling osrs_h;
+    Adafruit_BME280::sensor_sampling osrs_p;
+    Adafruit_BME280::sensor_filter iir_filter;
+    bme_sample_t deadband;
+    uint32_t max_publish_interval;
+    bme_sample_t last_published;
+    uint32_t last_publish_time;
+    bool published;
+    uint32_t trigger_time;
+    Bme280Compensation compensation;
+    bool write_register(uint8_t reg, uint8_t value);
+    bool read_register(uint8_t reg, uint8_t *value);
+    bool read_registers(uint8_t reg, uint8_t *data, uint8_t length);
+};
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef Clock_h
+#define Clock_h
+
+#include <time.h>
+
+/* Times before 2020 mean that the clock is not synchronised yet */
+#define TIME_VALID_THRESHOLD    1577836800
+
+#endif
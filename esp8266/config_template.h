@@ -10,4 +10,24 @@
 
 #define OTA_PASSWORT        "Your OTA password"
 
+#define NTP_SERVER          "pool.ntp.org"
+#define TIMEZONE            "CET-1CEST,M3.5.0,M10.5.0/3"
+
 #define BME280_I2C_ADR      0x76
+
+#define DOOR_COUNT          1
+// Pins of the software serials used for door 2 up to DOOR_COUNT, only needed if DOOR_COUNT > 1
+//#define DOOR_RX_PINS        { D5 }
+//#define DOOR_TX_PINS        { D6 }
+#define BME280_SAMPLE_INTERVAL            30000
+#define BME280_OVERSAMPLING_TEMPERATURE   Adafruit_BME280::SAMPLING_X1
+#define BME280_OVERSAMPLING_HUMIDITY      Adafruit_BME280::SAMPLING_X1
+#define BME280_OVERSAMPLING_PRESSURE      Adafruit_BME280::SAMPLING_X1
+#define BME280_FILTER                     Adafruit_BME280::FILTER_OFF
+#define BME280_DEADBAND_TEMPERATURE       0.2F
+#define BME280_DEADBAND_HUMIDITY          1.0F
+#define BME280_DEADBAND_PRESSURE          0.5F
+#define BME280_MAX_PUBLISH_INTERVAL       300000
+
+// WIFI_LIGHT_SLEEP suspends the CPU while idle, check the bus timing before using it
+#define WIFI_SLEEP_MODE     WIFI_MODEM_SLEEP
@@ -0,0 +1,90 @@
+#include "Arduino.h"
+#include "connection_manager.h"
+
+ConnectionManager::ConnectionManager(uint32_t min_delay, uint32_t max_delay, uint32_t discovery_max_delay, uint16_t reconnect_limit)
+  : backoff(min_delay, max_delay)
+{
+  this->discovery_max_delay = discovery_max_delay;
+  this->reconnect_limit = reconnect_limit;
+  reconnect_counter = 0;
+  discovery_pending = false;
+  discovery_time = 0;
+}
+
+void ConnectionManager::begin(uint32_t now, bool session_restored)
+{
+  // Discovery and retained states of the last run are still on the broker.
+  // Otherwise units powered up together don't send their discovery at the same time.
+  discovery_pending = !session_restored;
+  if (discovery_pending)
+  {
+    discovery_time = now + random(discovery_max_delay);
+  }
+}
+
+connection_action_t ConnectionManager::run(uint32_t now, bool wifi_connected, bool mqtt_connected)
+{
+  connection_action_t action = connection_none;
+
+  if (!wifi_connected)
+  {
+    action = connection_reconnect_wifi;
+    reconnect_counter++;
+  }
+  else if (!mqtt_connected)
+  {
+    if (backoff.due(now))
+    {
+      action = connection_connect_mqtt;
+      reconnect_counter++;
+    }
+  }
+  else
+  {
+    if (discovery_pending && ((int32_t)(now - discovery_time) >= 0))
+    {
+      action = connection_send_discovery;
+      discovery_pending = false;
+    }
+    if (reconnect_counter > 0)
+    {
+      reconnect_counter--;
+    }
+  }
+
+  if (reconnect_counter > reconnect_limit)
+  {
+    return connection_restart;
+  }
+  return action;
+}
+
+void ConnectionManager::connected(uint32_t now)
+{
+  backoff.succeeded(now);
+}
+
+void ConnectionManager::failed(uint32_t now)
+{
+  backoff.failed(now);
+}
+
+bool ConnectionManager::is_discovery_pending(void)
+{
+  return discovery_pending;
+}
+
+uint32_t ConnectionManager::get_connects(void)
+{
+  return backoff.get_connects();
+}
+
+uint32_t ConnectionManager::get_last_outage(void)
+{
+  return backoff.get_last_outage();
+}
+
+uint32_t ConnectionManager::get_retry_delay(void)
+{
+  return backoff.get_delay();
+}
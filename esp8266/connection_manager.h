@@ -0,0 +1,46 @@
+#ifndef ConnectionManager_h
+#define ConnectionManager_h
+
+#include "Arduino.h"
+#include "backoff.h"
+
+typedef enum
+{
+  connection_none = 0,
+  connection_reconnect_wifi,    // WiFi is down, associate again
+  connection_connect_mqtt,      // The backoff allows the next connect attempt
+  connection_send_discovery,    // Connected and the discovery delay has passed
+  connection_restart            // Too many attempts without a stable connection
+} connection_action_t;
+
+/*
+ * Reconnect and discovery logic of the connection task, without the
+ * network itself. run() decides what the task does next, the caller
+ * performs it and reports the result of a connect attempt. Every run
+ * with an attempt increments the reconnect counter, every connected run
+ * decrements it, the unit restarts when it exceeds reconnect_limit.
+ * Discovery is sent at a random time within discovery_max_delay after
+ * begin(), unless the broker session of the last run was restored.
+ */
+class ConnectionManager
+{
+  public:
+    ConnectionManager(uint32_t min_delay, uint32_t max_delay, uint32_t discovery_max_delay, uint16_t reconnect_limit);
+    void begin(uint32_t now, bool session_restored);
+    connection_action_t run(uint32_t now, bool wifi_connected, bool mqtt_connected);
+    void connected(uint32_t now);
+    void failed(uint32_t now);
+    bool is_discovery_pending();
+    uint32_t get_connects();
+    uint32_t get_last_outage();
+    uint32_t get_retry_delay();
+  private:
+    Backoff backoff;
+    uint32_t discovery_max_delay;
+    uint16_t reconnect_limit;
+    uint16_t reconnect_counter;
+    bool discovery_pending;
+    uint32_t discovery_time;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "Arduino.h"
+#include "discovery.h"
+
+typedef struct
+{
+  const char *component;
+  const char *entity;
+  const char *name;
+  const char *fields;       // entity specific JSON fields
+} discovery_entity_t;
+
+#define DOOR_TOPIC_FORMAT   "homeassistant/%s/%s_%s/config"
+#define DOOR_PAYLOAD_FORMAT "{\"~\":\"homeassistant/%s/%s_%s\", \"avty_t\":\"%s\", %s, \"name\":\"%s\", \"def_ent_id\":\"%s.%s_%s\", \"uniq_id\":\"%s_%s\", %s}"
+#define BME_TOPIC_FORMAT    "homeassistant/sensor/%s_%s/config"
+#define BME_PAYLOAD_FORMAT  "{\"avty\":[{\"topic\":\"%s\"}, {\"topic\":\"%s\"}], \"avty_mode\":\"all\", %s, \"name\":\"%s\", \"def_ent_id\":\"sensor.%s_%s\", \"stat_t\":\"%s\", \"uniq_id\":\"%s_%s\", %s}"
+
+static constexpr discovery_entity_t door_entities[DISCOVERY_DOOR_ENTITY_COUNT] =
+{
+  { "cover", "cover", "Garage door", "\"cmd_t\":\"~/command\", \"dev_cla\":\"garage\", \"pos_t\":\"~/position\", \"en\":\"true\"" },
+  { "switch", "venting", "Venting", "\"cmd_t\":\"~/command\", \"icon\":\"mdi:fan\", \"stat_t\":\"~/state\", \"en\":\"true\"" },
+  { "switch", "light", "Light", "\"cmd_t\":\"~/command\", \"icon\":\"mdi:lightbulb\", \"stat_t\":\"~/state\", \"en\":\"false\"" },
+  { "binary_sensor", "error", "Error", "\"dev_cla\":\"problem\", \"stat_t\":\"~/state\", \"en\":\"true\"" },
+  { "binary_sensor", "prewarn", "Prewarn", "\"dev_cla\":\"safety\", \"stat_t\":\"~/state\", \"en\":\"false\"" },
+  { "binary_sensor", "option_relay", "Option relay", "\"stat_t\":\"~/state\", \"en\":\"false\"" },
+  { "button", "emergency_stop", "Emergency stop", "\"cmd_t\":\"~/trigger\", \"icon\":\"mdi:close-octagon\", \"en\":\"false\"" },
+  { "button", "impulse", "Impulse", "\"cmd_t\":\"~/trigger\", \"icon\":\"mdi:arrow-up-down\", \"en\":\"false\"" }
+};
+
+static constexpr discovery_entity_t bme_entities[DISCOVERY_BME_ENTITY_COUNT] =
+{
+  { "sensor", "temperature", "Temperature", "\"dev_cla\":\"temperature\", \"stat_cla\":\"measurement\", \"unit_of_meas\":\"\u00b0C\", \"val_tpl\":\"{{value_json.temperature_C|round(1)}}\", \"en\":\"true\"" },
+  { "sensor", "humidity", "Humidity", "\"dev_cla\":\"humidity\", \"stat_cla\":\"measurement\", \"unit_of_meas\":\"%\", \"val_tpl\":\"{{value_json.humidity|round(0)}}\", \"en\":\"true\"" },
+  { "sensor", "pressure", "Pressure", "\"dev_cla\":\"pressure\", \"stat_cla\":\"measurement\", \"unit_of_meas\":\"hPa\", \"val_tpl\":\"{{value_json.pressure_hPa|round(1)}}\", \"en\":\"true\"" }
+};
+
+/* Worst case length of the table dependent parts of topic and payload */
+static constexpr size_t max_topic_length(const discovery_entity_t *entities, size_t count)
+{
+  return (count == 0) ? 0 :
+         (text_length(entities->component) + text_length(entities->entity) > max_topic_length(entities + 1, count - 1)) ?
+         text_length(entities->component) + text_length(entities->entity) : max_topic_length(entities + 1, count - 1);
+}
+
+static constexpr size_t entity_payload_length(const discovery_entity_t *entity)
+{
+  return (2 * text_length(entity->component)) + (3 * text_length(entity->entity)) + text_length(entity->name) + text_length(entity->fields);
+}
+
+static constexpr size_t max_payload_length(const discovery_entity_t *entities, size_t count)
+{
+  return (count == 0) ? 0 :
+         (entity_payload_length(entities) > max_payload_length(entities + 1, count - 1)) ?
+         entity_payload_length(entities) : max_payload_length(entities + 1, count - 1);
+}
+
+static_assert((sizeof(DOOR_TOPIC_FORMAT) + UNIQUE_ID_SIZE + max_topic_length(door_entities, DISCOVERY_DOOR_ENTITY_COUNT)) <= TOPIC_SIZE,
+              "Door discovery topic too long");
+static_assert((sizeof(BME_TOPIC_FORMAT) + UNIQUE_ID_SIZE + max_topic_length(bme_entities, DISCOVERY_BME_ENTITY_COUNT)) <= TOPIC_SIZE,
+              "BME discovery topic too long");
+static_assert((sizeof(DOOR_PAYLOAD_FORMAT) + (2 * UNIQUE_ID_SIZE) + TOPIC_SIZE + DISCOVERY_DEVICE_SIZE + DISCOVERY_OBJECT_ID_SIZE +
+               max_payload_length(door_entities, DISCOVERY_DOOR_ENTITY_COUNT)) <= DISCOVERY_PAYLOAD_SIZE,
+              "Door discovery payload too long");
+static_assert((sizeof(BME_PAYLOAD_FORMAT) + UNIQUE_ID_SIZE + (3 * TOPIC_SIZE) + DISCOVERY_DEVICE_SIZE + DISCOVERY_OBJECT_ID_SIZE +
+               max_payload_length(bme_entities, DISCOVERY_BME_ENTITY_COUNT)) <= DISCOVERY_PAYLOAD_SIZE,
+              "BME discovery payload too long");
+
+bool discovery_door_entity(const discovery_device_t *device, uint8_t entity, char *topic, TextBuffer *payload)
+{
+  const discovery_entity_t *e;
+
+  if (entity >= DISCOVERY_DOOR_ENTITY_COUNT)
+  {
+    return false;
+  }
+  e = &door_entities[entity];
+
+  snprintf(topic, TOPIC_SIZE, DOOR_TOPIC_FORMAT, e->component, device->unique_id, e->entity);
+  payload->clear();
+  return payload->appendf(DOOR_PAYLOAD_FORMAT, e->component, device->unique_id, e->entity, device->avty_topic, device->description,
+                          e->name, e->component, device->object_id, e->entity, device->unique_id, e->entity, e->fields);
+}
+
+bool discovery_bme_entity(const discovery_device_t *device, const char *bme_avty_topic, const char *bme_state_topic, uint8_t entity, char *topic, TextBuffer *payload)
+{
+  const discovery_entity_t *e;
+
+  if (entity >= DISCOVERY_BME_ENTITY_COUNT)
+  {
+    return false;
+  }
+  e = &bme_entities[entity];
+
+  snprintf(topic, TOPIC_SIZE, BME_TOPIC_FORMAT, device->unique_id, e->entity);
+  payload->clear();
+  return payload->appendf(BME_PAYLOAD_FORMAT, device->avty_topic, bme_avty_topic, device->description, e->name,
+                          device->object_id, e->entity, bme_state_topic, device->unique_id, e->entity, e->fields);
+}
@@ -0,0 +1,30 @@
+#ifndef Discovery_h
+#define Discovery_h
+
+#include "Arduino.h"
+#include "text_buffer.h"
+#include "door_channel.h"
+
+#define DISCOVERY_DEVICE_SIZE       224   // "dev" object of the payload
+#define DISCOVERY_OBJECT_ID_SIZE    48
+#define DISCOVERY_PAYLOAD_SIZE      1024
+
+#define DISCOVERY_DOOR_ENTITY_COUNT 8
+#define DISCOVERY_BME_ENTITY_COUNT  3
+
+typedef struct
+{
+  const char *unique_id;
+  const char *object_id;    // prefix of the entity ids
+  const char *description;  // "dev" object, at most DISCOVERY_DEVICE_SIZE
+  const char *avty_topic;
+} discovery_device_t;
+
+/*
+ * Home Assistant discovery messages of the entities of a door and of the BME280.
+ * Topic has to hold TOPIC_SIZE, payload at least DISCOVERY_PAYLOAD_SIZE bytes.
+ */
+bool discovery_door_entity(const discovery_device_t *device, uint8_t entity, char *topic, TextBuffer *payload);
+bool discovery_bme_entity(const discovery_device_t *device, const char *bme_avty_topic, const char *bme_state_topic, uint8_t entity, char *topic, TextBuffer *payload);
+
+#endif
@@ -0,0 +1,52 @@
+#include "Arduino.h"
+#include "door_channel.h"
+
+DoorChannel::DoorChannel(void) : rules(&door)
+{
+  index = 0;
+  unique_id[0] = '\0';
+  current_state.data_valid = false;
+  last_state.data_valid = false;
+  journal_state.data_valid = false;
+}
+
+void DoorChannel::setup_topics(const char *gateway_id, uint8_t channel_index)
+{
+  index = channel_index;
+
+  /* First door keeps the id of the gateway, so single door installations stay unchanged */
+  if (index == 0)
+  {
+    snprintf(unique_id, sizeof(unique_id), "%s", gateway_id);
+  }
+  else
+  {
+    snprintf(unique_id, sizeof(unique_id), "%s_%u", gateway_id, index + 1);
+  }
+
+  FORMAT_TOPIC(cover_cmd_topic, "homeassistant/cover/", unique_id, "_cover/command");
+  FORMAT_TOPIC(cover_pos_topic, "homeassistant/cover/", unique_id, "_cover/position");
+
+  FORMAT_TOPIC(venting_cmd_topic, "homeassistant/switch/", unique_id, "_venting/command");
+  FORMAT_TOPIC(venting_state_topic, "homeassistant/switch/", unique_id, "_venting/state");
+
+  FORMAT_TOPIC(light_cmd_topic, "homeassistant/switch/", unique_id, "_light/command");
+  FORMAT_TOPIC(light_state_topic, "homeassistant/switch/", unique_id, "_light/state");
+
+  FORMAT_TOPIC(error_state_topic, "homeassistant/binary_sensor/", unique_id, "_error/state");
+  FORMAT_TOPIC(prewarn_state_topic, "homeassistant/binary_sensor/", unique_id, "_prewarn/state");
+  FORMAT_TOPIC(option_relay_state_topic, "homeassistant/binary_sensor/", unique_id, "_option_relay/state");
+
+  FORMAT_TOPIC(emergency_stop_cmd_topic, "homeassistant/button/", unique_id, "_emergency_stop/trigger");
+  FORMAT_TOPIC(impulse_cmd_topic, "homeassistant/button/", unique_id, "_impulse/trigger");
+
+  FORMAT_TOPIC(rules_cfg_topic, "homeassistant/cover/", unique_id, "_cover/rules/config");
+  FORMAT_TOPIC(rules_state_topic, "homeassistant/cover/", unique_id, "_cover/rules/state");
+}
+
+bool DoorChannel::owns_topic(const char *topic)
+{
+  return ((strcmp(topic, cover_cmd_topic) == 0) || (strcmp(topic, venting_cmd_topic) == 0) ||
+          (strcmp(topic, light_cmd_topic) == 0) || (strcmp(topic, emergency_stop_cmd_topic) == 0) ||
+          (strcmp(topic, impulse_cmd_topic) == 0) || (strcmp(topic, rules_cfg_topic) == 0));
+}
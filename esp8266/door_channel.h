@@ -0,0 +1,45 @@
+#ifndef DoorChannel_h
+#define DoorChannel_h
+
+#include "Arduino.h"
+#include "hoermann_driver.h"
+#include "rules.h"
+
+#define GATEWAY_ID_SIZE   (sizeof("hoermann_door_") + 12)   // MAC as hex, including terminator
+#define UNIQUE_ID_SIZE    (GATEWAY_ID_SIZE + 3)             // "_" and door number up to 99
+#define TOPIC_SIZE        96
+
+/* Formats prefix + id + suffix into a topic buffer, checks the maximum length at compile time */
+#define FORMAT_TOPIC(topic, prefix, id, suffix) \
+  static_assert((sizeof(prefix) + UNIQUE_ID_SIZE + sizeof(suffix) - 2) <= TOPIC_SIZE, "Topic buffer too small"); \
+  snprintf(topic, TOPIC_SIZE, prefix "%s" suffix, id)
+
+class DoorChannel
+{
+  public:
+    DoorChannel();
+    void setup_topics(const char *gateway_id, uint8_t channel_index);
+    bool owns_topic(const char *topic);
+    HoermannDoor door;
+    RuleEngine rules;
+    uint8_t index;
+    char unique_id[UNIQUE_ID_SIZE];
+    hoermann_state_t current_state;
+    hoermann_state_t last_state;
+    hoermann_state_t journal_state;  // last state recorded in the journal
+    char cover_cmd_topic[TOPIC_SIZE];
+    char cover_pos_topic[TOPIC_SIZE];
+    char venting_cmd_topic[TOPIC_SIZE];
+    char venting_state_topic[TOPIC_SIZE];
+    char light_cmd_topic[TOPIC_SIZE];
+    char light_state_topic[TOPIC_SIZE];
+    char error_state_topic[TOPIC_SIZE];
+    char prewarn_state_topic[TOPIC_SIZE];
+    char option_relay_state_topic[TOPIC_SIZE];
+    char emergency_stop_cmd_topic[TOPIC_SIZE];
+    char impulse_cmd_topic[TOPIC_SIZE];
+    char rules_cfg_topic[TOPIC_SIZE];
+    char rules_state_topic[TOPIC_SIZE];
+};
+
+#endif
@@ -1,61 +1,219 @@
 #include "config.h"
 #include <ESP8266WiFi.h>
 #include <ArduinoOTA.h>
+#include <ESP8266HTTPClient.h>
 #include <PubSubClient.h>
-#include <PubSubClientTools.h>
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BME280.h>
 #include "hoermann.h"
+#include "scheduler.h"
+#include "bme_sampler.h"
+#include "rules.h"
+#include "door_channel.h"
+#include "esp_rtc_storage.h"
+#include "warm_start.h"
+#include "text_buffer.h"
+#include "discovery.h"
+#include "heap_monitor.h"
+#include "journal.h"
+#include "ota_updater.h"
+#include "ota_auth.h"
+#include "connection_manager.h"
+#if defined(DOOR_COUNT) && (DOOR_COUNT > 1)
+#include <SoftwareSerial.h>
+#endif
 
 #define HW_VERSION "v1"
 #define SW_VERSION "v3.2"
 
+#ifndef MQTT_RECONNECT_MIN_DELAY
+#define MQTT_RECONNECT_MIN_DELAY  1000
+#endif
+#ifndef MQTT_RECONNECT_MAX_DELAY
+#define MQTT_RECONNECT_MAX_DELAY  60000
+#endif
+#ifndef DISCOVERY_MAX_DELAY
+#define DISCOVERY_MAX_DELAY       10000
+#endif
+#define RECONNECT_LIMIT           100   // Attempts without a stable connection until restart
+
+#ifndef WIFI_SLEEP_MODE
+#define WIFI_SLEEP_MODE     WIFI_MODEM_SLEEP
+#endif
+
+#ifndef DOOR_COUNT
+#define DOOR_COUNT          1
+#endif
+
+#ifndef WARM_START_WIFI_TIMEOUT
+#define WARM_START_WIFI_TIMEOUT   2000
+#endif
+
+#ifndef JOURNAL_FLUSH_INTERVAL
+#define JOURNAL_FLUSH_INTERVAL    1000
+#endif
+#ifndef JOURNAL_BATCH_SIZE
+#define JOURNAL_BATCH_SIZE        8
+#endif
+
+#ifndef NTP_SERVER
+#define NTP_SERVER          "pool.ntp.org"
+#endif
+#ifndef TIMEZONE
+#define TIMEZONE            "UTC0"
+#endif
+
+#ifndef BME280_SAMPLE_INTERVAL
+#define BME280_SAMPLE_INTERVAL            30000
+#endif
+#ifndef BME280_OVERSAMPLING_TEMPERATURE
+#define BME280_OVERSAMPLING_TEMPERATURE   Adafruit_BME280::SAMPLING_X1
+#endif
+#ifndef BME280_OVERSAMPLING_HUMIDITY
+#define BME280_OVERSAMPLING_HUMIDITY      Adafruit_BME280::SAMPLING_X1
+#endif
+#ifndef BME280_OVERSAMPLING_PRESSURE
+#define BME280_OVERSAMPLING_PRESSURE      Adafruit_BME280::SAMPLING_X1
+#endif
+#ifndef BME280_FILTER
+#define BME280_FILTER                     Adafruit_BME280::FILTER_OFF
+#endif
+#ifndef BME280_DEADBAND_TEMPERATURE
+#define BME280_DEADBAND_TEMPERATURE       0.0F
+#endif
+#ifndef BME280_DEADBAND_HUMIDITY
+#define BME280_DEADBAND_HUMIDITY          0.0F
+#endif
+#ifndef BME280_DEADBAND_PRESSURE
+#define BME280_DEADBAND_PRESSURE          0.0F
+#endif
+#ifndef BME280_MAX_PUBLISH_INTERVAL
+#define BME280_MAX_PUBLISH_INTERVAL       0
+#endif
+
+#define DOOR_TASK_PERIOD        5
+#define NETWORK_TASK_PERIOD     10
+#define CONNECTION_TASK_PERIOD  500
+#define BME_TASK_PERIOD         BME280_SAMPLE_INTERVAL
+#define METRICS_TASK_PERIOD     60000
+#define RULES_TASK_PERIOD       1000
+#define JOURNAL_TASK_PERIOD     JOURNAL_FLUSH_INTERVAL
+
+// Shared by all payloads, tasks and the MQTT callback never publish at the same time.
+// Every additional door adds its PIC diagnostics to the metrics.
+#define PAYLOAD_BUFFER_SIZE     (2112 + (DOOR_COUNT - 1) * 384)
+
+#define DEVICE_FORMAT           "\"dev\":{\"ids\":\"%s\", \"name\":\"%s%s\", \"mdl\":\"Hoermann Door\", \"mf\":\"stephan192\", \"hw\":\"" HW_VERSION "\", \"sw\":\"" SW_VERSION "\"}"
+#define BME_STATE_FORMAT        "{ \"temperature_C\" : %.2f, \"humidity\" : %.2f, \"pressure_hPa\" : %.2f }"
+#define METRICS_HEADER_FORMAT   "{ \"load\" : %u, \"warm_start\" : %s, \"first_state_ms\" : %lu, \"heap\" : { \"free\" : %lu, \"max_block\" : %u, \"min_max_block\" : %u, \"fragmentation\" : %u, \"allocations\" : %ld }, \"mqtt\" : { \"connects\" : %lu, \"last_outage_ms\" : %lu, \"retry_delay_ms\" : %lu }, \"tasks\" : {"
+#define METRICS_TASK_FORMAT     "%s \"%s\" : { \"runs\" : %lu, \"overruns\" : %lu, \"max_latency_ms\" : %lu, \"max_runtime_us\" : %lu }"
+#define METRICS_DOORS_FORMAT    " }, \"doors\" : ["
+#define METRICS_DOOR_FORMAT     "%s { \"pic_active_percent\" : %d"
+#define METRICS_BUS_FORMAT      ", \"bus\" : { \"state\" : \"%s\", \"master_age_ms\" : %u, \"response_age_ms\" : %u, \"receiver_resets\" : %u, \"uart_reinits\" : %u, \"watchdog_resets\" : %u, \"overruns\" : %u, \"recoveries\" : %u, \"mttr_ms\" : %u }"
+#define METRICS_SLAVES_FORMAT   ", \"rejected_slaves\" : %u"
+#define METRICS_STRAY_FORMAT    ", \"stray_bytes\" : %u"
+#define METRICS_DOOR_TAIL       " }"
+#define METRICS_TAIL            " ] }"
+#define HISTORY_HEADER_FORMAT   "{ \"dropped\" : %lu, \"events\" : ["
+#define HISTORY_DOOR_FORMAT     "%s { \"ts\" : %lu, \"uptime_ms\" : %lu, \"door\" : %u, \"cover\" : \"%s\", \"venting\" : %s, \"light\" : %s, \"error\" : %s, \"prewarn\" : %s, \"option_relay\" : %s }"
+#define HISTORY_BME_FORMAT      "%s { \"ts\" : %lu, \"uptime_ms\" : %lu, \"temperature_C\" : %.2f, \"humidity\" : %.2f, \"pressure_hPa\" : %.1f }"
+#define HISTORY_TAIL            " ] }"
+#define OTA_STATE_FORMAT        "{ \"result\" : \"%s\", \"package\" : \"%s\", \"received\" : %lu, \"written\" : %lu, \"duration_ms\" : %lu, \"error\" : \"%s\" }"
+#define OTA_COMMAND_SIZE        256   // URL, MD5 and MAC, limited by MQTT_MAX_PACKET_SIZE anyway
+#define NUMBER_SIZE             12    // 32 bit number as text
+#define TASK_NAME_SIZE          16
+
+static_assert(DOOR_COUNT < 100, "Door number is limited to two digits");
+static_assert((sizeof(DEVICE_FORMAT) + UNIQUE_ID_SIZE + sizeof(HOSTNAME) + 3) <= DISCOVERY_DEVICE_SIZE, "Device description too long");
+static_assert((sizeof(HOSTNAME) + 3) <= DISCOVERY_OBJECT_ID_SIZE, "Object id too long");
+static_assert(DISCOVERY_PAYLOAD_SIZE <= PAYLOAD_BUFFER_SIZE, "Payload buffer too small for discovery");
+static_assert((sizeof(BME_STATE_FORMAT) + 3 * NUMBER_SIZE) <= PAYLOAD_BUFFER_SIZE, "Payload buffer too small for BME");
+static_assert((sizeof(METRICS_HEADER_FORMAT) + 11 * NUMBER_SIZE + sizeof(METRICS_DOORS_FORMAT) + sizeof(METRICS_TAIL) +
+               SCHEDULER_MAX_TASKS * (sizeof(METRICS_TASK_FORMAT) + TASK_NAME_SIZE + 4 * NUMBER_SIZE) +
+               DOOR_COUNT * (sizeof(METRICS_DOOR_FORMAT) + NUMBER_SIZE + sizeof(METRICS_BUS_FORMAT) + sizeof("receiver_reset") + 8 * NUMBER_SIZE +
+                             sizeof(METRICS_SLAVES_FORMAT) + sizeof("255") + sizeof(METRICS_DOOR_TAIL))) <= PAYLOAD_BUFFER_SIZE,
+              "Payload buffer too small for metrics");
+static_assert((sizeof(HISTORY_HEADER_FORMAT) + NUMBER_SIZE + sizeof(HISTORY_TAIL) +
+               JOURNAL_BATCH_SIZE * (sizeof(HISTORY_DOOR_FORMAT) + 3 * NUMBER_SIZE + 5 * sizeof("false") + sizeof("closing"))) <= PAYLOAD_BUFFER_SIZE,
+              "Payload buffer too small for a history batch");
+static_assert(sizeof(HISTORY_BME_FORMAT) + 5 * NUMBER_SIZE <= sizeof(HISTORY_DOOR_FORMAT) + 3 * NUMBER_SIZE + 5 * sizeof("false") + sizeof("closing"),
+              "BME history entry is longer than a door history entry");
+static_assert((sizeof(OTA_STATE_FORMAT) + 3 * NUMBER_SIZE + sizeof("installed") + sizeof("delta") + sizeof("timeout")) <= PAYLOAD_BUFFER_SIZE,
+              "Payload buffer too small for the OTA state");
+
 WiFiClient espClient;
 PubSubClient client(MQTT_SERVER, MQTT_PORT, espClient);
-PubSubClientTools mqtt(client);
-String unique_id;
-
-Hoermann door;
-hoermann_state_t current_door_state;
-hoermann_state_t last_door_state;
+char unique_id[GATEWAY_ID_SIZE];
+
+// Door 1 is connected to the hardware UART, all further doors to software serials
+DoorChannel channels[DOOR_COUNT];
+HoermannUart uart_driver;
+#if DOOR_COUNT > 1
+const int8_t door_rx_pins[DOOR_COUNT - 1] = DOOR_RX_PINS;
+const int8_t door_tx_pins[DOOR_COUNT - 1] = DOOR_TX_PINS;
+SoftwareSerial door_serials[DOOR_COUNT - 1];
+HoermannSoftwareSerial serial_drivers[DOOR_COUNT - 1];
+#endif
 
 Adafruit_BME280 bme; // I2C
+BmeSampler bme_sampler(&bme, BME280_I2C_ADR);
 bool bme_detected = false;
-uint32_t ReconnectCounter = 0;
-uint32_t StartTime;
-
-String cover_avty_topic;
-String cover_cmd_topic;
-String cover_pos_topic;
-String venting_cmd_topic;
-String venting_state_topic;
-String light_cmd_topic;
-String light_state_topic;
-String error_state_topic;
-String prewarn_state_topic;
-String option_relay_state_topic;
-String emergency_stop_cmd_topic;
-String impulse_cmd_topic;
-String bme_avty_topic;
-String bme_state_topic;
+bool bme_measuring = false;
 
-void setup() {
-  last_door_state.data_valid = false;
+// Spread the load of a fleet on the broker after a broker restart or a power cut
+ConnectionManager connection(MQTT_RECONNECT_MIN_DELAY, MQTT_RECONNECT_MAX_DELAY, DISCOVERY_MAX_DELAY, RECONNECT_LIMIT);
+
+Scheduler scheduler;
+
+// Snapshot of the runtime state which survives a restart
+EspRtcStorage rtc_storage;
+WarmStart warm_start(&rtc_storage);
+uint32_t first_state_time = 0; // ms after boot until the PIC reported the state of all doors
+
+char cover_avty_topic[TOPIC_SIZE]; // Shared by all doors of the gateway
+char bme_avty_topic[TOPIC_SIZE];
+char bme_state_topic[TOPIC_SIZE];
+char metrics_topic[TOPIC_SIZE];
+char history_topic[TOPIC_SIZE];
+char ota_cmd_topic[TOPIC_SIZE];
+char ota_state_topic[TOPIC_SIZE];
+
+StaticTextBuffer<PAYLOAD_BUFFER_SIZE> payload;
+HeapMonitor heap_monitor;
+
+// Door transitions and BME samples, also recorded while offline
+Journal journal;
+
+// Package URL received via MQTT, installed outside of the MQTT callback
+OtaUpdater ota_updater;
+char ota_command[OTA_COMMAND_SIZE] = "";
 
+void setup() {
   Serial.begin(115200);
   Serial.println();
 
+  // Door states of the last run are valid until the PIC sends its first status
+  if (warm_start.restore())
+  {
+    Serial.println("Warm start");
+    restore_door_states();
+  }
+
   // Connect to WiFi
   Serial.print("Connecting to WiFi: ");
   Serial.print(WIFI_SSID);
   WiFi.mode(WIFI_STA);
   WiFi.hostname(HOSTNAME);
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  if (!connect_cached_wifi()) {
+    WiFi.begin(WIFI_SSID, WIFI_PASS);
+    while (WiFi.status() != WL_CONNECTED) {
+      delay(500);
+      Serial.print(".");
+    }
   }
   Serial.println("connected");
+  warm_start.set_wifi(WiFi.BSSID(), WiFi.channel());
+  warm_start.save();
 
   // Port defaults to 8266
   // ArduinoOTA.setPort(8266);
@@ -67,7 +225,7 @@ void setup() {
   ArduinoOTA.setPassword(OTA_PASSWORT);
 
   ArduinoOTA.onStart([]() {
-    String type;
+    const char *type;
     if (ArduinoOTA.getCommand() == U_FLASH) {
       type = "sketch";
     } else { // U_SPIFFS
@@ -75,7 +233,13 @@ void setup() {
     }
 
     // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
-    Serial.println("Start updating " + type);
+    Serial.print("Start updating ");
+    Serial.println(type);
+
+    // Discovery contains the software version, so it has to be sent again by the new firmware.
+    // Not in onEnd, RTC memory must not be written between Update.end() and the restart.
+    warm_start.set_mqtt_session(false);
+    warm_start.save();
   });
   ArduinoOTA.onEnd([]() {
     Serial.println("\nEnd");
@@ -101,8 +265,13 @@ void setup() {
   Serial.print("OTA ready - IP address: ");
   Serial.println(WiFi.localIP());
 
+  // Local time is needed for time windows of rules
+  configTime(TIMEZONE, NTP_SERVER);
+
   // Connect BME sensor
-  bme_detected = bme.begin(BME280_I2C_ADR);
+  bme_sampler.set_sampling(BME280_OVERSAMPLING_TEMPERATURE, BME280_OVERSAMPLING_HUMIDITY, BME280_OVERSAMPLING_PRESSURE, BME280_FILTER);
+  bme_sampler.set_publish_policy(BME280_DEADBAND_TEMPERATURE, BME280_DEADBAND_HUMIDITY, BME280_DEADBAND_PRESSURE, BME280_MAX_PUBLISH_INTERVAL);
+  bme_detected = bme_sampler.begin();
   if (bme_detected)
   {
     Serial.println("BME connected!");
@@ -115,18 +284,26 @@ void setup() {
   // Connect to MQTT
   byte mac[6];
   WiFi.macAddress(mac);
-  unique_id = "hoermann_door_" + String(mac[0], HEX) + String(mac[1], HEX) + String(mac[2], HEX) + String(mac[3], HEX) + String(mac[4], HEX) + String(mac[5], HEX);
-  unique_id.toLowerCase();
+  // Bytes without leading zeros, like the ids of earlier versions
+  snprintf(unique_id, sizeof(unique_id), "hoermann_door_%x%x%x%x%x%x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
   Serial.print("MQTT client id: ");
   Serial.println(unique_id);
   setup_mqtt_topics();
+  client.setCallback(mqtt_callback);
 
   Serial.print("Connecting to MQTT: ");
   Serial.print(MQTT_SERVER);
   Serial.print("...");
+  randomSeed(ESP.random());
+  if (warm_start.get_mqtt_session())
+  {
+    Serial.println("MQTT session restored");
+    restore_published_states();
+  }
+  connection.begin(millis(), warm_start.get_mqtt_session());
   if (connect_mqtt()) {
     Serial.println("connected");
-    publish_mqtt_autodiscovery();
+    connection.connected(millis());
     mqtt_init_publish_and_subscribe();
   } else {
     Serial.print("failed, rc=");
@@ -138,141 +315,494 @@ void setup() {
   Serial.end();
   Serial.begin(19200);
   Serial.swap();
-
-  StartTime = millis();
+  uart_driver.begin(&Serial, &channels[0].door);
+#if DOOR_COUNT > 1
+  for (uint8_t i = 1; i < DOOR_COUNT; i++)
+  {
+    door_serials[i - 1].begin(19200, SWSERIAL_8N1, door_rx_pins[i - 1], door_tx_pins[i - 1]);
+    serial_drivers[i - 1].begin(&door_serials[i - 1], &channels[i].door);
+  }
+#endif
+
+  // Idle time between tasks is spent in delay(), which allows the SDK to sleep
+  WiFi.setSleepMode(WIFI_SLEEP_MODE);
+
+  // Door communication has the highest priority, so it is serviced first whenever it is due
+  scheduler.add_task("door", door_task, DOOR_TASK_PERIOD, DOOR_TASK_PERIOD, 0);
+  scheduler.add_task("network", network_task, NETWORK_TASK_PERIOD, 50, 1);
+  scheduler.add_task("connection", connection_task, CONNECTION_TASK_PERIOD, 2000, 2);
+  scheduler.add_task("bme", bme_task, BME_TASK_PERIOD, 1000, 3);
+  scheduler.add_task("rules", rules_task, RULES_TASK_PERIOD, 100, 1);
+  scheduler.add_task("metrics", metrics_task, METRICS_TASK_PERIOD, 1000, 4);
+  scheduler.add_task("journal", journal_task, JOURNAL_TASK_PERIOD, 1000, 3);
+  scheduler.set_max_idle(DOOR_TASK_PERIOD);
+
+  // Everything allocated during setup stays, only allocations in steady state are counted
+  heap_monitor.reset();
 }
 
 void loop()
 {
-  door.loop();
+  scheduler.run();
+}
 
-  if (WiFi.status() != WL_CONNECTED)
+void door_task()
+{
+  bool all_received = true;
+  hoermann_state_t state;
+
+  uart_driver.loop();
+#if DOOR_COUNT > 1
+  for (uint8_t i = 0; i < (DOOR_COUNT - 1); i++)
   {
-    reconnect_wifi();
-    ReconnectCounter++;
-    last_door_state.data_valid = false;
+    serial_drivers[i].loop();
   }
-  else
+#endif
+
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
   {
-    if (!client.connected()) {
-      reconnect_mqtt();
-      ReconnectCounter++;
-      last_door_state.data_valid = false;
+    state = channels[i].door.get_state();
+
+    // Rules have to work without network, so they are fed directly from the door.
+    // A restored state isn't confirmed by the PIC yet, no rule may act on it.
+    if (channels[i].door.has_status())
+    {
+      channels[i].rules.update(state);
     }
-    else
+
+    warm_start.set_door_state(i, state);
+
+    if (state.data_valid && (HoermannStateCodec::pack(state) != HoermannStateCodec::pack(channels[i].journal_state)))
     {
-      client.loop();
+      journal.add_door_state(i, state);
+      channels[i].journal_state = state;
+    }
+    all_received = all_received && channels[i].door.has_status();
+  }
+  // Only written to RTC memory if a state changed
+  warm_start.save();
 
-      process_door_data();
+  // Restored states don't count, the PIC has to report them
+  if (all_received && (first_state_time == 0))
+  {
+    first_state_time = millis();
+  }
+}
 
-      if (bme_detected)
-      {
-        read_bme();
-      }
-      else
-      {
-        connect_bme();
-      }
+void rules_task()
+{
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    channels[i].rules.run();
+  }
+}
+
+void network_task()
+{
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    if (client.connected())
+    {
+      client.loop();
 
-      if (ReconnectCounter > 0) {
-        ReconnectCounter--;
+      for (uint8_t i = 0; i < DOOR_COUNT; i++)
+      {
+        process_door_data(&channels[i]);
       }
     }
 
     ArduinoOTA.handle();
+    if (ota_command[0] != '\0')
+    {
+      install_ota();
+    }
   }
+}
 
-  if (ReconnectCounter > 100) {
+void install_ota()
+{
+  WiFiClient ota_client;
+  HTTPClient http;
+  const ota_report_t *report;
+  bool success = false;
+  const char *url;
+  const char *md5;
+  int length;
+
+  // A retained command would install the package again after every connect
+  client.publish(ota_cmd_topic, "", true);
+
+  // Discovery contains the software version, so it has to be sent again by the new firmware.
+  // Written before the update, RTC memory must not be written between Update.end() and the restart.
+  warm_start.set_mqtt_session(false);
+  warm_start.save();
+
+  // "<url> <md5> <mac>", anyone on the broker may publish, only the OTA password holder can sign.
+  // The signed MD5 is checked over the new image, also for delta packages.
+  if (!ota_auth_check_command(ota_command, OTA_PASSWORT, &url, &md5))
+  {
+    ota_updater.reject("auth");
+  }
+  // Blocks the loop like ArduinoOTA, the package is streamed straight into flash
+  else if (http.begin(ota_client, url) && (http.GET() == HTTP_CODE_OK))
+  {
+    length = http.getSize();
+    if (length > 0)
+    {
+      success = ota_updater.install(http.getStreamPtr(), (uint32_t)length, md5);
+    }
+  }
+  http.end();
+  ota_command[0] = '\0';
+
+  report = ota_updater.get_report();
+  payload.clear();
+  payload.appendf(OTA_STATE_FORMAT, success ? "installed" : "failed", report->delta ? "delta" : "full", (unsigned long)report->received,
+                  (unsigned long)report->written, (unsigned long)report->duration, (report->error != NULL) ? report->error : "");
+  client.publish(ota_state_topic, payload.c_str(), false);
+
+  if (success)
+  {
+    client.disconnect();
     ESP.restart();
   }
 }
 
+void connection_task()
+{
+  bool wifi_connected = (WiFi.status() == WL_CONNECTED);
+  bool broker_connected = wifi_connected && client.connected();
+
+  switch (connection.run(millis(), wifi_connected, broker_connected))
+  {
+    case connection_reconnect_wifi:
+      reconnect_wifi();
+      break;
+    case connection_connect_mqtt:
+      reconnect_mqtt();
+      break;
+    case connection_send_discovery:
+      publish_mqtt_autodiscovery();
+      warm_start.set_mqtt_session(true);
+      break;
+    case connection_restart:
+      // Cached access point and broker session are not trustworthy anymore, only keep the door states
+      warm_start.clear_wifi();
+      warm_start.set_mqtt_session(false);
+      warm_start.save();
+      ESP.restart();
+      return;
+    default:
+      break;
+  }
+
+  if (broker_connected)
+  {
+    // Access point may change due to roaming
+    warm_start.set_wifi(WiFi.BSSID(), WiFi.channel());
+    warm_start.save();
+  }
+  else
+  {
+    invalidate_door_states();
+  }
+
+  heap_monitor.sample();
+}
+
+void bme_task()
+{
+  if (bme_detected)
+  {
+    read_bme();
+  }
+  else
+  {
+    connect_bme();
+  }
+}
+
+void metrics_task()
+{
+  static const char *bus_level_names[] = { "ok", "receiver_reset", "uart_reinit", "watchdog_reset" };
+  const task_t *task;
+  heap_stats_t heap;
+  hoermann_diagnostics_t diagnostics;
+  uint8_t i;
+
+  if (!mqtt_connected())
+  {
+    return;
+  }
+
+  heap_monitor.sample();
+  heap = heap_monitor.get_stats();
+
+  payload.clear();
+  payload.appendf(METRICS_HEADER_FORMAT, scheduler.get_load(), warm_start.is_restored() ? "true" : "false", (unsigned long)first_state_time,
+                  (unsigned long)heap.free, heap.max_block, heap.min_max_block, heap.fragmentation, (long)heap.allocations,
+                  (unsigned long)connection.get_connects(), (unsigned long)connection.get_last_outage(), (unsigned long)connection.get_retry_delay());
+  for (i = 0; i < scheduler.get_task_count(); i++)
+  {
+    task = scheduler.get_task(i);
+    payload.appendf(METRICS_TASK_FORMAT, (i > 0) ? "," : "", task->name, (unsigned long)task->runs, (unsigned long)task->overruns,
+                    (unsigned long)task->max_latency, (unsigned long)task->max_runtime);
+  }
+  payload.append(METRICS_DOORS_FORMAT);
+  for (i = 0; i < DOOR_COUNT; i++)
+  {
+    // -1 until the PIC reported it, older PIC firmware never does
+    diagnostics = channels[i].door.get_diagnostics();
+    payload.appendf(METRICS_DOOR_FORMAT, (i > 0) ? "," : "", diagnostics.valid ? diagnostics.active_percent : -1);
+    if (diagnostics.bus_valid && (diagnostics.bus_level <= hoermann_bus_watchdog_reset))
+    {
+      payload.appendf(METRICS_BUS_FORMAT, bus_level_names[diagnostics.bus_level], diagnostics.master_age, diagnostics.response_age,
+                      diagnostics.receiver_resets, diagnostics.uart_reinits, diagnostics.watchdog_resets, diagnostics.overruns,
+                      diagnostics.recoveries, diagnostics.mean_recovery_time);
+    }
+    if (diagnostics.slaves_valid)
+    {
+      payload.appendf(METRICS_SLAVES_FORMAT, diagnostics.rejected_slaves);
+    }
+    if (diagnostics.stray_valid)
+    {
+      payload.appendf(METRICS_STRAY_FORMAT, diagnostics.stray_bytes);
+    }
+    payload.append(METRICS_DOOR_TAIL);
+  }
+  payload.append(METRICS_TAIL);
+  if (!payload.overflow())
+  {
+    publish_oversize_payload(metrics_topic, payload.c_str(), false);
+  }
+  scheduler.reset_metrics();
+  heap_monitor.reset();
+}
+
+void journal_task()
+{
+  const journal_entry_t *entry;
+  uint16_t count;
+  uint16_t i;
+
+  if (!mqtt_connected() || (journal.get_count() == 0))
+  {
+    return;
+  }
+
+  // Limited batch per period, so a long outage doesn't flood the broker after reconnect
+  count = journal.get_count();
+  if (count > JOURNAL_BATCH_SIZE)
+  {
+    count = JOURNAL_BATCH_SIZE;
+  }
+
+  payload.clear();
+  payload.appendf(HISTORY_HEADER_FORMAT, (unsigned long)journal.get_dropped());
+  for (i = 0; i < count; i++)
+  {
+    entry = journal.peek(i);
+    append_journal_entry(entry, (i > 0) ? "," : "");
+  }
+  payload.append(HISTORY_TAIL);
+
+  // Removed once the batch was written to the TCP connection. PubSubClient only publishes with
+  // QoS 0, so a batch which is still in flight when the connection breaks is lost.
+  if (publish_oversize_payload(history_topic, payload.c_str(), false))
+  {
+    journal.remove(count);
+  }
+}
+
+void append_journal_entry(const journal_entry_t *entry, const char *separator)
+{
+  static const char *cover_names[] = { "stopped", "open", "closed", "opening", "closing" };
+  hoermann_state_t state;
+
+  if (entry->type == journal_door_state)
+  {
+    state = HoermannStateCodec::unpack(entry->state);
+    payload.appendf(HISTORY_DOOR_FORMAT, separator, (unsigned long)entry->time, (unsigned long)entry->uptime, entry->door + 1,
+                    cover_names[state.cover], state.venting ? "true" : "false", state.light ? "true" : "false",
+                    state.error ? "true" : "false", state.prewarn ? "true" : "false", state.option_relay ? "true" : "false");
+  }
+  else
+  {
+    payload.appendf(HISTORY_BME_FORMAT, separator, (unsigned long)entry->time, (unsigned long)entry->uptime,
+                    entry->bme.temperature / 100.0, entry->bme.humidity / 100.0, entry->bme.pressure / 10.0);
+  }
+}
+
+void invalidate_door_states() {
+  // All states are published again after the connection is back
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    channels[i].last_state.data_valid = false;
+  }
+}
+
+bool connect_cached_wifi() {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t start;
+
+  if (!warm_start.get_wifi(bssid, &channel))
+  {
+    return false;
+  }
+
+  // Connecting to the last access point skips the scan of all channels
+  WiFi.begin(WIFI_SSID, WIFI_PASS, channel, bssid);
+  start = millis();
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    if ((millis() - start) > WARM_START_WIFI_TIMEOUT)
+    {
+      // Access point is gone or moved to another channel, fall back to a full scan
+      warm_start.clear_wifi();
+      WiFi.disconnect();
+      return false;
+    }
+    delay(10);
+  }
+  return true;
+}
+
+void restore_door_states() {
+  hoermann_state_t state;
+
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    if (warm_start.get_door_state(i, &state))
+    {
+      channels[i].door.restore_state(state);
+      channels[i].journal_state = state;
+    }
+  }
+}
+
+void restore_published_states() {
+  // Only changes against the retained states of the last run have to be published.
+  // The door may have moved while the broker was unreachable, so it is compared with what was sent.
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    warm_start.get_published_state(i, &channels[i].last_state);
+  }
+}
+
 void reconnect_wifi() {
   WiFi.disconnect();
   WiFi.mode(WIFI_OFF);
   WiFi.mode(WIFI_STA);
   WiFi.begin(WIFI_SSID, WIFI_PASS);
-  delay(500);
 }
 
 void reconnect_mqtt() {
 
   if (connect_mqtt()) {
+    connection.connected(millis());
     mqtt_init_publish_and_subscribe();
-  } else {
-    delay(500);
-  }
-}
-
-bool connect_mqtt() {
-  if (client.connect(unique_id.c_str(), MQTT_USER, MQTT_PASSWORD, cover_avty_topic.c_str(), 0, true, "offline")) {
-    // Run loop a few times before proceeding
-    for (int i = 0; i < 50; i++) {
-      client.loop();
-      delay(10);
-    }
-    return client.connected();
   }
   else
   {
-    return false;
+    connection.failed(millis());
   }
 }
 
+bool connect_mqtt() {
+  // Incoming messages are handled by the next run of network_task, the door task isn't held up
+  return client.connect(unique_id, MQTT_USER, MQTT_PASSWORD, cover_avty_topic, 0, true, "offline");
+}
+
+bool mqtt_connected(void)
+{
+  return ((WiFi.status() == WL_CONNECTED) && client.connected());
+}
+
 void read_bme(void)
 {
-  String message;
-  uint32_t CurrentTime;
+  bme_sample_t sample;
 
-  CurrentTime = millis();
-  if ((CurrentTime - StartTime) >= 30000)
+  if (!bme_measuring)
   {
-    StartTime = CurrentTime;
-
-    Wire.beginTransmission(BME280_I2C_ADR);
-    if (Wire.endTransmission() == 0)
+    // Start a forced measurement and come back when it is finished
+    if (bme_sampler.trigger())
     {
-      message = "{ \"temperature_C\" : " + String(bme.readTemperature()) + ", \"humidity\" : " + String(bme.readHumidity()) + ", \"pressure_hPa\" : " + String(bme.readPressure() / 100.0F) + " }";
-      mqtt.publish(bme_state_topic, message, true);
+      bme_measuring = true;
+      scheduler.sleep(bme_sampler.get_measurement_time());
     }
     else
     {
-      mqtt.publish(bme_avty_topic, "offline", true);
-      bme_detected = false;
+      disconnect_bme();
     }
+    return;
   }
-}
 
-void connect_bme(void)
-{
-  String message;
-  uint32_t CurrentTime;
-
-  CurrentTime = millis();
-  if ((CurrentTime - StartTime) >= 30000)
+  switch (bme_sampler.get_status())
   {
-    StartTime = CurrentTime;
+    case bme_busy:
+      scheduler.sleep(1);
+      return;
+    case bme_error:
+      // Sensor dropped off the bus, connect_bme() tries again in the next period
+      disconnect_bme();
+      return;
+    default:
+      break;
+  }
+  bme_measuring = false;
 
-    bme_detected = bme.begin(BME280_I2C_ADR);
-    if (bme_detected)
+  if (!bme_sampler.read(&sample))
+  {
+    disconnect_bme();
+    return;
+  }
+  if (bme_sampler.needs_publish(sample))
+  {
+    // Recorded without connection as well, the journal is sent after reconnect
+    journal.add_bme_sample(sample.temperature, sample.humidity, sample.pressure);
+    if (mqtt_connected())
     {
-      mqtt.publish(bme_avty_topic, "online", true);
+      payload.clear();
+      payload.appendf(BME_STATE_FORMAT, sample.temperature, sample.humidity, sample.pressure);
+      client.publish(bme_state_topic, payload.c_str(), true);
     }
+    bme_sampler.mark_published(sample);
+  }
+}
+
+void disconnect_bme(void)
+{
+  bme_measuring = false;
+  bme_detected = false;
+  if (mqtt_connected())
+  {
+    client.publish(bme_avty_topic, "offline", true);
   }
 }
 
-void process_door_data() {
-  current_door_state = door.get_state();
+void connect_bme(void)
+{
+  bme_measuring = false;
+  bme_detected = bme_sampler.begin();
+  if (bme_detected && mqtt_connected())
+  {
+    client.publish(bme_avty_topic, "online", true);
+  }
+}
+
+void process_door_data(DoorChannel *channel) {
+  channel->current_state = channel->door.get_state();
   /* Terminate if data is not valid */
-  if (!current_door_state.data_valid)
+  if (!channel->current_state.data_valid)
   {
     return;
   }
 
-  if ((current_door_state.cover != last_door_state.cover) || (!last_door_state.data_valid))
+  if ((channel->current_state.cover != channel->last_state.cover) || (!channel->last_state.data_valid))
   {
-    String position_message;
-    switch (current_door_state.cover)
+    const char *position_message;
+    switch (channel->current_state.cover)
     {
       case cover_open:
         position_message = "100";
@@ -284,13 +814,13 @@ void process_door_data() {
         position_message = "10";
         break;
     }
-    mqtt.publish(cover_pos_topic, position_message, true);
-    last_door_state.cover = current_door_state.cover;
+    client.publish(channel->cover_pos_topic, position_message, true);
+    channel->last_state.cover = channel->current_state.cover;
   }
-  if ((current_door_state.venting != last_door_state.venting) || (!last_door_state.data_valid))
+  if ((channel->current_state.venting != channel->last_state.venting) || (!channel->last_state.data_valid))
   {
-    String state_message;
-    if (current_door_state.venting)
+    const char *state_message;
+    if (channel->current_state.venting)
     {
       state_message = "ON";
     }
@@ -298,13 +828,13 @@ void process_door_data() {
     {
       state_message = "OFF";
     }
-    mqtt.publish(venting_state_topic, state_message, true);
-    last_door_state.venting = current_door_state.venting;
+    client.publish(channel->venting_state_topic, state_message, true);
+    channel->last_state.venting = channel->current_state.venting;
   }
-  if ((current_door_state.light != last_door_state.light) || (!last_door_state.data_valid))
+  if ((channel->current_state.light != channel->last_state.light) || (!channel->last_state.data_valid))
   {
-    String state_message;
-    if (current_door_state.light)
+    const char *state_message;
+    if (channel->current_state.light)
     {
       state_message = "ON";
     }
@@ -312,13 +842,13 @@ void process_door_data() {
     {
       state_message = "OFF";
     }
-    mqtt.publish(light_state_topic, state_message, true);
-    last_door_state.light = current_door_state.light;
+    client.publish(channel->light_state_topic, state_message, true);
+    channel->last_state.light = channel->current_state.light;
   }
-  if ((current_door_state.error != last_door_state.error) || (!last_door_state.data_valid))
+  if ((channel->current_state.error != channel->last_state.error) || (!channel->last_state.data_valid))
   {
-    String state_message;
-    if (current_door_state.error)
+    const char *state_message;
+    if (channel->current_state.error)
     {
       state_message = "ON";
     }
@@ -326,13 +856,13 @@ void process_door_data() {
     {
       state_message = "OFF";
     }
-    mqtt.publish(error_state_topic, state_message, true);
-    last_door_state.error = current_door_state.error;
+    client.publish(channel->error_state_topic, state_message, true);
+    channel->last_state.error = channel->current_state.error;
   }
-  if ((current_door_state.prewarn != last_door_state.prewarn) || (!last_door_state.data_valid))
+  if ((channel->current_state.prewarn != channel->last_state.prewarn) || (!channel->last_state.data_valid))
   {
-    String state_message;
-    if (current_door_state.prewarn)
+    const char *state_message;
+    if (channel->current_state.prewarn)
     {
       state_message = "ON";
     }
@@ -340,13 +870,13 @@ void process_door_data() {
     {
       state_message = "OFF";
     }
-    mqtt.publish(prewarn_state_topic, state_message, true);
-    last_door_state.prewarn = current_door_state.prewarn;
+    client.publish(channel->prewarn_state_topic, state_message, true);
+    channel->last_state.prewarn = channel->current_state.prewarn;
   }
-  if ((current_door_state.option_relay != last_door_state.option_relay) || (!last_door_state.data_valid))
+  if ((channel->current_state.option_relay != channel->last_state.option_relay) || (!channel->last_state.data_valid))
   {
-    String state_message;
-    if (current_door_state.option_relay)
+    const char *state_message;
+    if (channel->current_state.option_relay)
     {
       state_message = "ON";
     }
@@ -354,175 +884,281 @@ void process_door_data() {
     {
       state_message = "OFF";
     }
-    mqtt.publish(option_relay_state_topic, state_message, true);
-    last_door_state.option_relay = current_door_state.option_relay;
+    client.publish(channel->option_relay_state_topic, state_message, true);
+    channel->last_state.option_relay = channel->current_state.option_relay;
   }
-  last_door_state.data_valid = current_door_state.data_valid;
+  channel->last_state.data_valid = channel->current_state.data_valid;
+  warm_start.set_published_state(channel->index, channel->last_state);
 }
 
 void setup_mqtt_topics() {
-  cover_avty_topic = "homeassistant/cover/" + unique_id + "_cover/availability";
-  cover_cmd_topic = "homeassistant/cover/" + unique_id + "_cover/command";
-  cover_pos_topic = "homeassistant/cover/" + unique_id + "_cover/position";
-
-  venting_cmd_topic = "homeassistant/switch/" + unique_id + "_venting/command";
-  venting_state_topic = "homeassistant/switch/" + unique_id + "_venting/state";
-
-  light_cmd_topic = "homeassistant/switch/" + unique_id + "_light/command";
-  light_state_topic = "homeassistant/switch/" + unique_id + "_light/state";
+  FORMAT_TOPIC(cover_avty_topic, "homeassistant/cover/", unique_id, "_cover/availability");
 
-  error_state_topic = "homeassistant/binary_sensor/" + unique_id + "_error/state";
-  prewarn_state_topic = "homeassistant/binary_sensor/" + unique_id + "_prewarn/state";
-  option_relay_state_topic = "homeassistant/binary_sensor/" + unique_id + "_option_relay/state";
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    channels[i].setup_topics(unique_id, i);
+  }
 
-  emergency_stop_cmd_topic = "homeassistant/button/" + unique_id + "_emergency_stop/trigger";
-  impulse_cmd_topic = "homeassistant/button/" + unique_id + "_impulse/trigger";
+  FORMAT_TOPIC(bme_avty_topic, "homeassistant/sensor/", unique_id, "_bme/availability");
+  FORMAT_TOPIC(bme_state_topic, "homeassistant/sensor/", unique_id, "_bme/state");
 
-  bme_avty_topic = "homeassistant/sensor/" + unique_id + "_bme/availability";
-  bme_state_topic = "homeassistant/sensor/" + unique_id + "_bme/state";
+  FORMAT_TOPIC(metrics_topic, "homeassistant/sensor/", unique_id, "_metrics/state");
+  FORMAT_TOPIC(history_topic, "homeassistant/sensor/", unique_id, "_history/state");
+  FORMAT_TOPIC(ota_cmd_topic, "homeassistant/sensor/", unique_id, "_ota/set");
+  FORMAT_TOPIC(ota_state_topic, "homeassistant/sensor/", unique_id, "_ota/state");
 }
 
 void mqtt_init_publish_and_subscribe() {
-  mqtt.subscribe(cover_cmd_topic, cover_cmd_subscriber);
-  mqtt.subscribe(venting_cmd_topic, venting_cmd_subscriber);
-  mqtt.subscribe(light_cmd_topic, light_cmd_subscriber);
-  mqtt.subscribe(emergency_stop_cmd_topic, emergency_stop_cmd_subscriber);
-  mqtt.subscribe(impulse_cmd_topic, impulse_cmd_subscriber);
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    client.subscribe(channels[i].cover_cmd_topic);
+    client.subscribe(channels[i].venting_cmd_topic);
+    client.subscribe(channels[i].light_cmd_topic);
+    client.subscribe(channels[i].emergency_stop_cmd_topic);
+    client.subscribe(channels[i].impulse_cmd_topic);
+    client.subscribe(channels[i].rules_cfg_topic);
+  }
+  client.subscribe(ota_cmd_topic);
 
-  mqtt.publish(cover_avty_topic, "online", true);
+  client.publish(cover_avty_topic, "online", true);
   if (bme_detected)
   {
-    mqtt.publish(bme_avty_topic, "online", true);
+    client.publish(bme_avty_topic, "online", true);
   }
   else
   {
-    mqtt.publish(bme_avty_topic, "offline", true);
+    client.publish(bme_avty_topic, "offline", true);
   }
 }
 
 void publish_mqtt_autodiscovery() {
-  String topic;
-  String payload;
+  char topic[TOPIC_SIZE];
+  char description[DISCOVERY_DEVICE_SIZE];
+  char obj_id[DISCOVERY_OBJECT_ID_SIZE];
+  discovery_device_t device;
 
-  String device = "\"dev\":{\"ids\":\"" + unique_id + "\", \"name\":\"" + HOSTNAME + "\", \"mdl\":\"Hoermann Door\", \"mf\":\"stephan192\", \"hw\":\"" + String(HW_VERSION) + "\", \"sw\":\"" + String(SW_VERSION) + "\"}";
-  String obj_id = String(HOSTNAME);
-  obj_id.toLowerCase();
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    publish_door_autodiscovery(&channels[i]);
+  }
 
-  topic = "homeassistant/cover/" + unique_id + "_cover/config";
-  payload = "{\"~\":\"homeassistant/cover/" + unique_id + "_cover\", \"avty_t\":\"~/availability\", \"cmd_t\":\"~/command\", " + device + ", \"dev_cla\":\"garage\", \"name\":\"Garage door\", \"def_ent_id\":\"cover." + obj_id + "_cover\", \"pos_t\":\"~/position\", \"uniq_id\":\"" + unique_id + "_cover\", \"en\":\"true\"}";
-  publish_oversize_payload(topic, payload, true);
+  // BME280 belongs to the device of the first door
+  get_device_description(&channels[0], description);
+  get_object_id(&channels[0], obj_id);
+  device.unique_id = unique_id;
+  device.object_id = obj_id;
+  device.description = description;
+  device.avty_topic = cover_avty_topic;
 
-  topic = "homeassistant/switch/" + unique_id + "_venting/config";
-  payload = "{\"~\":\"homeassistant/switch/" + unique_id + "_venting\", \"avty_t\":\"" + cover_avty_topic + "\", \"cmd_t\":\"~/command\", " + device + ", \"icon\":\"mdi:fan\", \"name\":\"Venting\", \"def_ent_id\":\"switch." + obj_id + "_venting\", \"stat_t\":\"~/state\", \"uniq_id\":\"" + unique_id + "_venting\", \"en\":\"true\"}";
-  publish_oversize_payload(topic, payload, true);
+  for (uint8_t i = 0; i < DISCOVERY_BME_ENTITY_COUNT; i++)
+  {
+    if (discovery_bme_entity(&device, bme_avty_topic, bme_state_topic, i, topic, &payload))
+    {
+      publish_oversize_payload(topic, payload.c_str(), true);
+    }
+  }
 
-  topic = "homeassistant/switch/" + unique_id + "_light/config";
-  payload = "{\"~\":\"homeassistant/switch/" + unique_id + "_light\", \"avty_t\":\"" + cover_avty_topic + "\", \"cmd_t\":\"~/command\", " + device + ", \"icon\":\"mdi:lightbulb\", \"name\":\"Light\", \"def_ent_id\":\"switch." + obj_id + "_light\", \"stat_t\":\"~/state\", \"uniq_id\":\"" + unique_id + "_light\", \"en\":\"false\"}";
-  publish_oversize_payload(topic, payload, true);
+  Serial.println("MQTT autodiscovery sent");
+}
 
-  topic = "homeassistant/binary_sensor/" + unique_id + "_error/config";
-  payload = "{\"~\":\"homeassistant/binary_sensor/" + unique_id + "_error\", \"avty_t\":\"" + cover_avty_topic + "\", " + device + ", \"dev_cla\":\"problem\", \"name\":\"Error\", \"def_ent_id\":\"binary_sensor." + obj_id + "_error\", \"stat_t\":\"~/state\", \"uniq_id\":\"" + unique_id + "_error\", \"en\":\"true\"}";
-  publish_oversize_payload(topic, payload, true);
+void get_device_description(DoorChannel *channel, char *description) {
+  char number[4] = "";
+  if (channel->index > 0)
+  {
+    snprintf(number, sizeof(number), " %u", channel->index + 1);
+  }
+  snprintf(description, DISCOVERY_DEVICE_SIZE, DEVICE_FORMAT, channel->unique_id, HOSTNAME, number);
+}
 
-  topic = "homeassistant/binary_sensor/" + unique_id + "_prewarn/config";
-  payload = "{\"~\":\"homeassistant/binary_sensor/" + unique_id + "_prewarn\", \"avty_t\":\"" + cover_avty_topic + "\", " + device + ", \"dev_cla\":\"safety\", \"name\":\"Prewarn\", \"def_ent_id\":\"binary_sensor." + obj_id + "_prewarn\", \"stat_t\":\"~/state\", \"uniq_id\":\"" + unique_id + "_prewarn\", \"en\":\"false\"}";
-  publish_oversize_payload(topic, payload, true);
+void get_object_id(DoorChannel *channel, char *obj_id) {
+  if (channel->index > 0)
+  {
+    snprintf(obj_id, DISCOVERY_OBJECT_ID_SIZE, "%s_%u", HOSTNAME, channel->index + 1);
+  }
+  else
+  {
+    snprintf(obj_id, DISCOVERY_OBJECT_ID_SIZE, "%s", HOSTNAME);
+  }
+  for (char *c = obj_id; *c != '\0'; c++)
+  {
+    *c = tolower(*c);
+  }
+}
 
-  topic = "homeassistant/binary_sensor/" + unique_id + "_option_relay/config";
-  payload = "{\"~\":\"homeassistant/binary_sensor/" + unique_id + "_option_relay\", \"avty_t\":\"" + cover_avty_topic + "\", " + device + ", \"name\":\"Option relay\", \"def_ent_id\":\"binary_sensor." + obj_id + "_option_relay\", \"stat_t\":\"~/state\", \"uniq_id\":\"" + unique_id + "_option_relay\", \"en\":\"false\"}";
-  publish_oversize_payload(topic, payload, true);
+void publish_door_autodiscovery(DoorChannel *channel) {
+  char topic[TOPIC_SIZE];
+  char description[DISCOVERY_DEVICE_SIZE];
+  char obj_id[DISCOVERY_OBJECT_ID_SIZE];
+  discovery_device_t device;
 
-  topic = "homeassistant/button/" + unique_id + "_emergency_stop/config";
-  payload = "{\"~\":\"homeassistant/button/" + unique_id + "_emergency_stop\", \"avty_t\":\"" + cover_avty_topic + "\", \"cmd_t\":\"homeassistant/button/" + unique_id + "_emergency_stop/trigger\", " + device + ", \"icon\":\"mdi:close-octagon\", \"name\":\"Emergency stop\", \"def_ent_id\":\"button." + obj_id + "_emergency_stop\", \"uniq_id\":\"" + unique_id + "_emergency_stop\", \"en\":\"false\"}";
-  publish_oversize_payload(topic, payload, true);
+  get_device_description(channel, description);
+  get_object_id(channel, obj_id);
+  device.unique_id = channel->unique_id;
+  device.object_id = obj_id;
+  device.description = description;
+  device.avty_topic = cover_avty_topic;
 
-  topic = "homeassistant/button/" + unique_id + "_impulse/config";
-  payload = "{\"~\":\"homeassistant/button/" + unique_id + "_impulse\", \"avty_t\":\"" + cover_avty_topic + "\", \"cmd_t\":\"homeassistant/button/" + unique_id + "_impulse/trigger\", " + device + ", \"icon\":\"mdi:arrow-up-down\", \"name\":\"Impulse\", \"def_ent_id\":\"button." + obj_id + "_impulse\", \"uniq_id\":\"" + unique_id + "_impulse\", \"en\":\"false\"}";
-  publish_oversize_payload(topic, payload, true);
+  for (uint8_t i = 0; i < DISCOVERY_DOOR_ENTITY_COUNT; i++)
+  {
+    if (discovery_door_entity(&device, i, topic, &payload))
+    {
+      publish_oversize_payload(topic, payload.c_str(), true);
+    }
+  }
+}
 
-  topic = "homeassistant/sensor/" + unique_id + "_temperature/config";
-  payload = "{\"avty\":[{\"topic\":\"" + cover_avty_topic + "\"}, {\"topic\":\"" + bme_avty_topic + "\"}], \"avty_mode\":\"all\", " + device + ", \"dev_cla\":\"temperature\", \"name\":\"Temperature\", \"def_ent_id\":\"sensor." + obj_id + "_temperature\", \"stat_cla\":\"measurement\", \"stat_t\":\"" + bme_state_topic + "\", \"uniq_id\":\"" + unique_id + "_temperature\", \"unit_of_meas\":\"\u00b0C\", \"val_tpl\":\"{{value_json.temperature_C|round(1)}}\", \"en\":\"true\"}";
-  publish_oversize_payload(topic, payload, true);
+bool publish_oversize_payload(const char *topic, const char *message, bool retain)
+{
+  size_t index = 0u;
+  size_t message_len = strlen(message);
+  size_t count;
 
-  topic = "homeassistant/sensor/" + unique_id + "_humidity/config";
-  payload = "{\"avty\":[{\"topic\":\"" + cover_avty_topic + "\"}, {\"topic\":\"" + bme_avty_topic + "\"}], \"avty_mode\":\"all\", " + device + ", \"dev_cla\":\"humidity\", \"name\":\"Humidity\", \"def_ent_id\":\"sensor." + obj_id + "_humidity\", \"stat_cla\":\"measurement\", \"stat_t\":\"" + bme_state_topic + "\", \"uniq_id\":\"" + unique_id + "_humidity\", \"unit_of_meas\":\"%\", \"val_tpl\":\"{{value_json.humidity|round(0)}}\", \"en\":\"true\"}";
-  publish_oversize_payload(topic, payload, true);
+  if (!client.beginPublish(topic, message_len, retain))
+  {
+    return false;
+  }
+  while (index < message_len)
+  {
+    count = message_len - index;
+    if (count > MQTT_MAX_PACKET_SIZE) count = MQTT_MAX_PACKET_SIZE;
 
-  topic = "homeassistant/sensor/" + unique_id + "_pressure/config";
-  payload = "{\"avty\":[{\"topic\":\"" + cover_avty_topic + "\"}, {\"topic\":\"" + bme_avty_topic + "\"}], \"avty_mode\":\"all\", " + device + ", \"dev_cla\":\"pressure\", \"name\":\"Pressure\", \"def_ent_id\":\"sensor." + obj_id + "_pressure\", \"stat_cla\":\"measurement\", \"stat_t\":\"" + bme_state_topic + "\", \"uniq_id\":\"" + unique_id + "_pressure\", \"unit_of_meas\":\"hPa\", \"val_tpl\":\"{{value_json.pressure_hPa|round(1)}}\", \"en\":\"true\"}";
-  publish_oversize_payload(topic, payload, true);
+    client.write((const uint8_t *)&message[index], count);
+    index += count;
+  }
+  return (client.endPublish() == 1);
+}
 
-  Serial.println("MQTT autodiscovery sent");
+DoorChannel *find_channel(const char *topic)
+{
+  for (uint8_t i = 0; i < DOOR_COUNT; i++)
+  {
+    if (channels[i].owns_topic(topic))
+    {
+      return &channels[i];
+    }
+  }
+  return NULL;
 }
 
-void publish_oversize_payload(String topic, String payload, bool retain)
+void mqtt_callback(char *topic, byte *data, unsigned int length)
 {
-  String substr;
-  unsigned int index = 0u;
-  unsigned int payload_len = payload.length();
-  unsigned int count;
+  // Payload is not terminated, copy it to have a string
+  static char message[MQTT_MAX_PACKET_SIZE + 1];
+  DoorChannel *channel;
 
-  client.beginPublish(topic.c_str(), payload.length(), retain);
-  while (index < payload_len)
+  if (strcmp(topic, ota_cmd_topic) == 0)
   {
-    count = payload_len - index;
-    if (count > MQTT_MAX_PACKET_SIZE) count = MQTT_MAX_PACKET_SIZE;
+    // Longer commands are ignored instead of truncated. Empty is the cleared retained command.
+    if ((length > 0) && (length < sizeof(ota_command)))
+    {
+      memcpy(ota_command, data, length);
+      ota_command[length] = '\0';
+    }
+    return;
+  }
 
-    substr = payload.substring(index, (index + count));
-    client.write((byte*)substr.c_str(), count);
-    index += count;
+  channel = find_channel(topic);
+  if (channel == NULL)
+  {
+    return;
+  }
+
+  if (length >= sizeof(message))
+  {
+    length = sizeof(message) - 1;
+  }
+  memcpy(message, data, length);
+  message[length] = '\0';
+
+  if (strcmp(topic, channel->cover_cmd_topic) == 0)
+  {
+    cover_cmd_subscriber(channel, message);
+  }
+  else if (strcmp(topic, channel->venting_cmd_topic) == 0)
+  {
+    venting_cmd_subscriber(channel, message);
+  }
+  else if (strcmp(topic, channel->light_cmd_topic) == 0)
+  {
+    light_cmd_subscriber(channel, message);
+  }
+  else if (strcmp(topic, channel->emergency_stop_cmd_topic) == 0)
+  {
+    emergency_stop_cmd_subscriber(channel, message);
+  }
+  else if (strcmp(topic, channel->impulse_cmd_topic) == 0)
+  {
+    impulse_cmd_subscriber(channel, message);
+  }
+  else if (strcmp(topic, channel->rules_cfg_topic) == 0)
+  {
+    rules_cfg_subscriber(channel, message);
   }
-  client.endPublish();
 }
 
-void cover_cmd_subscriber(String topic, String message)
+void cover_cmd_subscriber(DoorChannel *channel, const char *message)
 {
-  if (message == "OPEN")
+  if (strcmp(message, "OPEN") == 0)
   {
-    door.trigger_action(hoermann_action_open);
+    channel->door.trigger_action(hoermann_action_open);
   }
-  else if (message == "CLOSE")
+  else if (strcmp(message, "CLOSE") == 0)
   {
-    door.trigger_action(hoermann_action_close);
+    channel->door.trigger_action(hoermann_action_close);
   }
-  else if (message == "STOP")
+  else if (strcmp(message, "STOP") == 0)
   {
-    door.trigger_action(hoermann_action_stop);
+    channel->door.trigger_action(hoermann_action_stop);
   }
 }
 
-void venting_cmd_subscriber(String topic, String message)
+void venting_cmd_subscriber(DoorChannel *channel, const char *message)
 {
-  if (message == "ON")
+  if (strcmp(message, "ON") == 0)
   {
-    door.trigger_action(hoermann_action_venting);
+    channel->door.trigger_action(hoermann_action_venting);
   }
-  else if (message == "OFF")
+  else if (strcmp(message, "OFF") == 0)
   {
-    door.trigger_action(hoermann_action_close);
+    channel->door.trigger_action(hoermann_action_close);
   }
 }
 
-void light_cmd_subscriber(String topic, String message)
+void light_cmd_subscriber(DoorChannel *channel, const char *message)
 {
-  if ((message == "ON") || (message == "OFF"))
+  if ((strcmp(message, "ON") == 0) || (strcmp(message, "OFF") == 0))
   {
-    door.trigger_action(hoermann_action_toggle_light);
+    channel->door.trigger_action(hoermann_action_toggle_light);
   }
 }
 
-void emergency_stop_cmd_subscriber(String topic, String message)
+void emergency_stop_cmd_subscriber(DoorChannel *channel, const char *message)
 {
-  if (message == "PRESS")
+  if (strcmp(message, "PRESS") == 0)
   {
-    door.trigger_action(hoermann_action_emergency_stop);
+    channel->door.trigger_action(hoermann_action_emergency_stop);
   }
 }
 
-void impulse_cmd_subscriber(String topic, String message)
+void impulse_cmd_subscriber(DoorChannel *channel, const char *message)
 {
-  if (message == "PRESS")
+  if (strcmp(message, "PRESS") == 0)
+  {
+    channel->door.trigger_action(hoermann_action_impulse);
+  }
+}
+
+void rules_cfg_subscriber(DoorChannel *channel, const char *message)
+{
+  char state[48];
+
+  if (channel->rules.load(message))
+  {
+    snprintf(state, sizeof(state), "{ \"rules\" : %u }", channel->rules.get_rule_count());
+  }
+  else
   {
-    door.trigger_action(hoermann_action_impulse);
+    snprintf(state, sizeof(state), "{ \"rules\" : %u, \"error_rule\" : %d }", channel->rules.get_rule_count(), channel->rules.get_error_rule());
   }
+  client.publish(channel->rules_state_topic, state, true);
 }
@@ -0,0 +1,13 @@
+#include "Arduino.h"
+#include "esp_rtc_storage.h"
+
+bool EspRtcStorage::read(uint32_t offset, uint32_t *data, size_t size)
+{
+  // The core addresses RTC user memory in blocks of 4 bytes
+  return ESP.rtcUserMemoryRead(offset / 4, data, size);
+}
+
+bool EspRtcStorage::write(uint32_t offset, uint32_t *data, size_t size)
+{
+  return ESP.rtcUserMemoryWrite(offset / 4, data, size);
+}
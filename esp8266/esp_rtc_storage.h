@@ -0,0 +1,15 @@
+#ifndef EspRtcStorage_h
+#define EspRtcStorage_h
+
+#include "Arduino.h"
+#include "rtc_storage.h"
+
+/* RTC user memory of the ESP8266, 512 bytes */
+class EspRtcStorage : public RtcStorage
+{
+  public:
+    bool read(uint32_t offset, uint32_t *data, size_t size);
+    bool write(uint32_t offset, uint32_t *data, size_t size);
+};
+
+#endif
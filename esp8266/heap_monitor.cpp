@@ -0,0 +1,48 @@
+#include "Arduino.h"
+#include "heap_monitor.h"
+#ifdef UMM_STATS_FULL
+#include <umm_malloc/umm_malloc_cfg.h>
+#endif
+
+HeapMonitor::HeapMonitor(void)
+{
+  stats.free = 0;
+  stats.max_block = 0;
+  stats.fragmentation = 0;
+  stats.allocations = -1;
+  stats.min_max_block = 0xFFFF;
+  allocation_base = 0;
+}
+
+void HeapMonitor::sample(void)
+{
+  ESP.getHeapStats(&stats.free, &stats.max_block, &stats.fragmentation);
+  if (stats.max_block < stats.min_max_block)
+  {
+    stats.min_max_block = stats.max_block;
+  }
+#ifdef UMM_STATS_FULL
+  stats.allocations = (int32_t)(get_allocation_count() - allocation_base);
+#endif
+}
+
+heap_stats_t HeapMonitor::get_stats(void)
+{
+  return stats;
+}
+
+void HeapMonitor::reset(void)
+{
+  stats.min_max_block = 0xFFFF;
+  allocation_base = get_allocation_count();
+  sample();
+}
+
+uint32_t HeapMonitor::get_allocation_count(void)
+{
+#ifdef UMM_STATS_FULL
+  return (uint32_t)(umm_get_malloc_count() + umm_get_realloc_count());
+#else
+  return 0;
+#endif
+}
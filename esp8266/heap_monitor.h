@@ -0,0 +1,32 @@
+#ifndef HeapMonitor_h
+#define HeapMonitor_h
+
+#include "Arduino.h"
+
+typedef struct
+{
+  uint32_t free;
+  uint16_t max_block;       // largest block which can be allocated
+  uint16_t min_max_block;   // smallest max_block seen since the last reset
+  uint8_t fragmentation;    // %
+  int32_t allocations;      // malloc and realloc calls since the last reset, -1 = not available
+} heap_stats_t;
+
+/*
+ * Keeps track of heap usage. Allocation counts need the umm_malloc statistics
+ * of the core, which are enabled with the build flag -DUMM_STATS_FULL.
+ */
+class HeapMonitor
+{
+  public:
+    HeapMonitor();
+    void sample();
+    heap_stats_t get_stats();
+    void reset();
+  private:
+    heap_stats_t stats;
+    uint32_t allocation_base;
+    uint32_t get_allocation_count();
+};
+
+#endif
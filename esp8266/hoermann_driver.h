@@ -0,0 +1,460 @@
+#ifndef HoermannDriver_h
+#define HoermannDriver_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(p_address) (*(const uint8_t *)(p_address))
+#endif
+
+/*
+ * Hardware independent driver for the serial interface to the PIC. It has no
+ * Arduino dependencies, so it compiles for the ESP as well as for a host.
+ *
+ * HoermannDoor holds the state of a door and the pending action, so rules,
+ * journal and MQTT don't depend on the serial class. HoermannDriver moves
+ * the frames between a serial port and a HoermannDoor:
+ *
+ * Stream      Concrete serial class providing int available(), int read() and
+ *             size_t write(const uint8_t *, size_t), e.g. HardwareSerial. The
+ *             calls are qualified with it, so they are bound at compile time
+ *             even though the Arduino serial classes implement virtual methods.
+ * Checksum    Checksum policy, see AdditiveChecksum and Crc8Checksum
+ * MaxPayload  Maximum number of data bytes of a frame
+ *
+ * Lookup tables are constexpr and placed in flash, on the ESP8266 they don't
+ * take DRAM.
+ */
+
+typedef enum
+{
+  cover_stopped = 0,
+  cover_open,
+  cover_closed,
+  cover_opening,
+  cover_closing
+} cover_state_t;
+
+typedef struct
+{
+  cover_state_t cover;
+  bool venting;
+  bool error;
+  bool prewarn;
+  bool light;
+  bool option_relay;
+  bool data_valid;
+} hoermann_state_t;
+
+/* Recovery step of the bus supervisor on the PIC */
+typedef enum
+{
+  hoermann_bus_ok = 0,
+  hoermann_bus_receiver_reset,
+  hoermann_bus_uart_reinit,
+  hoermann_bus_watchdog_reset
+} hoermann_bus_level_t;
+
+/* Sent by the PIC between two status messages */
+typedef struct
+{
+  uint8_t active_percent;   // time the CPU was not in IDLE
+  bool valid;
+  hoermann_bus_level_t bus_level;
+  uint16_t master_age;      // ms since the last frame of the drive
+  uint16_t response_age;    // ms since the last response of the PIC
+  uint8_t receiver_resets;  // counters since power up, saturate at 255
+  uint8_t uart_reinits;
+  uint8_t watchdog_resets;
+  uint8_t overruns;
+  uint8_t recoveries;
+  uint16_t mean_recovery_time;  // ms
+  bool bus_valid;           // false for PIC firmware without supervisor
+  uint8_t rejected_slaves;  // bit n: entry n of HOERMANN_SLAVES was not accepted
+  bool slaves_valid;        // false for PIC firmware which doesn't report it
+  uint8_t stray_bytes;      // bytes of the bus outside of a frame, saturates at 255
+  bool stray_valid;         // false for PIC firmware which doesn't report it
+} hoermann_diagnostics_t;
+
+typedef enum
+{
+  hoermann_action_stop = 0,
+  hoermann_action_open,
+  hoermann_action_close,
+  hoermann_action_venting,
+  hoermann_action_toggle_light,
+  hoermann_action_emergency_stop,
+  hoermann_action_impulse,
+  hoermann_action_none
+} hoermann_action_t;
+
+/* Frame layout: SYNC CMD LEN DATA[LEN] CHK */
+struct HoermannFrame
+{
+  static constexpr uint8_t sync_byte = 0x55;
+  static constexpr uint8_t offset_cmd = 1;
+  static constexpr uint8_t offset_length = 2;
+  static constexpr uint8_t offset_data = 3;
+  static constexpr uint8_t overhead = 4;  // SYNC + CMD + LEN + CHK
+
+  static constexpr uint8_t cmd_status = 0x00;
+  static constexpr uint8_t cmd_action = 0x01;
+  static constexpr uint8_t cmd_diagnostics = 0x02;
+  static constexpr uint8_t status_length = 0x02;
+  static constexpr uint8_t diagnostics_min_length = 0x01;
+  static constexpr uint8_t diagnostics_bus_length = 0x0D;
+  static constexpr uint8_t diagnostics_slaves_length = 0x0E;
+  static constexpr uint8_t diagnostics_stray_length = 0x0F;
+};
+
+/* Sum of all bytes including the sync byte, used between ESP and PIC */
+struct AdditiveChecksum
+{
+  static uint8_t calc(const uint8_t *p_data, uint8_t length)
+  {
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+      crc += p_data[i];
+    }
+    return crc;
+  }
+};
+
+/* CRC8 with polynomial 0x07 and initial value 0xF3, used on the Hoermann bus */
+struct Crc8Checksum
+{
+  struct Table
+  {
+    uint8_t value[256];
+
+    constexpr Table() : value()
+    {
+      for (unsigned int i = 0; i < 256; i++)
+      {
+        uint8_t crc = (uint8_t)i;
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+          crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+        value[i] = crc;
+      }
+    }
+  };
+
+  static constexpr uint8_t initial_value = 0xF3;
+
+  static uint8_t calc(const uint8_t *p_data, uint8_t length)
+  {
+    static constexpr Table table PROGMEM;
+    uint8_t crc = initial_value;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+      crc = pgm_read_byte(&table.value[p_data[i] ^ crc]);
+    }
+    return crc;
+  }
+};
+
+/* Decodes the first status byte of the broadcast, see docs/hoermann.md */
+struct HoermannStatusDecoder
+{
+  struct Table
+  {
+    uint8_t cover[256];
+
+    static constexpr cover_state_t decode_cover(uint8_t status)
+    {
+      return ((status & 0x01) == 0x01) ? cover_open :
+             ((status & 0x02) == 0x02) ? cover_closed :
+             ((status & 0x60) == 0x40) ? cover_opening :
+             ((status & 0x60) == 0x60) ? cover_closing :
+             cover_stopped;
+    }
+
+    constexpr Table() : cover()
+    {
+      for (unsigned int i = 0; i < 256; i++)
+      {
+        cover[i] = (uint8_t)decode_cover((uint8_t)i);
+      }
+    }
+  };
+
+  static void decode(const uint8_t *p_data, hoermann_state_t *p_state)
+  {
+    static constexpr Table table PROGMEM;
+
+    p_state->cover = (cover_state_t)pgm_read_byte(&table.cover[p_data[0]]);
+    p_state->option_relay = ((p_data[0] & 0x04) == 0x04);
+    p_state->light = ((p_data[0] & 0x08) == 0x08);
+    p_state->error = ((p_data[0] & 0x10) == 0x10);
+    p_state->venting = ((p_data[0] & 0x80) == 0x80);
+    p_state->prewarn = ((p_data[1] & 0x01) == 0x01);
+    p_state->data_valid = true;
+  }
+};
+
+/* Compact representation of a state, e.g. for RTC memory or the journal */
+struct HoermannStateCodec
+{
+  static constexpr uint16_t cover_mask = 0x0007;
+  static constexpr uint16_t venting = 0x0008;
+  static constexpr uint16_t error = 0x0010;
+  static constexpr uint16_t prewarn = 0x0020;
+  static constexpr uint16_t light = 0x0040;
+  static constexpr uint16_t option_relay = 0x0080;
+  static constexpr uint16_t valid = 0x0100;
+
+  static uint16_t pack(hoermann_state_t state)
+  {
+    uint16_t packed;
+
+    if (!state.data_valid)
+    {
+      return 0;
+    }
+
+    packed = ((uint16_t)state.cover & cover_mask) | valid;
+    packed |= state.venting ? venting : 0;
+    packed |= state.error ? error : 0;
+    packed |= state.prewarn ? prewarn : 0;
+    packed |= state.light ? light : 0;
+    packed |= state.option_relay ? option_relay : 0;
+    return packed;
+  }
+
+  static hoermann_state_t unpack(uint16_t packed)
+  {
+    hoermann_state_t state;
+
+    state.cover = (cover_state_t)(packed & cover_mask);
+    state.venting = ((packed & venting) != 0);
+    state.error = ((packed & error) != 0);
+    state.prewarn = ((packed & prewarn) != 0);
+    state.light = ((packed & light) != 0);
+    state.option_relay = ((packed & option_relay) != 0);
+    state.data_valid = ((packed & valid) != 0);
+    return state;
+  }
+};
+
+/* State of a door as reported by the PIC, and the action to send next */
+class HoermannDoor
+{
+  public:
+    HoermannDoor()
+    {
+      status_received = false;
+      actual_state.data_valid = false;
+      actual_action = hoermann_action_none;
+      diagnostics.valid = false;
+      diagnostics.bus_valid = false;
+      diagnostics.slaves_valid = false;
+      diagnostics.stray_valid = false;
+    }
+
+    hoermann_state_t get_state() const
+    {
+      return actual_state;
+    }
+
+    hoermann_diagnostics_t get_diagnostics() const
+    {
+      return diagnostics;
+    }
+
+    void trigger_action(hoermann_action_t action)
+    {
+      actual_action = action;
+    }
+
+    // Preset the state until the first status is received, e.g. after a warm start
+    void restore_state(hoermann_state_t state)
+    {
+      if (!status_received)
+      {
+        actual_state = state;
+      }
+    }
+
+    // True once the PIC reported a status, a restored state doesn't count
+    bool has_status() const
+    {
+      return status_received;
+    }
+
+    // Returns the pending action once, hoermann_action_none if there is none
+    hoermann_action_t take_action()
+    {
+      hoermann_action_t action = actual_action;
+
+      actual_action = hoermann_action_none;
+      return action;
+    }
+
+    // Frame with valid checksum, p_frame points to the sync byte
+    void handle_frame(const uint8_t *p_frame)
+    {
+      const uint8_t *p_data = &p_frame[HoermannFrame::offset_data];
+      uint8_t length = p_frame[HoermannFrame::offset_length];
+
+      if ((p_frame[HoermannFrame::offset_cmd] == HoermannFrame::cmd_status) &&
+          (length == HoermannFrame::status_length))
+      {
+        HoermannStatusDecoder::decode(p_data, &actual_state);
+        status_received = true;
+      }
+      else if ((p_frame[HoermannFrame::offset_cmd] == HoermannFrame::cmd_diagnostics) &&
+               (length >= HoermannFrame::diagnostics_min_length))
+      {
+        // Older PIC firmware doesn't send it, newer may append fields
+        diagnostics.active_percent = p_data[0];
+        diagnostics.valid = true;
+        diagnostics.bus_valid = (length >= HoermannFrame::diagnostics_bus_length);
+        if (diagnostics.bus_valid)
+        {
+          diagnostics.bus_level = (hoermann_bus_level_t)p_data[1];
+          diagnostics.master_age = (uint16_t)p_data[2] | ((uint16_t)p_data[3] << 8);
+          diagnostics.response_age = (uint16_t)p_data[4] | ((uint16_t)p_data[5] << 8);
+          diagnostics.receiver_resets = p_data[6];
+          diagnostics.uart_reinits = p_data[7];
+          diagnostics.watchdog_resets = p_data[8];
+          diagnostics.overruns = p_data[9];
+          diagnostics.recoveries = p_data[10];
+          diagnostics.mean_recovery_time = (uint16_t)p_data[11] | ((uint16_t)p_data[12] << 8);
+        }
+        diagnostics.slaves_valid = (length >= HoermannFrame::diagnostics_slaves_length);
+        if (diagnostics.slaves_valid)
+        {
+          diagnostics.rejected_slaves = p_data[13];
+        }
+        diagnostics.stray_valid = (length >= HoermannFrame::diagnostics_stray_length);
+        if (diagnostics.stray_valid)
+        {
+          diagnostics.stray_bytes = p_data[14];
+        }
+      }
+    }
+
+  private:
+    bool status_received;
+    hoermann_state_t actual_state;
+    hoermann_action_t actual_action;
+    hoermann_diagnostics_t diagnostics;
+};
+
+template<class Stream, class Checksum, size_t MaxPayload>
+class HoermannDriver
+{
+  public:
+    static_assert(MaxPayload < 16, "Length is transmitted in 4 bits");
+    static constexpr size_t frame_size = MaxPayload + HoermannFrame::overhead;
+
+    HoermannDriver() : serial(nullptr), door(nullptr), rx_counter(0), rx_length(0)
+    {
+    }
+
+    HoermannDriver(Stream *stream, HoermannDoor *p_door) : serial(stream), door(p_door), rx_counter(0), rx_length(0)
+    {
+    }
+
+    void begin(Stream *stream, HoermannDoor *p_door)
+    {
+      serial = stream;
+      door = p_door;
+      rx_counter = 0;
+      rx_length = 0;
+    }
+
+    void loop()
+    {
+      hoermann_action_t action;
+
+      if ((serial == nullptr) || (door == nullptr))
+      {
+        return;
+      }
+
+      if (read_rs232())
+      {
+        door->handle_frame(rx_buffer);
+      }
+
+      action = door->take_action();
+      if (action != hoermann_action_none)
+      {
+        send_command(action);
+      }
+    }
+
+  private:
+    Stream *serial;
+    HoermannDoor *door;
+    uint8_t rx_buffer[frame_size];
+    uint8_t rx_counter;
+    uint8_t rx_length;
+    uint8_t output_buffer[frame_size];
+
+    bool read_rs232()
+    {
+      uint8_t data;
+
+      while (serial->Stream::available() > 0)
+      {
+        // read the incoming byte:
+        data = (uint8_t)serial->Stream::read();
+
+        if ((data == HoermannFrame::sync_byte) && (rx_counter == 0))
+        {
+          rx_buffer[rx_counter] = data;
+          rx_counter++;
+          rx_length = 0;
+        }
+        else if (rx_counter > 0)
+        {
+          rx_buffer[rx_counter] = data;
+          rx_counter++;
+          if (rx_counter == (HoermannFrame::offset_length + 1))
+          {
+            if (data <= MaxPayload)
+            {
+              rx_length = data + HoermannFrame::overhead;
+            }
+            else
+            {
+              rx_counter = 0;
+            }
+          }
+          else if (rx_counter == rx_length)
+          {
+            rx_counter = 0;
+            if (Checksum::calc(rx_buffer, rx_length - 1) == data)
+            {
+              return true;
+            }
+          }
+        }
+      }
+
+      return false;
+    }
+
+    void send_command(hoermann_action_t action)
+    {
+      output_buffer[0] = HoermannFrame::sync_byte;
+      output_buffer[HoermannFrame::offset_cmd] = HoermannFrame::cmd_action;
+      output_buffer[HoermannFrame::offset_length] = 0x01;
+      output_buffer[HoermannFrame::offset_data] = (uint8_t)action;
+      output_buffer[HoermannFrame::offset_data + 1] = Checksum::calc(output_buffer, HoermannFrame::offset_data + 1);
+      serial->Stream::write(&output_buffer[0], HoermannFrame::offset_data + 2);
+    }
+};
+
+#endif
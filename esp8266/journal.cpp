@@ -0,0 +1,81 @@
+#include "Arduino.h"
+#include "clock.h"
+#include "journal.h"
+
+Journal::Journal(void)
+{
+  head = 0;
+  count = 0;
+  dropped = 0;
+}
+
+void Journal::add_door_state(uint8_t door, hoermann_state_t state)
+{
+  journal_entry_t *entry = add(journal_door_state);
+
+  entry->door = door;
+  entry->state = HoermannStateCodec::pack(state);
+}
+
+void Journal::add_bme_sample(float temperature, float humidity, float pressure)
+{
+  journal_entry_t *entry = add(journal_bme_sample);
+
+  entry->door = 0;
+  entry->bme.temperature = (int16_t)lroundf(temperature * 100.0F);
+  entry->bme.humidity = (uint16_t)lroundf(humidity * 100.0F);
+  entry->bme.pressure = (uint16_t)lroundf(pressure * 10.0F);
+}
+
+uint16_t Journal::get_count(void)
+{
+  return count;
+}
+
+uint32_t Journal::get_dropped(void)
+{
+  return dropped;
+}
+
+const journal_entry_t *Journal::peek(uint16_t position)
+{
+  if (position >= count)
+  {
+    return NULL;
+  }
+  return &entries[(head + position) % JOURNAL_SIZE];
+}
+
+void Journal::remove(uint16_t number)
+{
+  if (number > count)
+  {
+    number = count;
+  }
+  head = (head + number) % JOURNAL_SIZE;
+  count -= number;
+  dropped = 0;
+}
+
+journal_entry_t *Journal::add(journal_type_t type)
+{
+  journal_entry_t *entry;
+  time_t now;
+
+  if (count == JOURNAL_SIZE)
+  {
+    /* Full, overwrite the oldest entry */
+    head = (head + 1) % JOURNAL_SIZE;
+    count--;
+    dropped++;
+  }
+
+  entry = &entries[(head + count) % JOURNAL_SIZE];
+  count++;
+
+  now = time(NULL);
+  entry->time = (now >= TIME_VALID_THRESHOLD) ? (uint32_t)now : 0;
+  entry->uptime = millis();
+  entry->type = type;
+  return entry;
+}
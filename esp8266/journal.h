@@ -0,0 +1,56 @@
+#ifndef Journal_h
+#define Journal_h
+
+#include "Arduino.h"
+#include "hoermann_driver.h"
+
+#define JOURNAL_SIZE          128
+
+typedef enum
+{
+  journal_door_state = 0,
+  journal_bme_sample
+} journal_type_t;
+
+typedef struct
+{
+  uint32_t time;              // unix time in s, 0 = clock not synchronized
+  uint32_t uptime;            // ms since boot
+  uint8_t type;               // journal_type_t
+  uint8_t door;               // index of the door for journal_door_state
+  union
+  {
+    uint16_t state;           // packed door state, see HoermannStateCodec
+    struct
+    {
+      int16_t temperature;    // 0.01 °C
+      uint16_t humidity;      // 0.01 %
+      uint16_t pressure;      // 0.1 hPa
+    } bme;
+  };
+} journal_entry_t;
+
+/*
+ * Ring buffer of door state transitions and BME samples. It is filled
+ * independent of the network, if it is full the oldest entries are dropped.
+ * It is kept in RAM only, a restart loses the entries not yet sent.
+ */
+class Journal
+{
+  public:
+    Journal();
+    void add_door_state(uint8_t door, hoermann_state_t state);
+    void add_bme_sample(float temperature, float humidity, float pressure);
+    uint16_t get_count();
+    uint32_t get_dropped();
+    const journal_entry_t *peek(uint16_t position);
+    void remove(uint16_t count);
+  private:
+    journal_entry_t entries[JOURNAL_SIZE];
+    uint16_t head;            // oldest entry
+    uint16_t count;
+    uint32_t dropped;         // entries overwritten since the last remove()
+    journal_entry_t *add(journal_type_t type);
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include <string.h>
+#include "ota_auth.h"
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_dword(p_address) (*(const uint32_t *)(p_address))
+#endif
+
+#define SHA256_BLOCK_SIZE   64
+#define HMAC_INNER_PAD      0x36
+#define HMAC_OUTER_PAD      0x5C
+
+typedef struct
+{
+  uint32_t state[8];
+  uint64_t length;        /* Bytes hashed so far */
+  uint8_t block[SHA256_BLOCK_SIZE];
+} sha256_t;
+
+static const uint32_t round_constants[64] PROGMEM = {
+  0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+  0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+  0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+  0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+  0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+  0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+  0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+  0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+
+static uint32_t rotate(uint32_t value, uint8_t bits)
+{
+  return (value >> bits) | (value << (32 - bits));
+}
+
+
+static void sha256_transform(sha256_t *p_sha)
+{
+  uint32_t w[64];
+  uint32_t v[8];
+  uint32_t t1;
+  uint32_t t2;
+  uint8_t i;
+
+  for (i = 0; i < 16; i++)
+  {
+    w[i] = ((uint32_t)p_sha->block[4 * i] << 24) | ((uint32_t)p_sha->block[4 * i + 1] << 16) |
+           ((uint32_t)p_sha->block[4 * i + 2] << 8) | (uint32_t)p_sha->block[4 * i + 3];
+  }
+  for (i = 16; i < 64; i++)
+  {
+    w[i] = w[i - 16] + (rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+           w[i - 7] + (rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10));
+  }
+
+  memcpy(v, p_sha->state, sizeof(v));
+  for (i = 0; i < 64; i++)
+  {
+    t1 = v[7] + (rotate(v[4], 6) ^ rotate(v[4], 11) ^ rotate(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+         pgm_read_dword(&round_constants[i]) + w[i];
+    t2 = (rotate(v[0], 2) ^ rotate(v[0], 13) ^ rotate(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+    memmove(&v[1], &v[0], 7 * sizeof(v[0]));
+    v[4] += t1;
+    v[0] = t1 + t2;
+  }
+  for (i = 0; i < 8; i++)
+  {
+    p_sha->state[i] += v[i];
+  }
+}
+
+
+static void sha256_init(sha256_t *p_sha)
+{
+  static const uint32_t initial_state[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+  };
+
+  memcpy(p_sha->state, initial_state, sizeof(p_sha->state));
+  p_sha->length = 0;
+}
+
+
+static void sha256_update(sha256_t *p_sha, const uint8_t *p_data, size_t length)
+{
+  size_t i;
+
+  for (i = 0; i < length; i++)
+  {
+    p_sha->block[p_sha->length % SHA256_BLOCK_SIZE] = p_data[i];
+    p_sha->length++;
+    if ((p_sha->length % SHA256_BLOCK_SIZE) == 0)
+    {
+      sha256_transform(p_sha);
+    }
+  }
+}
+
+
+static void sha256_final(sha256_t *p_sha, uint8_t *p_hash)
+{
+  uint64_t bits = p_sha->length * 8;
+  uint8_t padding = 0x80;
+  uint8_t i;
+
+  /* 0x80, zeros up to 56 bytes in the last block, length in bits */
+  sha256_update(p_sha, &padding, 1);
+  padding = 0x00;
+  while ((p_sha->length % SHA256_BLOCK_SIZE) != (SHA256_BLOCK_SIZE - 8))
+  {
+    sha256_update(p_sha, &padding, 1);
+  }
+  for (i = 0; i < 8; i++)
+  {
+    padding = (uint8_t)(bits >> (56 - 8 * i));
+    sha256_update(p_sha, &padding, 1);
+  }
+
+  for (i = 0; i < 32; i++)
+  {
+    p_hash[i] = (uint8_t)(p_sha->state[i / 4] >> (24 - 8 * (i % 4)));
+  }
+}
+
+
+/* RFC 2104 with SHA-256, keys longer than a block are hashed first */
+void ota_auth_hmac(const char *p_key, const uint8_t *p_data, size_t length, uint8_t *p_mac)
+{
+  sha256_t sha;
+  uint8_t key[SHA256_BLOCK_SIZE];
+  uint8_t pad[SHA256_BLOCK_SIZE];
+  size_t key_length;
+  uint8_t i;
+
+  memset(key, 0, sizeof(key));
+  key_length = strlen(p_key);
+  if (key_length > SHA256_BLOCK_SIZE)
+  {
+    sha256_init(&sha);
+    sha256_update(&sha, (const uint8_t *)p_key, key_length);
+    sha256_final(&sha, key);
+  }
+  else
+  {
+    memcpy(key, p_key, key_length);
+  }
+
+  for (i = 0; i < SHA256_BLOCK_SIZE; i++)
+  {
+    pad[i] = key[i] ^ HMAC_INNER_PAD;
+  }
+  sha256_init(&sha);
+  sha256_update(&sha, pad, sizeof(pad));
+  sha256_update(&sha, p_data, length);
+  sha256_final(&sha, p_mac);
+
+  for (i = 0; i < SHA256_BLOCK_SIZE; i++)
+  {
+    pad[i] = key[i] ^ HMAC_OUTER_PAD;
+  }
+  sha256_init(&sha);
+  sha256_update(&sha, pad, sizeof(pad));
+  sha256_update(&sha, p_mac, OTA_AUTH_MAC_SIZE);
+  sha256_final(&sha, p_mac);
+}
+
+
+static int hex_digit(char c)
+{
+  if ((c >= '0') && (c <= '9'))
+  {
+    return c - '0';
+  }
+  if ((c >= 'a') && (c <= 'f'))
+  {
+    return c - 'a' + 10;
+  }
+  if ((c >= 'A') && (c <= 'F'))
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+
+/* Splits the command in place into URL and MD5 if its MAC matches. Fails
+ * without a key, i.e. an empty OTA_PASSWORT disables updates over MQTT. */
+bool ota_auth_check_command(char *p_command, const char *p_key, const char **pp_url, const char **pp_md5)
+{
+  uint8_t expected[OTA_AUTH_MAC_SIZE];
+  uint8_t difference = 0;
+  char *p_mac;
+  char *p_md5;
+  int high;
+  int low;
+  uint8_t i;
+
+  p_mac = strrchr(p_command, ' ');
+  if ((p_key[0] == '\0') || (p_mac == NULL) || (strlen(p_mac + 1) != (2 * OTA_AUTH_MAC_SIZE)))
+  {
+    return false;
+  }
+
+  ota_auth_hmac(p_key, (const uint8_t *)p_command, (size_t)(p_mac - p_command), expected);
+  p_mac++;
+  for (i = 0; i < OTA_AUTH_MAC_SIZE; i++)
+  {
+    high = hex_digit(p_mac[2 * i]);
+    low = hex_digit(p_mac[2 * i + 1]);
+    if ((high < 0) || (low < 0))
+    {
+      return false;
+    }
+    /* Compares all bytes, the time doesn't tell how many matched */
+    difference |= expected[i] ^ (uint8_t)((high << 4) | low);
+  }
+  if (difference != 0)
+  {
+    return false;
+  }
+
+  /* The MAC covers the whole text, but the URL must not contain spaces */
+  p_mac[-1] = '\0';
+  p_md5 = strchr(p_command, ' ');
+  if ((p_md5 == NULL) || (p_md5 == p_command) || (strlen(p_md5 + 1) != OTA_AUTH_MD5_LENGTH))
+  {
+    return false;
+  }
+  *p_md5 = '\0';
+  *pp_url = p_command;
+  *pp_md5 = p_md5 + 1;
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef OtaAuth_h
+#define OtaAuth_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Authentication of the OTA command from MQTT. Plain C, shared with the
+ * host tests.
+ *
+ * Command layout: "<url> <md5> <mac>", mac is the HMAC-SHA256 of
+ * "<url> <md5>" keyed with OTA_PASSWORT as 64 hex digits. The MD5 is
+ * checked by Update over the new image, so only the package the password
+ * holder named is installed, whatever the HTTP server sends.
+ */
+
+#define OTA_AUTH_MAC_SIZE   32
+#define OTA_AUTH_MD5_LENGTH 32  /* hex digits */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void ota_auth_hmac(const char *p_key, const uint8_t *p_data, size_t length, uint8_t *p_mac);
+extern bool ota_auth_check_command(char *p_command, const char *p_key, const char **pp_url, const char **pp_md5);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
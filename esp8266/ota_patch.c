@@ -0,0 +1,393 @@
+#include <string.h>
+#include "ota_patch.h"
+
+typedef enum
+{
+  state_opcode = 0,
+  state_copy_offset,
+  state_copy_length,
+  state_copy_unchanged,
+  state_copy_replaced,
+  state_copy_bytes,
+  state_literal_length,
+  state_literal_bytes,
+  state_end
+} state_t;
+
+
+static uint32_t get_u32(const uint8_t *p_data)
+{
+  return (uint32_t)p_data[0] | ((uint32_t)p_data[1] << 8) | ((uint32_t)p_data[2] << 16) | ((uint32_t)p_data[3] << 24);
+}
+
+
+static void put_u32(uint8_t *p_data, uint32_t value)
+{
+  p_data[0] = (uint8_t)value;
+  p_data[1] = (uint8_t)(value >> 8);
+  p_data[2] = (uint8_t)(value >> 16);
+  p_data[3] = (uint8_t)(value >> 24);
+}
+
+
+uint32_t ota_patch_crc32(uint32_t crc, const uint8_t *p_data, size_t length)
+{
+  size_t i;
+  uint8_t bit;
+
+  /* Bitwise instead of a table, saves 1k of RAM on the ESP */
+  crc = ~crc;
+  for (i = 0; i < length; i++)
+  {
+    crc ^= p_data[i];
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320UL) : (crc >> 1);
+    }
+  }
+
+  return ~crc;
+}
+
+
+bool ota_patch_parse_header(ota_patch_header_t *p_header, const uint8_t *p_data)
+{
+  if ((get_u32(&p_data[0]) != OTA_PATCH_MAGIC) ||
+      (get_u32(&p_data[20]) != ota_patch_crc32(0, p_data, 20)))
+  {
+    return false;
+  }
+
+  p_header->base_size = get_u32(&p_data[4]);
+  p_header->base_crc = get_u32(&p_data[8]);
+  p_header->target_size = get_u32(&p_data[12]);
+  p_header->target_crc = get_u32(&p_data[16]);
+  return true;
+}
+
+
+void ota_patch_write_header(const ota_patch_header_t *p_header, uint8_t *p_data)
+{
+  put_u32(&p_data[0], OTA_PATCH_MAGIC);
+  put_u32(&p_data[4], p_header->base_size);
+  put_u32(&p_data[8], p_header->base_crc);
+  put_u32(&p_data[12], p_header->target_size);
+  put_u32(&p_data[16], p_header->target_crc);
+  put_u32(&p_data[20], ota_patch_crc32(0, p_data, 20));
+}
+
+
+void ota_patch_init(ota_patch_t *p_patch, const ota_patch_header_t *p_header,
+                    ota_patch_read_t read, ota_patch_write_t write, void *p_context)
+{
+  memset(p_patch, 0, sizeof(*p_patch));
+  p_patch->header = *p_header;
+  p_patch->read = read;
+  p_patch->write = write;
+  p_patch->p_context = p_context;
+  p_patch->result = ota_patch_busy;
+  p_patch->state = state_opcode;
+}
+
+
+/* p_data holds length bytes of the base at offset */
+void ota_patch_normalize_base(uint32_t offset, uint8_t *p_data, size_t length)
+{
+  uint32_t position;
+
+  for (position = OTA_PATCH_FLASH_OFFSET; position < (OTA_PATCH_FLASH_OFFSET + OTA_PATCH_FLASH_LENGTH); position++)
+  {
+    if ((position >= offset) && ((position - offset) < length))
+    {
+      p_data[position - offset] = 0x00;
+    }
+  }
+}
+
+
+static bool read_base(ota_patch_t *p_patch, uint32_t offset, uint8_t *p_data, uint16_t length)
+{
+  if (!p_patch->read(p_patch->p_context, offset, p_data, length))
+  {
+    return false;
+  }
+  ota_patch_normalize_base(offset, p_data, length);
+  return true;
+}
+
+
+ota_patch_result_t ota_patch_check_base(ota_patch_t *p_patch, uint32_t base_size)
+{
+  uint32_t offset;
+  uint16_t length;
+  uint32_t crc = 0;
+
+  if (base_size != p_patch->header.base_size)
+  {
+    return ota_patch_error_base;
+  }
+
+  /* The block buffer is still unused */
+  for (offset = 0; offset < base_size; offset += length)
+  {
+    length = ((base_size - offset) > OTA_PATCH_BLOCK_SIZE) ? OTA_PATCH_BLOCK_SIZE : (uint16_t)(base_size - offset);
+    if (!read_base(p_patch, offset, p_patch->block, length))
+    {
+      return ota_patch_error_read;
+    }
+    crc = ota_patch_crc32(crc, p_patch->block, length);
+  }
+
+  return (crc == p_patch->header.base_crc) ? ota_patch_busy : ota_patch_error_base;
+}
+
+
+static bool flush_block(ota_patch_t *p_patch)
+{
+  if (!p_patch->write(p_patch->p_context, p_patch->block, p_patch->block_count))
+  {
+    return false;
+  }
+  p_patch->block_count = 0;
+  return true;
+}
+
+
+/* Makes room for up to length bytes in the block, returns the usable size */
+static uint16_t reserve(ota_patch_t *p_patch, uint32_t length)
+{
+  uint16_t space;
+
+  if (p_patch->block_count == OTA_PATCH_BLOCK_SIZE)
+  {
+    if (!flush_block(p_patch))
+    {
+      p_patch->result = ota_patch_error_write;
+      return 0;
+    }
+  }
+  if ((p_patch->written + length) > p_patch->header.target_size)
+  {
+    p_patch->result = ota_patch_error_size;
+    return 0;
+  }
+
+  space = OTA_PATCH_BLOCK_SIZE - p_patch->block_count;
+  return (length < space) ? (uint16_t)length : space;
+}
+
+
+static void commit(ota_patch_t *p_patch, uint16_t length)
+{
+  p_patch->crc = ota_patch_crc32(p_patch->crc, &p_patch->block[p_patch->block_count], length);
+  p_patch->block_count += length;
+  p_patch->written += length;
+}
+
+
+static void copy_base(ota_patch_t *p_patch, uint32_t length)
+{
+  uint16_t chunk;
+
+  if ((p_patch->old_position > p_patch->header.base_size) ||
+      (length > (p_patch->header.base_size - p_patch->old_position)))
+  {
+    p_patch->result = ota_patch_error_format;
+    return;
+  }
+
+  while ((length > 0) && (p_patch->result == ota_patch_busy))
+  {
+    chunk = reserve(p_patch, length);
+    if (chunk == 0)
+    {
+      return;
+    }
+    if (!read_base(p_patch, p_patch->old_position, &p_patch->block[p_patch->block_count], chunk))
+    {
+      p_patch->result = ota_patch_error_read;
+      return;
+    }
+    commit(p_patch, chunk);
+    p_patch->old_position += chunk;
+    length -= chunk;
+  }
+}
+
+
+static void put_byte(ota_patch_t *p_patch, uint8_t data)
+{
+  if (reserve(p_patch, 1) == 1)
+  {
+    p_patch->block[p_patch->block_count] = data;
+    commit(p_patch, 1);
+  }
+}
+
+
+/* Collects a LEB128 number, returns true when it is complete */
+static bool read_varint(ota_patch_t *p_patch, uint8_t data)
+{
+  if (p_patch->varint_shift > 28)
+  {
+    p_patch->result = ota_patch_error_format;
+    return false;
+  }
+  p_patch->varint |= (uint32_t)(data & 0x7F) << p_patch->varint_shift;
+  p_patch->varint_shift += 7;
+  return ((data & 0x80) == 0);
+}
+
+
+static void finish(ota_patch_t *p_patch)
+{
+  if (p_patch->written != p_patch->header.target_size)
+  {
+    p_patch->result = ota_patch_error_size;
+  }
+  else if (p_patch->crc != p_patch->header.target_crc)
+  {
+    p_patch->result = ota_patch_error_crc;
+  }
+  else if ((p_patch->block_count > 0) && !flush_block(p_patch))
+  {
+    p_patch->result = ota_patch_error_write;
+  }
+  else
+  {
+    p_patch->result = ota_patch_done;
+  }
+}
+
+
+/* Continues a copy after one of its segments ended */
+static void next_segment(ota_patch_t *p_patch, uint8_t state)
+{
+  p_patch->state = (p_patch->remaining == 0) ? state_opcode : state;
+}
+
+
+static void decode(ota_patch_t *p_patch, uint8_t data)
+{
+  uint32_t value = 0;
+
+  if ((p_patch->state != state_opcode) && (p_patch->state != state_copy_bytes) &&
+      (p_patch->state != state_literal_bytes) && (p_patch->state != state_end))
+  {
+    if (!read_varint(p_patch, data))
+    {
+      return;
+    }
+    value = p_patch->varint;
+    p_patch->varint = 0;
+    p_patch->varint_shift = 0;
+  }
+
+  switch (p_patch->state)
+  {
+    case state_opcode:
+      if (data == OTA_PATCH_OP_END)
+      {
+        p_patch->state = state_end;
+        finish(p_patch);
+      }
+      else if (data == OTA_PATCH_OP_COPY)
+      {
+        p_patch->state = state_copy_offset;
+      }
+      else if (data == OTA_PATCH_OP_LITERAL)
+      {
+        p_patch->state = state_literal_length;
+      }
+      else
+      {
+        p_patch->result = ota_patch_error_format;
+      }
+      break;
+
+    case state_copy_offset:
+      /* Zigzag encoded, small steps forward and backward stay short */
+      p_patch->old_position += (value & 1) ? ~(value >> 1) : (value >> 1);
+      p_patch->state = state_copy_length;
+      break;
+
+    case state_copy_length:
+      p_patch->remaining = value;
+      next_segment(p_patch, state_copy_unchanged);
+      break;
+
+    case state_copy_unchanged:
+      if (value > p_patch->remaining)
+      {
+        p_patch->result = ota_patch_error_format;
+        break;
+      }
+      copy_base(p_patch, value);
+      p_patch->remaining -= value;
+      next_segment(p_patch, state_copy_replaced);
+      break;
+
+    case state_copy_replaced:
+      if (value > p_patch->remaining)
+      {
+        p_patch->result = ota_patch_error_format;
+        break;
+      }
+      p_patch->segment = value;
+      p_patch->state = (value > 0) ? state_copy_bytes : state_copy_unchanged;
+      break;
+
+    case state_copy_bytes:
+      /* Replaced bytes consume their counterpart in the base image */
+      put_byte(p_patch, data);
+      p_patch->old_position++;
+      p_patch->remaining--;
+      p_patch->segment--;
+      if (p_patch->segment == 0)
+      {
+        next_segment(p_patch, state_copy_unchanged);
+      }
+      break;
+
+    case state_literal_length:
+      p_patch->remaining = value;
+      next_segment(p_patch, state_literal_bytes);
+      break;
+
+    case state_literal_bytes:
+      put_byte(p_patch, data);
+      p_patch->remaining--;
+      next_segment(p_patch, state_literal_bytes);
+      break;
+
+    default:
+      /* Data after END */
+      p_patch->result = ota_patch_error_format;
+      break;
+  }
+}
+
+
+ota_patch_result_t ota_patch_feed(ota_patch_t *p_patch, const uint8_t *p_data, size_t length)
+{
+  size_t i;
+
+  for (i = 0; (i < length) && (p_patch->result == ota_patch_busy); i++)
+  {
+    decode(p_patch, p_data[i]);
+  }
+
+  return p_patch->result;
+}
+
+
+const char *ota_patch_result_name(ota_patch_result_t result)
+{
+  static const char *names[] = { "busy", "done", "header", "base", "format", "read", "write", "size", "crc" };
+
+  if ((size_t)result >= (sizeof(names) / sizeof(names[0])))
+  {
+    return "unknown";
+  }
+  return names[result];
+}
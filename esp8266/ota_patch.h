@@ -0,0 +1,106 @@
+#ifndef OtaPatch_h
+#define OtaPatch_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Streaming decoder for delta firmware packages. Plain C, shared with the
+ * Linux packaging tool (linux/otapack.c).
+ *
+ * Package layout, all numbers little endian:
+ *   header   magic "HDP1", base size, base CRC-32, target size, target CRC-32,
+ *            CRC-32 of the preceding 20 bytes
+ *   ops      0x00 END
+ *            0x01 COPY  offset (zigzag varint, relative to the end of the
+ *                       previous copy), length (varint), then segments of
+ *                       unchanged (varint) and replaced (varint + bytes)
+ *                       bytes until length is reached
+ *            0x02 LITERAL  length (varint) + bytes
+ *
+ * The target image is written in blocks of OTA_PATCH_BLOCK_SIZE. The last
+ * block is only written after the CRC-32 of the whole target matched, so a
+ * broken package never completes the update.
+ *
+ * esptool and Update write flash mode, size and frequency of the chip into
+ * bytes 2 and 3 of the image header, so the running sketch differs there
+ * from its .bin. The decoder reads the base through
+ * ota_patch_normalize_base(), which sets them to 0, the packaging tool
+ * builds the base CRC and the copies from the normalised base as well.
+ */
+
+#define OTA_PATCH_MAGIC         0x31504448UL  /* "HDP1" */
+#define OTA_PATCH_HEADER_SIZE   24
+#define OTA_PATCH_BLOCK_SIZE    256
+#define OTA_PATCH_FLASH_OFFSET  2     /* Flash mode, size and frequency in the image header */
+#define OTA_PATCH_FLASH_LENGTH  2
+
+#define OTA_PATCH_OP_END        0x00
+#define OTA_PATCH_OP_COPY       0x01
+#define OTA_PATCH_OP_LITERAL    0x02
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+  ota_patch_busy = 0,
+  ota_patch_done,
+  ota_patch_error_header,
+  ota_patch_error_base,
+  ota_patch_error_format,
+  ota_patch_error_read,
+  ota_patch_error_write,
+  ota_patch_error_size,
+  ota_patch_error_crc
+} ota_patch_result_t;
+
+/* Reads length bytes of the running (base) image at offset */
+typedef bool (*ota_patch_read_t)(void *p_context, uint32_t offset, uint8_t *p_data, uint16_t length);
+/* Appends length bytes to the new (target) image */
+typedef bool (*ota_patch_write_t)(void *p_context, const uint8_t *p_data, uint16_t length);
+
+typedef struct
+{
+  uint32_t base_size;
+  uint32_t base_crc;
+  uint32_t target_size;
+  uint32_t target_crc;
+} ota_patch_header_t;
+
+typedef struct
+{
+  ota_patch_header_t header;
+  ota_patch_read_t read;
+  ota_patch_write_t write;
+  void *p_context;
+  ota_patch_result_t result;
+  uint8_t state;
+  uint32_t varint;
+  uint8_t varint_shift;
+  uint32_t old_position;
+  uint32_t remaining;     /* Bytes left of the current op */
+  uint32_t segment;       /* Bytes left of the current segment of a copy */
+  uint32_t written;
+  uint32_t crc;
+  uint16_t block_count;
+  uint8_t block[OTA_PATCH_BLOCK_SIZE];
+} ota_patch_t;
+
+extern uint32_t ota_patch_crc32(uint32_t crc, const uint8_t *p_data, size_t length);
+extern bool ota_patch_parse_header(ota_patch_header_t *p_header, const uint8_t *p_data);
+extern void ota_patch_write_header(const ota_patch_header_t *p_header, uint8_t *p_data);
+extern void ota_patch_init(ota_patch_t *p_patch, const ota_patch_header_t *p_header,
+                           ota_patch_read_t read, ota_patch_write_t write, void *p_context);
+extern void ota_patch_normalize_base(uint32_t offset, uint8_t *p_data, size_t length);
+extern ota_patch_result_t ota_patch_check_base(ota_patch_t *p_patch, uint32_t base_size);
+extern ota_patch_result_t ota_patch_feed(ota_patch_t *p_patch, const uint8_t *p_data, size_t length);
+extern const char *ota_patch_result_name(ota_patch_result_t result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
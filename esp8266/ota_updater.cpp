@@ -0,0 +1,217 @@
+#include "Arduino.h"
+#include <Updater.h>
+#include "ota_updater.h"
+
+OtaUpdater::OtaUpdater(void)
+{
+  report.delta = false;
+  report.received = 0;
+  report.written = 0;
+  report.duration = 0;
+  report.error = NULL;
+  expected_md5 = NULL;
+}
+
+bool OtaUpdater::install(Stream *stream, uint32_t length, const char *md5)
+{
+  ota_patch_header_t header;
+  uint32_t start;
+  bool success;
+
+  start = millis();
+  report.delta = false;
+  report.received = 0;
+  report.written = 0;
+  report.error = NULL;
+  expected_md5 = md5;
+  stream->setTimeout(OTA_STREAM_TIMEOUT);
+
+  if (length < OTA_PATCH_HEADER_SIZE)
+  {
+    success = fail("size");
+  }
+  else if (!receive(stream, buffer, OTA_PATCH_HEADER_SIZE))
+  {
+    success = false;
+  }
+  else if (ota_patch_parse_header(&header, buffer))
+  {
+    report.delta = true;
+    ota_patch_init(&patch, &header, read_base, write_target, this);
+    success = install_delta(stream, length);
+  }
+  else
+  {
+    success = install_image(stream, length, OTA_PATCH_HEADER_SIZE);
+  }
+
+  report.duration = millis() - start;
+  return success;
+}
+
+/* Reports a command which was refused before the download */
+void OtaUpdater::reject(const char *error)
+{
+  report.delta = false;
+  report.received = 0;
+  report.written = 0;
+  report.duration = 0;
+  report.error = error;
+}
+
+const ota_report_t *OtaUpdater::get_report(void)
+{
+  return &report;
+}
+
+bool OtaUpdater::receive(Stream *stream, uint8_t *p_data, size_t length)
+{
+  size_t count;
+
+  count = stream->readBytes(p_data, length);
+  report.received += count;
+  if (count != length)
+  {
+    return fail("timeout");
+  }
+  return true;
+}
+
+bool OtaUpdater::install_image(Stream *stream, uint32_t length, uint32_t received)
+{
+  uint32_t chunk;
+
+  // Sketch images start with 0xE9, gzip compressed ones with 0x1F 0x8B
+  if ((buffer[0] != 0xE9) && ((buffer[0] != 0x1F) || (buffer[1] != 0x8B)))
+  {
+    return fail("format");
+  }
+  if (!Update.begin(length))
+  {
+    return fail("begin");
+  }
+  // Nothing else protects a full image, the bootloader only checks its header
+  if (!set_md5(true))
+  {
+    return false;
+  }
+
+  chunk = received;
+  while (true)
+  {
+    if (Update.write(buffer, chunk) != chunk)
+    {
+      // end() without all data aborts the update
+      Update.end();
+      return fail("write");
+    }
+    report.written += chunk;
+    if (report.received == length)
+    {
+      break;
+    }
+    chunk = min(length - report.received, (uint32_t)sizeof(buffer));
+    if (!receive(stream, buffer, chunk))
+    {
+      Update.end();
+      return false;
+    }
+  }
+
+  return finish();
+}
+
+bool OtaUpdater::install_delta(Stream *stream, uint32_t length)
+{
+  ota_patch_result_t result;
+  uint32_t chunk;
+
+  // Only applies to the sketch it was built for
+  result = ota_patch_check_base(&patch, ESP.getSketchSize());
+  if (result != ota_patch_busy)
+  {
+    return fail(ota_patch_result_name(result));
+  }
+  if (!Update.begin(patch.header.target_size))
+  {
+    return fail("begin");
+  }
+  if (!set_md5(false))
+  {
+    return false;
+  }
+
+  while ((result == ota_patch_busy) && (report.received < length))
+  {
+    chunk = min(length - report.received, (uint32_t)sizeof(buffer));
+    if (!receive(stream, buffer, chunk))
+    {
+      Update.end();
+      return false;
+    }
+    result = ota_patch_feed(&patch, buffer, chunk);
+  }
+
+  if (result != ota_patch_done)
+  {
+    // The last block is held back until the CRC matched, so end() aborts
+    Update.end();
+    return fail((result == ota_patch_busy) ? "size" : ota_patch_result_name(result));
+  }
+  return finish();
+}
+
+bool OtaUpdater::set_md5(bool required)
+{
+  if (expected_md5 == NULL)
+  {
+    if (required)
+    {
+      // end() without data aborts the update
+      Update.end();
+      return fail("no md5");
+    }
+    return true;
+  }
+  // 32 hex digits, checked by Update over everything written
+  if (!Update.setMD5(expected_md5))
+  {
+    Update.end();
+    return fail("md5");
+  }
+  return true;
+}
+
+bool OtaUpdater::finish()
+{
+  if (!Update.end())
+  {
+    return fail((Update.getError() == UPDATE_ERROR_MD5) ? "md5" : "end");
+  }
+  return true;
+}
+
+bool OtaUpdater::fail(const char *error)
+{
+  report.error = error;
+  return false;
+}
+
+bool OtaUpdater::read_base(void *p_context, uint32_t offset, uint8_t *p_data, uint16_t length)
+{
+  // The running sketch starts at flash address 0, including the bootloader.
+  // Its flash header differs from the .bin, ota_patch normalises it.
+  return ESP.flashRead(offset, p_data, length);
+}
+
+bool OtaUpdater::write_target(void *p_context, const uint8_t *p_data, uint16_t length)
+{
+  OtaUpdater *updater = static_cast<OtaUpdater *>(p_context);
+
+  if (Update.write(const_cast<uint8_t *>(p_data), length) != length)
+  {
+    return false;
+  }
+  updater->report.written += length;
+  return true;
+}
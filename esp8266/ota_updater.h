@@ -0,0 +1,49 @@
+#ifndef OtaUpdater_h
+#define OtaUpdater_h
+
+#include "Arduino.h"
+#include "ota_patch.h"
+
+#define OTA_STREAM_BUFFER_SIZE  512
+#define OTA_STREAM_TIMEOUT      5000  // ms without data until the download is aborted
+
+typedef struct
+{
+  bool delta;               // delta package, otherwise a full (gzip) image
+  uint32_t received;        // bytes of the package, i.e. airtime
+  uint32_t written;         // bytes of the new image
+  uint32_t duration;        // ms
+  const char *error;        // NULL on success
+} ota_report_t;
+
+/*
+ * Installs a firmware package from a stream into the update partition.
+ * Full images (plain or gzip, the bootloader unpacks them) are passed to
+ * Update as they are and need the MD5 of the file. Delta packages (see
+ * ota_patch.h) are applied against the running sketch in bounded memory
+ * and checked with a rolling CRC-32 before the update is completed, the
+ * MD5 of the new image is checked in addition if it is given.
+ */
+class OtaUpdater
+{
+  public:
+    OtaUpdater();
+    bool install(Stream *stream, uint32_t length, const char *md5);
+    void reject(const char *error);
+    const ota_report_t *get_report();
+  private:
+    ota_patch_t patch;
+    uint8_t buffer[OTA_STREAM_BUFFER_SIZE];
+    ota_report_t report;
+    const char *expected_md5;
+    bool receive(Stream *stream, uint8_t *p_data, size_t length);
+    bool install_image(Stream *stream, uint32_t length, uint32_t received);
+    bool install_delta(Stream *stream, uint32_t length);
+    bool set_md5(bool required);
+    bool finish();
+    bool fail(const char *error);
+    static bool read_base(void *p_context, uint32_t offset, uint8_t *p_data, uint16_t length);
+    static bool write_target(void *p_context, const uint8_t *p_data, uint16_t length);
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef RtcStorage_h
+#define RtcStorage_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Memory which survives a software reset but not a power cycle. Offset and
+ * size are given in bytes and have to be multiples of 4.
+ */
+class RtcStorage
+{
+  public:
+    virtual ~RtcStorage() {}
+    virtual bool read(uint32_t offset, uint32_t *data, size_t size) = 0;
+    virtual bool write(uint32_t offset, uint32_t *data, size_t size) = 0;
+};
+
+#endif
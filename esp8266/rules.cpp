@@ -0,0 +1,383 @@
+#include "Arduino.h"
+#include "clock.h"
+#include "rules.h"
+
+#define RULES_MAX_TEXT_LENGTH   256
+
+#define FLAG_VENTING            0x01
+#define FLAG_LIGHT              0x02
+#define FLAG_ERROR              0x04
+#define FLAG_PREWARN            0x08
+#define FLAG_OPTION_RELAY       0x10
+
+#define COVER_MASK_ALL          0x1F
+
+typedef struct
+{
+  const char *name;
+  uint8_t value;
+} rule_keyword_t;
+
+static const rule_keyword_t cover_keywords[] = {
+  {"stopped", cover_stopped},
+  {"open", cover_open},
+  {"closed", cover_closed},
+  {"opening", cover_opening},
+  {"closing", cover_closing}
+};
+
+static const rule_keyword_t flag_keywords[] = {
+  {"venting", FLAG_VENTING},
+  {"light", FLAG_LIGHT},
+  {"error", FLAG_ERROR},
+  {"prewarn", FLAG_PREWARN},
+  {"option_relay", FLAG_OPTION_RELAY}
+};
+
+static const rule_keyword_t action_keywords[] = {
+  {"stop", hoermann_action_stop},
+  {"open", hoermann_action_open},
+  {"close", hoermann_action_close},
+  {"venting", hoermann_action_venting},
+  {"toggle_light", hoermann_action_toggle_light},
+  {"emergency_stop", hoermann_action_emergency_stop},
+  {"impulse", hoermann_action_impulse}
+};
+
+static bool find_keyword(const rule_keyword_t *keywords, uint8_t count, const char *name, uint8_t *value)
+{
+  uint8_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (strcmp(keywords[i].name, name) == 0)
+    {
+      *value = keywords[i].value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parse_time(const char *text, int16_t *minutes)
+{
+  unsigned int hour;
+  unsigned int minute;
+  char dummy;
+
+  if ((sscanf(text, "%u:%u%c", &hour, &minute, &dummy) != 2) || (hour > 23) || (minute > 59))
+  {
+    return false;
+  }
+  *minutes = (int16_t)((hour * 60) + minute);
+  return true;
+}
+
+RuleEngine::RuleEngine(HoermannDoor *door)
+{
+  target = door;
+  rule_count = 0;
+  error_rule = -1;
+  door_state.data_valid = false;
+}
+
+/*
+ * Rules are separated by ';' or newlines. Each rule has the format
+ *   <condition>[&<condition>...] [for <seconds>] [between <hh:mm>-<hh:mm>] do <action>
+ * A condition is a cover state (stopped, open, closed, opening, closing) or a
+ * flag (venting, light, error, prewarn, option_relay), optionally negated by '!'.
+ * Example: "venting for 600 do close; opening & !light do toggle_light"
+ */
+bool RuleEngine::load(const char *text)
+{
+  char buffer[RULES_MAX_TEXT_LENGTH];
+  rule_t parsed[RULES_MAX_COUNT];
+  uint8_t count = 0;
+  char *rule_text;
+  char *save;
+  uint8_t i;
+
+  if (strlen(text) >= sizeof(buffer))
+  {
+    error_rule = 0;
+    return false;
+  }
+  strcpy(buffer, text);
+
+  for (rule_text = strtok_r(buffer, ";\n", &save); rule_text != NULL; rule_text = strtok_r(NULL, ";\n", &save))
+  {
+    /* Skip empty rules */
+    if (strspn(rule_text, " \t\r") == strlen(rule_text))
+    {
+      continue;
+    }
+    if ((count >= RULES_MAX_COUNT) || !parse_rule(rule_text, &parsed[count]))
+    {
+      /* Keep the previous rule set if the new one is invalid */
+      error_rule = count;
+      return false;
+    }
+    count++;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    rules[i] = parsed[i];
+    states[i].matching = false;
+    states[i].fired = false;
+    states[i].since = 0;
+  }
+  rule_count = count;
+  error_rule = -1;
+  evaluate();
+  return true;
+}
+
+void RuleEngine::clear(void)
+{
+  rule_count = 0;
+  error_rule = -1;
+}
+
+uint8_t RuleEngine::get_rule_count(void)
+{
+  return rule_count;
+}
+
+int8_t RuleEngine::get_error_rule(void)
+{
+  return error_rule;
+}
+
+void RuleEngine::update(hoermann_state_t state)
+{
+  /* Only state transitions are of interest, timers are handled by run() */
+  if ((state.data_valid == door_state.data_valid) && (state.cover == door_state.cover) &&
+      (state.venting == door_state.venting) && (state.error == door_state.error) &&
+      (state.prewarn == door_state.prewarn) && (state.light == door_state.light) &&
+      (state.option_relay == door_state.option_relay))
+  {
+    return;
+  }
+
+  door_state = state;
+  evaluate();
+}
+
+void RuleEngine::run(void)
+{
+  evaluate();
+}
+
+bool RuleEngine::parse_rule(char *text, rule_t *rule)
+{
+  char *token;
+  char *save;
+  char *condition;
+  char *condition_save;
+  uint8_t conditions = 0;
+  unsigned long hold;
+  char *end;
+
+  rule->cover_mask = COVER_MASK_ALL;
+  rule->flags_set = 0;
+  rule->flags_clear = 0;
+  rule->hold = 0;
+  rule->window_start = -1;
+  rule->window_end = -1;
+  rule->action = hoermann_action_none;
+
+  token = strtok_r(text, " \t\r", &save);
+  while (token != NULL)
+  {
+    if (strcmp(token, "for") == 0)
+    {
+      token = strtok_r(NULL, " \t\r", &save);
+      if (token == NULL)
+      {
+        return false;
+      }
+      hold = strtoul(token, &end, 10);
+      if ((*end != '\0') || (hold > 0xFFFF))
+      {
+        return false;
+      }
+      rule->hold = (uint16_t)hold;
+    }
+    else if (strcmp(token, "between") == 0)
+    {
+      token = strtok_r(NULL, " \t\r", &save);
+      if ((token == NULL) || !parse_window(token, rule))
+      {
+        return false;
+      }
+    }
+    else if (strcmp(token, "do") == 0)
+    {
+      token = strtok_r(NULL, " \t\r", &save);
+      if ((token == NULL) || !parse_action(token, rule))
+      {
+        return false;
+      }
+      /* Nothing is allowed after the action */
+      return ((strtok_r(NULL, " \t\r", &save) == NULL) && (conditions > 0));
+    }
+    else
+    {
+      for (condition = strtok_r(token, "&", &condition_save); condition != NULL; condition = strtok_r(NULL, "&", &condition_save))
+      {
+        if (!parse_condition(condition, rule))
+        {
+          return false;
+        }
+        conditions++;
+      }
+    }
+    token = strtok_r(NULL, " \t\r", &save);
+  }
+
+  /* Action is missing */
+  return false;
+}
+
+bool RuleEngine::parse_condition(const char *token, rule_t *rule)
+{
+  bool negate = false;
+  uint8_t value;
+
+  if (token[0] == '!')
+  {
+    negate = true;
+    token++;
+  }
+
+  if (find_keyword(cover_keywords, sizeof(cover_keywords) / sizeof(cover_keywords[0]), token, &value))
+  {
+    if (negate)
+    {
+      rule->cover_mask &= (uint8_t)~(1 << value);
+    }
+    else
+    {
+      rule->cover_mask &= (uint8_t)(1 << value);
+    }
+    return true;
+  }
+  if (find_keyword(flag_keywords, sizeof(flag_keywords) / sizeof(flag_keywords[0]), token, &value))
+  {
+    if (negate)
+    {
+      rule->flags_clear |= value;
+    }
+    else
+    {
+      rule->flags_set |= value;
+    }
+    return true;
+  }
+  return false;
+}
+
+bool RuleEngine::parse_window(const char *token, rule_t *rule)
+{
+  char start[6];
+  const char *separator;
+
+  separator = strchr(token, '-');
+  if ((separator == NULL) || ((separator - token) >= (int)sizeof(start)))
+  {
+    return false;
+  }
+  memcpy(start, token, separator - token);
+  start[separator - token] = '\0';
+
+  return (parse_time(start, &rule->window_start) && parse_time(separator + 1, &rule->window_end));
+}
+
+bool RuleEngine::parse_action(const char *token, rule_t *rule)
+{
+  uint8_t value;
+
+  if (!find_keyword(action_keywords, sizeof(action_keywords) / sizeof(action_keywords[0]), token, &value))
+  {
+    return false;
+  }
+  rule->action = (hoermann_action_t)value;
+  return true;
+}
+
+bool RuleEngine::matches(const rule_t *rule)
+{
+  uint8_t flags = 0;
+
+  if (!door_state.data_valid)
+  {
+    return false;
+  }
+
+  if (door_state.venting) flags |= FLAG_VENTING;
+  if (door_state.light) flags |= FLAG_LIGHT;
+  if (door_state.error) flags |= FLAG_ERROR;
+  if (door_state.prewarn) flags |= FLAG_PREWARN;
+  if (door_state.option_relay) flags |= FLAG_OPTION_RELAY;
+
+  return (((rule->cover_mask & (1 << door_state.cover)) != 0) &&
+          ((flags & rule->flags_set) == rule->flags_set) &&
+          ((flags & rule->flags_clear) == 0));
+}
+
+bool RuleEngine::in_window(const rule_t *rule)
+{
+  time_t now;
+  struct tm local;
+  int16_t minute;
+
+  if (rule->window_start < 0)
+  {
+    return true;
+  }
+
+  now = time(NULL);
+  if (now < TIME_VALID_THRESHOLD)
+  {
+    return false;
+  }
+  localtime_r(&now, &local);
+  minute = (int16_t)((local.tm_hour * 60) + local.tm_min);
+
+  if (rule->window_start <= rule->window_end)
+  {
+    return ((minute >= rule->window_start) && (minute < rule->window_end));
+  }
+  /* Window wraps around midnight */
+  return ((minute >= rule->window_start) || (minute < rule->window_end));
+}
+
+void RuleEngine::evaluate(void)
+{
+  uint8_t i;
+  uint32_t now;
+
+  now = millis();
+  for (i = 0; i < rule_count; i++)
+  {
+    if (!matches(&rules[i]))
+    {
+      states[i].matching = false;
+      states[i].fired = false;
+      continue;
+    }
+
+    if (!states[i].matching)
+    {
+      states[i].matching = true;
+      states[i].since = now;
+    }
+
+    if ((!states[i].fired) && ((now - states[i].since) >= ((uint32_t)rules[i].hold * 1000)) && in_window(&rules[i]))
+    {
+      target->trigger_action(rules[i].action);
+      states[i].fired = true;
+    }
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef Rules_h
+#define Rules_h
+
+#include "Arduino.h"
+#include "hoermann_driver.h"
+
+#define RULES_MAX_COUNT   8
+
+typedef struct
+{
+  uint8_t cover_mask;       // bit n set = cover state n matches
+  uint8_t flags_set;        // flags which have to be active
+  uint8_t flags_clear;      // flags which have to be inactive
+  uint16_t hold;            // s the condition has to be fulfilled before the action is triggered
+  int16_t window_start;     // minute of day, -1 = no time window
+  int16_t window_end;       // minute of day
+  hoermann_action_t action;
+} rule_t;
+
+typedef struct
+{
+  bool matching;
+  bool fired;
+  uint32_t since;
+} rule_state_t;
+
+class RuleEngine
+{
+  public:
+    RuleEngine(HoermannDoor *door);
+    bool load(const char *text);
+    void clear();
+    uint8_t get_rule_count();
+    int8_t get_error_rule();
+    void update(hoermann_state_t state);
+    void run();
+  private:
+    HoermannDoor *target;
+    rule_t rules[RULES_MAX_COUNT];
+    rule_state_t states[RULES_MAX_COUNT];
+    uint8_t rule_count;
+    int8_t error_rule;
+    hoermann_state_t door_state;
+    bool parse_rule(char *text, rule_t *rule);
+    bool parse_condition(const char *token, rule_t *rule);
+    bool parse_window(const char *token, rule_t *rule);
+    bool parse_action(const char *token, rule_t *rule);
+    bool matches(const rule_t *rule);
+    bool in_window(const rule_t *rule);
+    void evaluate();
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "Arduino.h"
+#include "scheduler.h"
+
+Scheduler::Scheduler(void)
+{
+  task_count = 0;
+  current_task = NULL;
+  sleep_requested = false;
+  max_idle = 10;
+  reset_metrics();
+}
+
+uint8_t Scheduler::add_task(const char *name, task_callback_t callback, uint32_t period, uint32_t deadline, uint8_t priority)
+{
+  task_t *task;
+
+  if (task_count >= SCHEDULER_MAX_TASKS)
+  {
+    return SCHEDULER_INVALID_TASK;
+  }
+
+  task = &tasks[task_count];
+  task->name = name;
+  task->callback = callback;
+  task->period = period;
+  task->deadline = deadline;
+  task->priority = priority;
+  /* First release is immediately */
+  task->next_release = millis();
+  task->runs = 0;
+  task->overruns = 0;
+  task->max_latency = 0;
+  task->max_runtime = 0;
+
+  return task_count++;
+}
+
+void Scheduler::run(void)
+{
+  uint32_t now;
+  task_t *task;
+
+  now = millis();
+  task = get_next_task(now);
+  if (task != NULL)
+  {
+    execute(task);
+  }
+  else
+  {
+    idle(now);
+  }
+}
+
+void Scheduler::sleep(uint32_t duration)
+{
+  /* Only allowed from within a running task, postpones its next release */
+  if (current_task != NULL)
+  {
+    current_task->next_release = millis() + duration;
+    sleep_requested = true;
+  }
+}
+
+void Scheduler::set_max_idle(uint32_t duration)
+{
+  max_idle = duration;
+}
+
+uint8_t Scheduler::get_task_count(void)
+{
+  return task_count;
+}
+
+const task_t *Scheduler::get_task(uint8_t id)
+{
+  if (id >= task_count)
+  {
+    return NULL;
+  }
+  return &tasks[id];
+}
+
+uint8_t Scheduler::get_load(void)
+{
+  uint32_t elapsed;
+
+  elapsed = millis() - metrics_start;
+  if ((elapsed == 0) || (idle_time >= elapsed))
+  {
+    return 0;
+  }
+  return (uint8_t)(100 - ((idle_time * 100) / elapsed));
+}
+
+void Scheduler::reset_metrics(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < task_count; i++)
+  {
+    tasks[i].runs = 0;
+    tasks[i].overruns = 0;
+    tasks[i].max_latency = 0;
+    tasks[i].max_runtime = 0;
+  }
+  idle_time = 0;
+  metrics_start = millis();
+}
+
+task_t *Scheduler::get_next_task(uint32_t now)
+{
+  uint8_t i;
+  task_t *task;
+  task_t *next = NULL;
+
+  for (i = 0; i < task_count; i++)
+  {
+    task = &tasks[i];
+    /* Wrap around safe check if task is released */
+    if ((int32_t)(now - task->next_release) < 0)
+    {
+      continue;
+    }
+    if (next == NULL)
+    {
+      next = task;
+    }
+    else if (task->priority < next->priority)
+    {
+      next = task;
+    }
+    else if ((task->priority == next->priority) &&
+             ((int32_t)((task->next_release + task->deadline) - (next->next_release + next->deadline)) < 0))
+    {
+      /* Same priority, earliest deadline first */
+      next = task;
+    }
+  }
+
+  return next;
+}
+
+void Scheduler::execute(task_t *task)
+{
+  uint32_t release;
+  uint32_t latency;
+  uint32_t start;
+  uint32_t runtime;
+  uint32_t finish;
+
+  release = task->next_release;
+  current_task = task;
+  sleep_requested = false;
+
+  latency = millis() - release;
+  start = micros();
+  task->callback();
+  runtime = micros() - start;
+  finish = millis();
+
+  current_task = NULL;
+
+  task->runs++;
+  if (runtime > task->max_runtime)
+  {
+    task->max_runtime = runtime;
+  }
+  if (latency > task->max_latency)
+  {
+    task->max_latency = latency;
+  }
+  if ((finish - release) > task->deadline)
+  {
+    task->overruns++;
+  }
+
+  if (!sleep_requested)
+  {
+    if (task->period == 0)
+    {
+      task->next_release = finish;
+    }
+    else
+    {
+      /* Keep the release grid, skip releases which were missed completely */
+      task->next_release = release + task->period;
+      if ((int32_t)(finish - task->next_release) >= 0)
+      {
+        task->next_release = finish + task->period - ((finish - release) % task->period);
+      }
+    }
+  }
+}
+
+void Scheduler::idle(uint32_t now)
+{
+  uint8_t i;
+  uint32_t wait = max_idle;
+
+  for (i = 0; i < task_count; i++)
+  {
+    if ((tasks[i].next_release - now) < wait)
+    {
+      wait = tasks[i].next_release - now;
+    }
+  }
+
+  if (wait > 0)
+  {
+    /* delay() lets the SDK enter modem or light sleep, depending on WiFi.setSleepMode() */
+    idle_time += wait;
+    delay(wait);
+  }
+  else
+  {
+    yield();
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include "Arduino.h"
+
+#define SCHEDULER_MAX_TASKS     8
+#define SCHEDULER_INVALID_TASK  0xFF
+
+typedef void (*task_callback_t)(void);
+
+typedef struct
+{
+  const char *name;
+  task_callback_t callback;
+  uint32_t period;          // ms between two releases, 0 = run on every pass
+  uint32_t deadline;        // ms after release until the task has to be finished
+  uint8_t priority;         // 0 = highest priority
+  uint32_t next_release;    // millis() timestamp of the next release
+  uint32_t runs;
+  uint32_t overruns;        // number of runs which finished after their deadline
+  uint32_t max_latency;     // ms between release and start of the task
+  uint32_t max_runtime;     // us
+} task_t;
+
+class Scheduler
+{
+  public:
+    Scheduler();
+    uint8_t add_task(const char *name, task_callback_t callback, uint32_t period, uint32_t deadline, uint8_t priority);
+    void run();
+    void sleep(uint32_t duration);
+    void set_max_idle(uint32_t duration);
+    uint8_t get_task_count();
+    const task_t *get_task(uint8_t id);
+    uint8_t get_load();
+    void reset_metrics();
+  private:
+    task_t tasks[SCHEDULER_MAX_TASKS];
+    uint8_t task_count;
+    task_t *current_task;
+    bool sleep_requested;
+    uint32_t max_idle;
+    uint32_t idle_time;
+    uint32_t metrics_start;
+    task_t *get_next_task(uint32_t now);
+    void execute(task_t *task);
+    void idle(uint32_t now);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include "text_buffer.h"
+
+TextBuffer::TextBuffer(char *buffer, size_t buffer_size)
+{
+  data = buffer;
+  size = buffer_size;
+  clear();
+}
+
+void TextBuffer::clear(void)
+{
+  data[0] = '\0';
+  used = 0;
+  overflowed = false;
+}
+
+bool TextBuffer::append(const char *text)
+{
+  return appendf("%s", text);
+}
+
+bool TextBuffer::appendf(const char *format, ...)
+{
+  va_list args;
+  int count;
+
+  va_start(args, format);
+  count = vsnprintf(&data[used], size - used, format, args);
+  va_end(args);
+
+  if ((count < 0) || ((size_t)count >= (size - used)))
+  {
+    /* vsnprintf already terminated the cut text */
+    used = strlen(data);
+    overflowed = true;
+    return false;
+  }
+  used += count;
+  return true;
+}
+
+const char *TextBuffer::c_str(void) const
+{
+  return data;
+}
+
+size_t TextBuffer::length(void) const
+{
+  return used;
+}
+
+bool TextBuffer::overflow(void) const
+{
+  return overflowed;
+}
@@ -0,0 +1,44 @@
+#ifndef TextBuffer_h
+#define TextBuffer_h
+
+#include "Arduino.h"
+
+/* Length of a string without terminator, usable in static_assert */
+constexpr size_t text_length(const char *text)
+{
+  return (*text == '\0') ? 0 : 1 + text_length(text + 1);
+}
+
+/*
+ * Fixed capacity replacement for String on top of a given buffer. Text which
+ * doesn't fit is cut and the buffer is marked as overflowed, it never
+ * allocates.
+ */
+class TextBuffer
+{
+  public:
+    TextBuffer(char *buffer, size_t buffer_size);
+    void clear();
+    bool append(const char *text);
+    __attribute__((format(printf, 2, 3))) bool appendf(const char *format, ...);
+    const char *c_str() const;
+    size_t length() const;
+    bool overflow() const;
+  private:
+    char *data;
+    size_t size;
+    size_t used;
+    bool overflowed;
+};
+
+/* TextBuffer with its own storage */
+template<size_t Size>
+class StaticTextBuffer : public TextBuffer
+{
+  public:
+    StaticTextBuffer() : TextBuffer(storage, Size) {}
+  private:
+    char storage[Size];
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include <stddef.h>
+#include <string.h>
+#include "warm_start.h"
+
+#define WARM_START_MAGIC    0x48524d53  // "HRMS"
+#define WARM_START_VERSION  2
+
+static_assert((sizeof(warm_start_snapshot_t) % 4) == 0, "RTC memory is accessed in blocks of 4 bytes");
+// The eboot command of Updater lives in block 0, a snapshot there makes the bootloader ignore an update
+static_assert(WARM_START_OFFSET >= 128, "RTC user blocks 0 to 31 are reserved for OTA");
+static_assert((WARM_START_OFFSET + sizeof(warm_start_snapshot_t)) <= 512, "Snapshot does not fit into RTC user memory");
+
+WarmStart::WarmStart(RtcStorage *storage)
+{
+  this->storage = storage;
+  restored = false;
+  clear();
+}
+
+bool WarmStart::restore()
+{
+  restored = false;
+
+  if (storage->read(WARM_START_OFFSET, (uint32_t *)&snapshot, sizeof(snapshot)) &&
+      (snapshot.magic == WARM_START_MAGIC) &&
+      (snapshot.version == WARM_START_VERSION) &&
+      (snapshot.checksum == calc_checksum(&snapshot)))
+  {
+    restored = true;
+    dirty = false;
+  }
+  else
+  {
+    clear();
+  }
+
+  return restored;
+}
+
+bool WarmStart::is_restored()
+{
+  return restored;
+}
+
+void WarmStart::invalidate()
+{
+  clear();
+  save();
+}
+
+bool WarmStart::save()
+{
+  if (!dirty)
+  {
+    return true;
+  }
+
+  snapshot.checksum = calc_checksum(&snapshot);
+  if (storage->write(WARM_START_OFFSET, (uint32_t *)&snapshot, sizeof(snapshot)))
+  {
+    dirty = false;
+  }
+  return !dirty;
+}
+
+bool WarmStart::get_door_state(uint8_t index, hoermann_state_t *state)
+{
+  return get_state(snapshot.door_state, index, state);
+}
+
+void WarmStart::set_door_state(uint8_t index, hoermann_state_t state)
+{
+  set_state(snapshot.door_state, index, state);
+}
+
+bool WarmStart::get_published_state(uint8_t index, hoermann_state_t *state)
+{
+  return get_state(snapshot.published_state, index, state);
+}
+
+void WarmStart::set_published_state(uint8_t index, hoermann_state_t state)
+{
+  set_state(snapshot.published_state, index, state);
+}
+
+bool WarmStart::get_wifi(uint8_t *bssid, uint8_t *channel)
+{
+  if (snapshot.wifi_channel == 0)
+  {
+    return false;
+  }
+  memcpy(bssid, snapshot.wifi_bssid, sizeof(snapshot.wifi_bssid));
+  *channel = snapshot.wifi_channel;
+  return true;
+}
+
+void WarmStart::set_wifi(const uint8_t *bssid, uint8_t channel)
+{
+  if ((snapshot.wifi_channel != channel) || (memcmp(snapshot.wifi_bssid, bssid, sizeof(snapshot.wifi_bssid)) != 0))
+  {
+    memcpy(snapshot.wifi_bssid, bssid, sizeof(snapshot.wifi_bssid));
+    snapshot.wifi_channel = channel;
+    dirty = true;
+  }
+}
+
+void WarmStart::clear_wifi()
+{
+  if (snapshot.wifi_channel != 0)
+  {
+    memset(snapshot.wifi_bssid, 0, sizeof(snapshot.wifi_bssid));
+    snapshot.wifi_channel = 0;
+    dirty = true;
+  }
+}
+
+bool WarmStart::get_mqtt_session()
+{
+  return (snapshot.mqtt_session != 0);
+}
+
+void WarmStart::set_mqtt_session(bool session)
+{
+  if ((snapshot.mqtt_session != 0) != session)
+  {
+    snapshot.mqtt_session = session ? 1 : 0;
+    dirty = true;
+  }
+}
+
+void WarmStart::clear()
+{
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.magic = WARM_START_MAGIC;
+  snapshot.version = WARM_START_VERSION;
+  dirty = true;
+}
+
+bool WarmStart::get_state(const uint16_t *states, uint8_t index, hoermann_state_t *state)
+{
+  if ((index >= WARM_START_MAX_DOORS) || ((states[index] & HoermannStateCodec::valid) == 0))
+  {
+    return false;
+  }
+  *state = HoermannStateCodec::unpack(states[index]);
+  return true;
+}
+
+void WarmStart::set_state(uint16_t *states, uint8_t index, hoermann_state_t state)
+{
+  uint16_t packed;
+
+  if (index >= WARM_START_MAX_DOORS)
+  {
+    return;
+  }
+  packed = HoermannStateCodec::pack(state);
+  if (states[index] != packed)
+  {
+    states[index] = packed;
+    dirty = true;
+  }
+}
+
+uint32_t WarmStart::calc_checksum(const warm_start_snapshot_t *snapshot)
+{
+  // CRC-32 over everything but the checksum itself, bitwise to save flash
+  const uint8_t *p_data = (const uint8_t *)snapshot;
+  uint32_t crc = 0xFFFFFFFF;
+  uint8_t bit;
+
+  for (size_t i = 0; i < offsetof(warm_start_snapshot_t, checksum); i++)
+  {
+    crc ^= p_data[i];
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,58 @@
+#ifndef WarmStart_h
+#define WarmStart_h
+
+#include <stdint.h>
+#include "hoermann_driver.h"
+#include "rtc_storage.h"
+
+#define WARM_START_MAX_DOORS  8
+#define WARM_START_OFFSET     128   // byte offset in RTC memory, the core reserves the first 128 bytes for OTA
+
+typedef struct
+{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t wifi_channel;             // 0 = no cached access point
+  uint8_t wifi_bssid[6];
+  uint8_t mqtt_session;             // discovery is on the broker
+  uint8_t reserved[3];
+  uint16_t door_state[WARM_START_MAX_DOORS];      // last state of the PIC
+  uint16_t published_state[WARM_START_MAX_DOORS]; // last state sent to the broker, i.e. retained there
+  uint32_t checksum;
+} warm_start_snapshot_t;
+
+/*
+ * Keeps a checksummed snapshot of the runtime state in RTC memory, so that a
+ * restart can skip the WiFi scan, MQTT discovery and the wait for the first
+ * door status. A power cycle leaves random data which fails the checksum.
+ */
+class WarmStart
+{
+  public:
+    WarmStart(RtcStorage *storage);
+    bool restore();
+    bool is_restored();
+    void invalidate();
+    bool save();
+
+    bool get_door_state(uint8_t index, hoermann_state_t *state);
+    void set_door_state(uint8_t index, hoermann_state_t state);
+    bool get_published_state(uint8_t index, hoermann_state_t *state);
+    void set_published_state(uint8_t index, hoermann_state_t state);
+    bool get_wifi(uint8_t *bssid, uint8_t *channel);
+    void set_wifi(const uint8_t *bssid, uint8_t channel);
+    void clear_wifi();
+    bool get_mqtt_session();
+    void set_mqtt_session(bool session);
+  private:
+    RtcStorage *storage;
+    warm_start_snapshot_t snapshot;
+    bool restored;
+    bool dirty;
+    void clear();
+    bool get_state(const uint16_t *states, uint8_t index, hoermann_state_t *state);
+    void set_state(uint16_t *states, uint8_t index, hoermann_state_t state);
+    static uint32_t calc_checksum(const warm_start_snapshot_t *snapshot);
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <linux/serial.h>
+#include "bus.h"
+
+
+/* Response is scheduled relative to the time the request was read. USB
+ * adapters add some latency, so answer a bit earlier than the PIC does. */
+#define RESPONSE_LEAD_NS          500000L   /* Sync break and USB latency */
+/* Sync break before each frame, at least 13 bit times at 19200 baud */
+#define SYNC_BREAK_NS             1000000L
+/* Silence which also starts a frame, for adapters which don't report breaks
+ * and for ptys. Shorter than the response delay, longer than 2 byte times. */
+#define FRAME_GAP_NS              2000000L
+
+#define MARK_IDLE                 0
+#define MARK_ESCAPE               1
+#define MARK_ERROR                2
+
+
+static int configure_tty(int fd)
+{
+  struct termios tty;
+  struct serial_struct serial;
+
+  if(tcgetattr(fd, &tty) != 0)
+  {
+    return -1;
+  }
+
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, B19200);
+  cfsetospeed(&tty, B19200);
+  tty.c_cflag |= (CLOCAL | CREAD);
+  tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  /* Report breaks and framing errors as \377 \0 x, the sync break marks the
+   * start of each frame. A real \377 is received as \377 \377. */
+  tty.c_iflag &= ~(IGNBRK | BRKINT | IGNPAR);
+  tty.c_iflag |= PARMRK;
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+
+  if(tcsetattr(fd, TCSANOW, &tty) != 0)
+  {
+    return -1;
+  }
+
+  /* Not supported by every driver, the response window is still met by most
+   * adapters without it */
+  if(ioctl(fd, TIOCGSERIAL, &serial) == 0)
+  {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    (void)ioctl(fd, TIOCSSERIAL, &serial);
+  }
+
+  tcflush(fd, TCIOFLUSH);
+  return 0;
+}
+
+
+static void start_timer(bus_door_t *p_door, long delay_ns)
+{
+  struct itimerspec timer;
+
+  /* A zero timer would disarm it */
+  if(delay_ns <= 0)
+  {
+    delay_ns = 1;
+  }
+
+  memset(&timer, 0, sizeof(timer));
+  timer.it_value.tv_nsec = delay_ns;
+  timerfd_settime(p_door->timer_fd, 0, &timer, NULL);
+}
+
+
+static void start_response_timer(bus_door_t *p_door, uint8_t delay)
+{
+  /* A new request ends a sync break which is still running */
+  if(p_door->tx_break)
+  {
+    ioctl(p_door->fd, TIOCCBRK);
+    p_door->tx_break = false;
+  }
+  start_timer(p_door, ((long)delay * 1000000L) - RESPONSE_LEAD_NS);
+}
+
+
+static bool receive_byte(bus_door_t *p_door, uint8_t data)
+{
+  uint8_t length;
+  uint8_t delay = 0;
+
+  if(p_door->rx_counter < 0)
+  {
+    /* Wait for the next sync break */
+    return false;
+  }
+
+  p_door->rx_buffer[p_door->rx_counter] = data;
+  p_door->rx_counter++;
+  if(p_door->rx_counter == 2)
+  {
+    p_door->rx_length = hoermann_frame_length(data);
+  }
+  else if(p_door->rx_counter == p_door->rx_length)
+  {
+    p_door->rx_counter = -1;
+    if(hoermann_crc8(p_door->rx_buffer, p_door->rx_length) != 0x00)
+    {
+      return false;
+    }
+
+    length = hoermann_handle_frame(&p_door->bus, p_door->rx_buffer, p_door->tx_buffer, &delay);
+    if(length > 0)
+    {
+      p_door->tx_length = length;
+      start_response_timer(p_door, delay);
+    }
+    return (p_door->rx_buffer[0] == 0x00);
+  }
+
+  return false;
+}
+
+
+static void receive_sync_break(bus_door_t *p_door)
+{
+  p_door->rx_counter = 0;
+  p_door->rx_length = 0;
+}
+
+
+int bus_open(bus_door_t *p_door, const char *device)
+{
+  memset(p_door, 0, sizeof(*p_door));
+  p_door->device = device;
+  p_door->rx_counter = -1;
+  p_door->rx_mark_state = MARK_IDLE;
+  hoermann_bus_init(&p_door->bus);
+  hoermann_add_slave(&p_door->bus, HOERMANN_UAP1_ADDR, HOERMANN_UAP1_TYPE, HOERMANN_RESPONSE_DELAY);
+
+  p_door->fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if(p_door->fd < 0)
+  {
+    fprintf(stderr, "%s: %s\n", device, strerror(errno));
+    return -1;
+  }
+  if(configure_tty(p_door->fd) != 0)
+  {
+    fprintf(stderr, "%s: configuring tty failed: %s\n", device, strerror(errno));
+    close(p_door->fd);
+    return -1;
+  }
+
+  p_door->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(p_door->timer_fd < 0)
+  {
+    close(p_door->fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* Emulates an additional slave, e.g. to answer scans as another accessory */
+bool bus_add_slave(bus_door_t *p_door, uint8_t address, uint8_t type)
+{
+  return hoermann_add_slave(&p_door->bus, address, type, HOERMANN_RESPONSE_DELAY);
+}
+
+
+void bus_close(bus_door_t *p_door)
+{
+  close(p_door->timer_fd);
+  close(p_door->fd);
+}
+
+
+/* Reads all pending bytes, returns true if a broadcast status was received */
+bool bus_receive(bus_door_t *p_door)
+{
+  uint8_t buffer[256];
+  ssize_t count;
+  ssize_t i;
+  uint8_t data;
+  bool broadcast = false;
+  struct timespec now;
+  long gap_ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  gap_ns = ((long)(now.tv_sec - p_door->rx_time.tv_sec) * 1000000000L) + (now.tv_nsec - p_door->rx_time.tv_nsec);
+  p_door->rx_time = now;
+  /* Only while waiting for a frame, USB adapters may split a frame with a pause */
+  if((p_door->rx_counter < 0) && (gap_ns >= FRAME_GAP_NS))
+  {
+    receive_sync_break(p_door);
+  }
+
+  while((count = read(p_door->fd, buffer, sizeof(buffer))) > 0)
+  {
+    for(i = 0; i < count; i++)
+    {
+      data = buffer[i];
+      switch(p_door->rx_mark_state)
+      {
+        case MARK_IDLE:
+        {
+          if(data == 0xFF)
+          {
+            p_door->rx_mark_state = MARK_ESCAPE;
+          }
+          else
+          {
+            broadcast |= receive_byte(p_door, data);
+          }
+          break;
+        }
+        case MARK_ESCAPE:
+        {
+          if(data == 0x00)
+          {
+            p_door->rx_mark_state = MARK_ERROR;
+          }
+          else
+          {
+            p_door->rx_mark_state = MARK_IDLE;
+            broadcast |= receive_byte(p_door, data);
+          }
+          break;
+        }
+        default:
+        {
+          /* Break or framing error, both mark the start of a new frame like FERR on the PIC */
+          p_door->rx_mark_state = MARK_IDLE;
+          receive_sync_break(p_door);
+          break;
+        }
+      }
+    }
+  }
+
+  return broadcast;
+}
+
+
+/* Called when the response timer expired. The first expiry starts the sync
+ * break, the second one ends it and sends the response. Other buses are
+ * served in between instead of sleeping during the break. */
+void bus_send_response(bus_door_t *p_door)
+{
+  uint64_t expirations;
+
+  (void)read(p_door->timer_fd, &expirations, sizeof(expirations));
+  if(p_door->tx_length == 0)
+  {
+    return;
+  }
+
+  if(!p_door->tx_break)
+  {
+    ioctl(p_door->fd, TIOCSBRK);
+    p_door->tx_break = true;
+    start_timer(p_door, SYNC_BREAK_NS);
+    return;
+  }
+
+  ioctl(p_door->fd, TIOCCBRK);
+  p_door->tx_break = false;
+  if(write(p_door->fd, p_door->tx_buffer, p_door->tx_length) != p_door->tx_length)
+  {
+    fprintf(stderr, "%s: sending response failed\n", p_door->device);
+  }
+  p_door->tx_length = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "hoermann_protocol.h"
+
+typedef struct
+{
+  const char *device;
+  int fd;
+  int timer_fd;
+  hoermann_bus_t bus;
+  uint8_t rx_buffer[HOERMANN_MAX_FRAME_LENGTH];
+  int8_t rx_counter;
+  uint8_t rx_length;
+  uint8_t rx_mark_state;
+  struct timespec rx_time;  /* of the last read, a long gap starts a frame as well */
+  uint8_t tx_buffer[HOERMANN_MAX_FRAME_LENGTH];
+  uint8_t tx_length;
+  bool tx_break;
+} bus_door_t;
+
+extern int bus_open(bus_door_t *p_door, const char *device);
+extern bool bus_add_slave(bus_door_t *p_door, uint8_t address, uint8_t type);
+extern void bus_close(bus_door_t *p_door);
+extern bool bus_receive(bus_door_t *p_door);
+extern void bus_send_response(bus_door_t *p_door);
+
+#endif
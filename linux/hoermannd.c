@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "hoermann_protocol.h"
+#include "bus.h"
+#include "mqtt.h"
+
+
+#define MAX_DOORS             16
+#define MAX_EVENTS            (MAX_DOORS * 2 + 2)
+
+/* Tags of the epoll events, door events carry the door index in the lower bits */
+#define EVENT_SIGNAL          0x0100
+#define EVENT_MQTT            0x0200
+#define EVENT_DOOR_RX         0x0300
+#define EVENT_DOOR_TIMER      0x0400
+#define EVENT_TYPE_MASK       0xFF00
+#define EVENT_INDEX_MASK      0x00FF
+
+
+static bus_door_t doors[MAX_DOORS];
+static mqtt_door_t mqtt_doors[MAX_DOORS];
+static uint8_t door_count = 0;
+static int epoll_fd = -1;
+
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options] <tty> [<tty> ...]\n"
+          "  -H <host>      MQTT server (default localhost)\n"
+          "  -p <port>      MQTT port (default 1883)\n"
+          "  -u <user>      MQTT user\n"
+          "  -P <password>  MQTT password\n"
+          "  -n <name>      Device name shown in Home Assistant (default hostname)\n"
+          "  -i <id>        Unique id of the gateway (default hoermann_door_<hostname>)\n"
+          "  -s <adr>:<typ> Emulate an additional slave on every bus, e.g. 0x30:0x14\n",
+          program);
+}
+
+
+static int epoll_add(int fd, uint32_t events, uint32_t tag)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.u32 = tag;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+
+static void door_action(uint8_t door, hoermann_action_t action)
+{
+  hoermann_set_action(&doors[door].bus, action);
+}
+
+
+static int block_signals(void)
+{
+  sigset_t mask;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if(sigprocmask(SIG_BLOCK, &mask, NULL) != 0)
+  {
+    return -1;
+  }
+  return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+
+int main(int argc, char *argv[])
+{
+  static char hostname[HOST_NAME_MAX + 1];
+  static char default_id[MQTT_ID_LENGTH];
+  mqtt_config_t config = {"localhost", 1883, NULL, NULL, NULL, NULL};
+  struct epoll_event events[MAX_EVENTS];
+  int signal_fd;
+  int count;
+  int option;
+  int i;
+  uint8_t index;
+  bool running = true;
+  unsigned int slave_address;
+  unsigned int slave_type;
+  uint8_t extra_slaves[HOERMANN_MAX_SLAVES][2];
+  uint8_t extra_slave_count = 0;
+  uint8_t slave;
+
+  while((option = getopt(argc, argv, "H:p:u:P:n:i:s:h")) != -1)
+  {
+    switch(option)
+    {
+      case 'H': config.host = optarg; break;
+      case 'p': config.port = atoi(optarg); break;
+      case 'u': config.user = optarg; break;
+      case 'P': config.password = optarg; break;
+      case 'n': config.name = optarg; break;
+      case 'i': config.id = optarg; break;
+      case 's':
+        if((sscanf(optarg, "%i:%i", &slave_address, &slave_type) != 2) || (slave_address > 0xFF) || (slave_type > 0xFF) ||
+           (extra_slave_count >= (HOERMANN_MAX_SLAVES - 1)))
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        extra_slaves[extra_slave_count][0] = (uint8_t)slave_address;
+        extra_slaves[extra_slave_count][1] = (uint8_t)slave_type;
+        extra_slave_count++;
+        break;
+      default: usage(argv[0]); return EXIT_FAILURE;
+    }
+  }
+  if((optind >= argc) || ((argc - optind) > MAX_DOORS))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  gethostname(hostname, sizeof(hostname) - 1);
+  if(config.name == NULL)
+  {
+    config.name = hostname;
+  }
+  if(config.id == NULL)
+  {
+    snprintf(default_id, sizeof(default_id), "hoermann_door_%s", hostname);
+    config.id = default_id;
+  }
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  signal_fd = block_signals();
+  if((epoll_fd < 0) || (signal_fd < 0))
+  {
+    perror("hoermannd");
+    return EXIT_FAILURE;
+  }
+  epoll_add(signal_fd, EPOLLIN, EVENT_SIGNAL);
+
+  for(i = optind; i < argc; i++)
+  {
+    if(bus_open(&doors[door_count], argv[i]) != 0)
+    {
+      return EXIT_FAILURE;
+    }
+    for(slave = 0; slave < extra_slave_count; slave++)
+    {
+      if(!bus_add_slave(&doors[door_count], extra_slaves[slave][0], extra_slaves[slave][1]))
+      {
+        fprintf(stderr, "hoermannd: slave 0x%02X can't be added, check range and lower 4 bits of the address\n", extra_slaves[slave][0]);
+        return EXIT_FAILURE;
+      }
+    }
+    epoll_add(doors[door_count].fd, EPOLLIN, EVENT_DOOR_RX | door_count);
+    epoll_add(doors[door_count].timer_fd, EPOLLIN, EVENT_DOOR_TIMER | door_count);
+    door_count++;
+  }
+
+  if(mqtt_init(&config, mqtt_doors, door_count, door_action) != 0)
+  {
+    fprintf(stderr, "hoermannd: initialising mqtt failed\n");
+    return EXIT_FAILURE;
+  }
+  /* The broker connection runs in its own thread, commands arrive as events */
+  epoll_add(mqtt_event_fd(), EPOLLIN, EVENT_MQTT);
+
+  while(running)
+  {
+    count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    if(count < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      perror("hoermannd");
+      break;
+    }
+
+    /* Bus responses first, they have to meet the response window */
+    for(i = 0; i < count; i++)
+    {
+      if((events[i].data.u32 & EVENT_TYPE_MASK) == EVENT_DOOR_TIMER)
+      {
+        bus_send_response(&doors[events[i].data.u32 & EVENT_INDEX_MASK]);
+      }
+    }
+
+    for(i = 0; i < count; i++)
+    {
+      index = (uint8_t)(events[i].data.u32 & EVENT_INDEX_MASK);
+      switch(events[i].data.u32 & EVENT_TYPE_MASK)
+      {
+        case EVENT_DOOR_RX:
+        {
+          if(bus_receive(&doors[index]))
+          {
+            mqtt_publish_state(index, doors[index].bus.broadcast_status);
+          }
+          break;
+        }
+        case EVENT_MQTT:
+        {
+          mqtt_handle_events();
+          break;
+        }
+        case EVENT_SIGNAL:
+        {
+          running = false;
+          break;
+        }
+        default:
+        {
+          break;
+        }
+      }
+    }
+  }
+
+  mqtt_shutdown();
+  for(index = 0; index < door_count; index++)
+  {
+    bus_close(&doors[index]);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mosquitto.h>
+#include "mqtt.h"
+
+
+#define HW_VERSION                "linux"
+#define SW_VERSION                "v3.2"
+
+#define KEEPALIVE                 60
+#define PAYLOAD_LENGTH            1024
+#define RECONNECT_MIN_DELAY       1     /* s, doubled up to the maximum */
+#define RECONNECT_MAX_DELAY       60
+
+/* Events of the network thread for the main loop */
+#define EVENT_CONNECTED           0
+#define EVENT_DISCONNECTED        1
+#define EVENT_ACTION              2
+
+#define STATUS_OPEN               0x0001
+#define STATUS_CLOSED             0x0002
+#define STATUS_OPTION_RELAY       0x0004
+#define STATUS_LIGHT              0x0008
+#define STATUS_ERROR              0x0010
+#define STATUS_VENTING            0x0080
+#define STATUS_PREWARN            0x0100
+
+
+static struct mosquitto *mosq = NULL;
+static const mqtt_config_t *config = NULL;
+static mqtt_door_t *doors = NULL;
+static uint8_t door_count = 0;
+static mqtt_action_callback_t action_callback = NULL;
+static bool connected = false;
+/* Written by the network thread, read by the main loop */
+static int event_pipe[2] = {-1, -1};
+/* Availability is shared by all doors, like on the ESP gateway */
+static char avty_topic[MQTT_TOPIC_LENGTH];
+
+
+static void build_topic(char *p_topic, const char *component, const mqtt_door_t *p_door, const char *entity, const char *leaf)
+{
+  snprintf(p_topic, MQTT_TOPIC_LENGTH, "homeassistant/%s/%s_%s/%s", component, p_door->unique_id, entity, leaf);
+}
+
+
+static void publish(const char *topic, const char *payload, bool retain)
+{
+  if(mosquitto_publish(mosq, NULL, topic, (int)strlen(payload), payload, 0, retain) != MOSQ_ERR_SUCCESS)
+  {
+    fprintf(stderr, "mqtt: publishing %s failed\n", topic);
+  }
+}
+
+
+static void publish_entity_discovery(const mqtt_door_t *p_door, const char *component, const char *entity, const char *fields)
+{
+  char topic[MQTT_TOPIC_LENGTH];
+  char payload[PAYLOAD_LENGTH];
+
+  build_topic(topic, component, p_door, entity, "config");
+  snprintf(payload, sizeof(payload),
+           "{\"~\":\"homeassistant/%s/%s_%s\", \"avty_t\":\"%s\", "
+           "\"dev\":{\"ids\":\"%s\", \"name\":\"%s\", \"mdl\":\"Hoermann Door\", \"mf\":\"stephan192\", \"hw\":\"%s\", \"sw\":\"%s\"}, "
+           "\"def_ent_id\":\"%s.%s_%s\", \"uniq_id\":\"%s_%s\", %s}",
+           component, p_door->unique_id, entity, avty_topic,
+           p_door->unique_id, p_door->name, HW_VERSION, SW_VERSION,
+           component, p_door->obj_id, entity, p_door->unique_id, entity, fields);
+  publish(topic, payload, true);
+}
+
+
+static void publish_discovery(const mqtt_door_t *p_door)
+{
+  char fields[256];
+
+  publish_entity_discovery(p_door, "cover", "cover", "\"cmd_t\":\"~/command\", \"dev_cla\":\"garage\", \"name\":\"Garage door\", \"pos_t\":\"~/position\", \"en\":\"true\"");
+  publish_entity_discovery(p_door, "switch", "venting", "\"cmd_t\":\"~/command\", \"icon\":\"mdi:fan\", \"name\":\"Venting\", \"stat_t\":\"~/state\", \"en\":\"true\"");
+  publish_entity_discovery(p_door, "switch", "light", "\"cmd_t\":\"~/command\", \"icon\":\"mdi:lightbulb\", \"name\":\"Light\", \"stat_t\":\"~/state\", \"en\":\"false\"");
+  publish_entity_discovery(p_door, "binary_sensor", "error", "\"dev_cla\":\"problem\", \"name\":\"Error\", \"stat_t\":\"~/state\", \"en\":\"true\"");
+  publish_entity_discovery(p_door, "binary_sensor", "prewarn", "\"dev_cla\":\"safety\", \"name\":\"Prewarn\", \"stat_t\":\"~/state\", \"en\":\"false\"");
+  publish_entity_discovery(p_door, "binary_sensor", "option_relay", "\"name\":\"Option relay\", \"stat_t\":\"~/state\", \"en\":\"false\"");
+  snprintf(fields, sizeof(fields), "\"cmd_t\":\"homeassistant/button/%s_emergency_stop/trigger\", \"icon\":\"mdi:close-octagon\", \"name\":\"Emergency stop\", \"en\":\"false\"", p_door->unique_id);
+  publish_entity_discovery(p_door, "button", "emergency_stop", fields);
+  snprintf(fields, sizeof(fields), "\"cmd_t\":\"homeassistant/button/%s_impulse/trigger\", \"icon\":\"mdi:arrow-up-down\", \"name\":\"Impulse\", \"en\":\"false\"", p_door->unique_id);
+  publish_entity_discovery(p_door, "button", "impulse", fields);
+}
+
+
+static void subscribe(const char *component, const mqtt_door_t *p_door, const char *entity, const char *leaf)
+{
+  char topic[MQTT_TOPIC_LENGTH];
+
+  build_topic(topic, component, p_door, entity, leaf);
+  mosquitto_subscribe(mosq, NULL, topic, 0);
+}
+
+
+/* Runs in the network thread, everything else is done by the main loop */
+static void send_event(uint8_t type, uint8_t door, uint8_t action)
+{
+  uint8_t event[3];
+
+  event[0] = type;
+  event[1] = door;
+  event[2] = action;
+  /* Atomic for pipes, only fails if the main loop is stuck */
+  if(write(event_pipe[1], event, sizeof(event)) != (ssize_t)sizeof(event))
+  {
+    fprintf(stderr, "mqtt: event queue full\n");
+  }
+}
+
+
+static void on_connect(struct mosquitto *p_mosq, void *p_obj, int result)
+{
+  uint8_t i;
+
+  (void)p_mosq;
+  (void)p_obj;
+  if(result != 0)
+  {
+    fprintf(stderr, "mqtt: connection refused: %s\n", mosquitto_connack_string(result));
+    return;
+  }
+
+  /* Ids and topics don't change after mqtt_init(), publishing is thread safe */
+  for(i = 0; i < door_count; i++)
+  {
+    publish_discovery(&doors[i]);
+    subscribe("cover", &doors[i], "cover", "command");
+    subscribe("switch", &doors[i], "venting", "command");
+    subscribe("switch", &doors[i], "light", "command");
+    subscribe("button", &doors[i], "emergency_stop", "trigger");
+    subscribe("button", &doors[i], "impulse", "trigger");
+  }
+  publish(avty_topic, "online", true);
+  send_event(EVENT_CONNECTED, 0, 0);
+}
+
+
+static void on_disconnect(struct mosquitto *p_mosq, void *p_obj, int result)
+{
+  (void)p_mosq;
+  (void)p_obj;
+  (void)result;
+  send_event(EVENT_DISCONNECTED, 0, 0);
+}
+
+
+static bool topic_matches(const char *topic, const char *component, const mqtt_door_t *p_door, const char *entity, const char *leaf)
+{
+  char expected[MQTT_TOPIC_LENGTH];
+
+  build_topic(expected, component, p_door, entity, leaf);
+  return (strcmp(topic, expected) == 0);
+}
+
+
+static void on_message(struct mosquitto *p_mosq, void *p_obj, const struct mosquitto_message *p_msg)
+{
+  char message[16];
+  uint8_t i;
+  int length;
+
+  (void)p_mosq;
+  (void)p_obj;
+  length = p_msg->payloadlen;
+  if(length >= (int)sizeof(message))
+  {
+    return;
+  }
+  memcpy(message, p_msg->payload, (size_t)length);
+  message[length] = '\0';
+
+  for(i = 0; i < door_count; i++)
+  {
+    if(topic_matches(p_msg->topic, "cover", &doors[i], "cover", "command"))
+    {
+      if(strcmp(message, "OPEN") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_open);
+      }
+      else if(strcmp(message, "CLOSE") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_close);
+      }
+      else if(strcmp(message, "STOP") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_stop);
+      }
+    }
+    else if(topic_matches(p_msg->topic, "switch", &doors[i], "venting", "command"))
+    {
+      if(strcmp(message, "ON") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_venting);
+      }
+      else if(strcmp(message, "OFF") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_close);
+      }
+    }
+    else if(topic_matches(p_msg->topic, "switch", &doors[i], "light", "command"))
+    {
+      if((strcmp(message, "ON") == 0) || (strcmp(message, "OFF") == 0))
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_toggle_light);
+      }
+    }
+    else if(topic_matches(p_msg->topic, "button", &doors[i], "emergency_stop", "trigger"))
+    {
+      if(strcmp(message, "PRESS") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_emergency_stop);
+      }
+    }
+    else if(topic_matches(p_msg->topic, "button", &doors[i], "impulse", "trigger"))
+    {
+      if(strcmp(message, "PRESS") == 0)
+      {
+        send_event(EVENT_ACTION, i, hoermann_action_impulse);
+      }
+    }
+  }
+}
+
+
+static void setup_door(mqtt_door_t *p_door, uint8_t index)
+{
+  size_t i;
+
+  /* First door keeps the gateway id, same scheme as the ESP gateway */
+  if(index == 0)
+  {
+    snprintf(p_door->unique_id, sizeof(p_door->unique_id), "%s", config->id);
+    snprintf(p_door->name, sizeof(p_door->name), "%s", config->name);
+    snprintf(p_door->obj_id, sizeof(p_door->obj_id), "%s", config->name);
+  }
+  else
+  {
+    snprintf(p_door->unique_id, sizeof(p_door->unique_id), "%s_%u", config->id, (unsigned int)(index + 1));
+    snprintf(p_door->name, sizeof(p_door->name), "%s %u", config->name, (unsigned int)(index + 1));
+    snprintf(p_door->obj_id, sizeof(p_door->obj_id), "%s_%u", config->name, (unsigned int)(index + 1));
+  }
+  for(i = 0; p_door->obj_id[i] != '\0'; i++)
+  {
+    p_door->obj_id[i] = (char)tolower((unsigned char)p_door->obj_id[i]);
+  }
+  p_door->state_valid = false;
+}
+
+
+int mqtt_init(const mqtt_config_t *p_config, mqtt_door_t *p_doors, uint8_t count, mqtt_action_callback_t callback)
+{
+  uint8_t i;
+  int result;
+
+  config = p_config;
+  doors = p_doors;
+  door_count = count;
+  action_callback = callback;
+
+  /* Longer ids and names would be truncated for the further doors */
+  if(((strlen(config->id) + 3) >= MQTT_ID_LENGTH) || ((strlen(config->name) + 3) >= MQTT_ID_LENGTH))
+  {
+    fprintf(stderr, "mqtt: id and name are limited to %u characters\n", (unsigned int)(MQTT_ID_LENGTH - 4));
+    return -1;
+  }
+  for(i = 0; i < door_count; i++)
+  {
+    setup_door(&doors[i], i);
+  }
+  build_topic(avty_topic, "cover", &doors[0], "cover", "availability");
+
+  if((pipe(event_pipe) != 0) || (fcntl(event_pipe[0], F_SETFL, O_NONBLOCK) != 0) || (fcntl(event_pipe[1], F_SETFL, O_NONBLOCK) != 0))
+  {
+    return -1;
+  }
+
+  mosquitto_lib_init();
+  mosq = mosquitto_new(config->id, true, NULL);
+  if(mosq == NULL)
+  {
+    return -1;
+  }
+  if((config->user != NULL) && (mosquitto_username_pw_set(mosq, config->user, config->password) != MOSQ_ERR_SUCCESS))
+  {
+    return -1;
+  }
+  mosquitto_will_set(mosq, avty_topic, (int)strlen("offline"), "offline", 0, true);
+  mosquitto_connect_callback_set(mosq, on_connect);
+  mosquitto_disconnect_callback_set(mosq, on_disconnect);
+  mosquitto_message_callback_set(mosq, on_message);
+  mosquitto_reconnect_delay_set(mosq, RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY, true);
+
+  /* Connecting, keepalive and reconnecting block, so they run in the thread
+   * of libmosquitto. The epoll loop only serves the buses and the event pipe. */
+  result = mosquitto_connect_async(mosq, config->host, config->port, KEEPALIVE);
+  if(result != MOSQ_ERR_SUCCESS)
+  {
+    /* Not fatal, the network thread keeps trying */
+    fprintf(stderr, "mqtt: connecting to %s:%d failed: %s\n", config->host, config->port, mosquitto_strerror(result));
+  }
+  if(mosquitto_loop_start(mosq) != MOSQ_ERR_SUCCESS)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+void mqtt_shutdown(void)
+{
+  if(connected)
+  {
+    publish(avty_topic, "offline", true);
+  }
+  /* Queued after the availability, the thread ends after sending both. A
+   * thread which is still trying to connect is cancelled. */
+  mosquitto_disconnect(mosq);
+  mosquitto_loop_stop(mosq, !connected);
+  mosquitto_destroy(mosq);
+  mosquitto_lib_cleanup();
+  close(event_pipe[0]);
+  close(event_pipe[1]);
+}
+
+
+int mqtt_event_fd(void)
+{
+  return event_pipe[0];
+}
+
+
+void mqtt_handle_events(void)
+{
+  uint8_t event[3];
+  uint8_t i;
+
+  while(read(event_pipe[0], event, sizeof(event)) == (ssize_t)sizeof(event))
+  {
+    switch(event[0])
+    {
+      case EVENT_CONNECTED:
+        connected = true;
+        /* All states are published again */
+        for(i = 0; i < door_count; i++)
+        {
+          doors[i].state_valid = false;
+        }
+        break;
+      case EVENT_DISCONNECTED:
+        connected = false;
+        break;
+      default:
+        if(event[1] < door_count)
+        {
+          action_callback(event[1], (hoermann_action_t)event[2]);
+        }
+        break;
+    }
+  }
+}
+
+
+static void publish_switch_state(const mqtt_door_t *p_door, const char *component, const char *entity, uint16_t broadcast, uint16_t mask)
+{
+  char topic[MQTT_TOPIC_LENGTH];
+
+  if(p_door->state_valid && ((p_door->state & mask) == (broadcast & mask)))
+  {
+    return;
+  }
+  build_topic(topic, component, p_door, entity, "state");
+  publish(topic, ((broadcast & mask) != 0) ? "ON" : "OFF", true);
+}
+
+
+void mqtt_publish_state(uint8_t door, uint16_t broadcast)
+{
+  mqtt_door_t *p_door = &doors[door];
+  char topic[MQTT_TOPIC_LENGTH];
+  const char *position;
+
+  if(!connected)
+  {
+    return;
+  }
+
+  if(!p_door->state_valid || ((p_door->state & (STATUS_OPEN | STATUS_CLOSED)) != (broadcast & (STATUS_OPEN | STATUS_CLOSED))))
+  {
+    if((broadcast & STATUS_OPEN) != 0)
+    {
+      position = "100";
+    }
+    else if((broadcast & STATUS_CLOSED) != 0)
+    {
+      position = "0";
+    }
+    else
+    {
+      position = "10";
+    }
+    build_topic(topic, "cover", p_door, "cover", "position");
+    publish(topic, position, true);
+  }
+  publish_switch_state(p_door, "switch", "venting", broadcast, STATUS_VENTING);
+  publish_switch_state(p_door, "switch", "light", broadcast, STATUS_LIGHT);
+  publish_switch_state(p_door, "binary_sensor", "error", broadcast, STATUS_ERROR);
+  publish_switch_state(p_door, "binary_sensor", "prewarn", broadcast, STATUS_PREWARN);
+  publish_switch_state(p_door, "binary_sensor", "option_relay", broadcast, STATUS_OPTION_RELAY);
+
+  p_door->state = broadcast;
+  p_door->state_valid = true;
+}
@@ -0,0 +1,40 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "hoermann_protocol.h"
+
+/* Fits the default id hoermann_door_<hostname> and the suffix _<n> of further doors */
+#define MQTT_ID_LENGTH      (sizeof("hoermann_door_") + HOST_NAME_MAX + 3)
+#define MQTT_TOPIC_LENGTH   160
+
+typedef struct
+{
+  const char *host;
+  int port;
+  const char *user;
+  const char *password;
+  const char *name;
+  const char *id;
+} mqtt_config_t;
+
+typedef struct
+{
+  char unique_id[MQTT_ID_LENGTH];
+  char name[MQTT_ID_LENGTH];
+  char obj_id[MQTT_ID_LENGTH];
+  bool state_valid;
+  uint16_t state;
+} mqtt_door_t;
+
+typedef void (*mqtt_action_callback_t)(uint8_t door, hoermann_action_t action);
+
+extern int mqtt_init(const mqtt_config_t *p_config, mqtt_door_t *p_doors, uint8_t count, mqtt_action_callback_t callback);
+extern void mqtt_shutdown(void);
+extern int mqtt_event_fd(void);
+extern void mqtt_handle_events(void);
+extern void mqtt_publish_state(uint8_t door, uint16_t broadcast);
+
+#endif
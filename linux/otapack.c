@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ota_patch.h"
+
+
+#define SEED_LENGTH           8       /* Bytes which have to match exactly to start a copy */
+#define HASH_BITS             20
+#define MAX_CANDIDATES        32      /* Checked positions per hash chain */
+#define WINDOW_LENGTH         32      /* Copies end if too many bytes differ within this window */
+#define WINDOW_MISMATCHES     12
+#define MIN_COPY_SCORE        12      /* Matching bytes a copy needs, shorter ones are sent literally */
+
+#define NO_POSITION           UINT32_MAX
+
+
+typedef struct
+{
+  uint8_t *p_data;
+  uint32_t size;
+} image_t;
+
+typedef struct
+{
+  uint8_t *p_data;
+  size_t size;
+  size_t capacity;
+} output_t;
+
+typedef struct
+{
+  const image_t *p_base;
+  output_t *p_target;
+} apply_context_t;
+
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s diff <base.bin> <target.bin> <package>   Create a delta package\n"
+          "       %s apply <base.bin> <package> <target.bin>  Rebuild the target like the ESP does\n"
+          "       %s info <package>                           Show the header of a package\n"
+          "Full images can be sent gzip compressed instead (gzip -9 firmware.bin).\n",
+          program, program, program);
+}
+
+
+static bool load_file(const char *path, image_t *p_image)
+{
+  FILE *file;
+  long size;
+
+  file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if((size < 0) || (size > (long)(UINT32_MAX / 2)))
+  {
+    fprintf(stderr, "%s: invalid size\n", path);
+    fclose(file);
+    return false;
+  }
+
+  p_image->size = (uint32_t)size;
+  p_image->p_data = malloc(p_image->size + 1);
+  if((p_image->p_data == NULL) || (fread(p_image->p_data, 1, p_image->size, file) != p_image->size))
+  {
+    perror(path);
+    fclose(file);
+    return false;
+  }
+  fclose(file);
+  return true;
+}
+
+
+static bool save_file(const char *path, const uint8_t *p_data, size_t size)
+{
+  FILE *file;
+  bool ok;
+
+  file = fopen(path, "wb");
+  if(file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+  ok = (fwrite(p_data, 1, size, file) == size);
+  ok = (fclose(file) == 0) && ok;
+  if(!ok)
+  {
+    perror(path);
+  }
+  return ok;
+}
+
+
+static void put_bytes(output_t *p_output, const uint8_t *p_data, size_t length)
+{
+  if((p_output->size + length) > p_output->capacity)
+  {
+    p_output->capacity = (p_output->size + length) * 2;
+    p_output->p_data = realloc(p_output->p_data, p_output->capacity);
+    if(p_output->p_data == NULL)
+    {
+      perror("otapack");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(&p_output->p_data[p_output->size], p_data, length);
+  p_output->size += length;
+}
+
+
+static void put_byte(output_t *p_output, uint8_t data)
+{
+  put_bytes(p_output, &data, 1);
+}
+
+
+static void put_varint(output_t *p_output, uint32_t value)
+{
+  while(value >= 0x80)
+  {
+    put_byte(p_output, (uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  put_byte(p_output, (uint8_t)value);
+}
+
+
+static uint32_t hash_seed(const uint8_t *p_data)
+{
+  uint64_t value;
+
+  memcpy(&value, p_data, sizeof(value));
+  return (uint32_t)((value * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+
+/* Extends a match of base and target as long as most bytes are equal.
+ * Returns the length up to the last equal byte and the number of equal bytes. */
+static uint32_t extend_match(const image_t *p_base, uint32_t base_position, const image_t *p_target, uint32_t target_position,
+                             uint32_t *p_score)
+{
+  uint32_t i;
+  uint32_t length = 0;
+  uint32_t score = 0;
+  uint32_t window = 0;
+  uint32_t max_length;
+  bool equal;
+
+  max_length = p_target->size - target_position;
+  if((p_base->size - base_position) < max_length)
+  {
+    max_length = p_base->size - base_position;
+  }
+
+  for(i = 0; i < max_length; i++)
+  {
+    equal = (p_base->p_data[base_position + i] == p_target->p_data[target_position + i]);
+    /* Number of differing bytes within the last WINDOW_LENGTH bytes */
+    if(!equal)
+    {
+      window++;
+    }
+    if((i >= WINDOW_LENGTH) &&
+       (p_base->p_data[base_position + i - WINDOW_LENGTH] != p_target->p_data[target_position + i - WINDOW_LENGTH]))
+    {
+      window--;
+    }
+    if(window > WINDOW_MISMATCHES)
+    {
+      break;
+    }
+    if(equal)
+    {
+      score++;
+      length = i + 1;
+    }
+  }
+
+  *p_score = score;
+  return length;
+}
+
+
+static void put_literal(output_t *p_output, const image_t *p_target, uint32_t start, uint32_t end)
+{
+  if(end > start)
+  {
+    put_byte(p_output, OTA_PATCH_OP_LITERAL);
+    put_varint(p_output, end - start);
+    put_bytes(p_output, &p_target->p_data[start], end - start);
+  }
+}
+
+
+static void put_copy(output_t *p_output, const image_t *p_base, uint32_t base_position, uint32_t previous_end,
+                     const image_t *p_target, uint32_t target_position, uint32_t length)
+{
+  int32_t offset;
+  uint32_t i = 0;
+  uint32_t run;
+
+  offset = (int32_t)(base_position - previous_end);
+  put_byte(p_output, OTA_PATCH_OP_COPY);
+  put_varint(p_output, ((uint32_t)offset << 1) ^ (uint32_t)(offset >> 31));
+  put_varint(p_output, length);
+
+  while(i < length)
+  {
+    for(run = 0; ((i + run) < length) &&
+                 (p_base->p_data[base_position + i + run] == p_target->p_data[target_position + i + run]); run++)
+    {
+    }
+    put_varint(p_output, run);
+    i += run;
+    if(i == length)
+    {
+      break;
+    }
+    for(run = 0; ((i + run) < length) &&
+                 (p_base->p_data[base_position + i + run] != p_target->p_data[target_position + i + run]); run++)
+    {
+    }
+    put_varint(p_output, run);
+    put_bytes(p_output, &p_target->p_data[target_position + i], run);
+    i += run;
+  }
+}
+
+
+static void create_delta(const image_t *p_base, const image_t *p_target, output_t *p_output)
+{
+  uint32_t *p_heads;
+  uint32_t *p_chain;
+  uint32_t i;
+  uint32_t position = 0;
+  uint32_t literal_start = 0;
+  uint32_t previous_end = 0;     /* End of the last copy in the base image */
+  int64_t alignment = 0;         /* Base minus target position of the last copy */
+  uint32_t candidate;
+  uint32_t checked;
+  uint32_t length;
+  uint32_t score;
+  uint32_t best_position;
+  uint32_t best_length;
+  uint32_t best_score;
+  int64_t aligned;
+
+  p_heads = malloc(sizeof(uint32_t) << HASH_BITS);
+  p_chain = malloc(sizeof(uint32_t) * (p_base->size + 1));
+  if((p_heads == NULL) || (p_chain == NULL))
+  {
+    perror("otapack");
+    exit(EXIT_FAILURE);
+  }
+  memset(p_heads, 0xFF, sizeof(uint32_t) << HASH_BITS);
+  for(i = 0; (i + SEED_LENGTH) <= p_base->size; i++)
+  {
+    p_chain[i] = p_heads[hash_seed(&p_base->p_data[i])];
+    p_heads[hash_seed(&p_base->p_data[i])] = i;
+  }
+
+  while(position < p_target->size)
+  {
+    best_length = 0;
+    best_score = 0;
+    best_position = 0;
+
+    /* Code which only moved keeps its alignment, relocated addresses differ in a few bytes */
+    aligned = (int64_t)position + alignment;
+    if((aligned >= 0) && (aligned < p_base->size))
+    {
+      best_length = extend_match(p_base, (uint32_t)aligned, p_target, position, &best_score);
+      best_position = (uint32_t)aligned;
+    }
+
+    if((position + SEED_LENGTH) <= p_target->size)
+    {
+      candidate = p_heads[hash_seed(&p_target->p_data[position])];
+      for(checked = 0; (candidate != NO_POSITION) && (checked < MAX_CANDIDATES); checked++)
+      {
+        if(memcmp(&p_base->p_data[candidate], &p_target->p_data[position], SEED_LENGTH) == 0)
+        {
+          length = extend_match(p_base, candidate, p_target, position, &score);
+          if(score > best_score)
+          {
+            best_score = score;
+            best_length = length;
+            best_position = candidate;
+          }
+        }
+        candidate = p_chain[candidate];
+      }
+    }
+
+    /* A copy has to start with an equal byte, otherwise it's part of the literal */
+    if((best_score >= MIN_COPY_SCORE) && (p_base->p_data[best_position] == p_target->p_data[position]))
+    {
+      put_literal(p_output, p_target, literal_start, position);
+      put_copy(p_output, p_base, best_position, previous_end, p_target, position, best_length);
+      previous_end = best_position + best_length;
+      alignment = (int64_t)best_position - position;
+      position += best_length;
+      literal_start = position;
+    }
+    else
+    {
+      position++;
+    }
+  }
+  put_literal(p_output, p_target, literal_start, position);
+  put_byte(p_output, OTA_PATCH_OP_END);
+
+  free(p_heads);
+  free(p_chain);
+}
+
+
+static bool read_base(void *p_context, uint32_t offset, uint8_t *p_data, uint16_t length)
+{
+  const apply_context_t *p_apply = p_context;
+
+  if((offset > p_apply->p_base->size) || (length > (p_apply->p_base->size - offset)))
+  {
+    return false;
+  }
+  memcpy(p_data, &p_apply->p_base->p_data[offset], length);
+  return true;
+}
+
+
+static bool write_target(void *p_context, const uint8_t *p_data, uint16_t length)
+{
+  apply_context_t *p_apply = p_context;
+
+  put_bytes(p_apply->p_target, p_data, length);
+  return true;
+}
+
+
+/* Same sequence as on the ESP: header, base check, package in small chunks */
+static ota_patch_result_t apply_delta(const image_t *p_base, const uint8_t *p_package, size_t size, output_t *p_target)
+{
+  static ota_patch_t patch;
+  ota_patch_header_t header;
+  ota_patch_result_t result;
+  apply_context_t context;
+  size_t offset;
+  size_t chunk;
+
+  if((size < OTA_PATCH_HEADER_SIZE) || !ota_patch_parse_header(&header, p_package))
+  {
+    return ota_patch_error_header;
+  }
+  context.p_base = p_base;
+  context.p_target = p_target;
+  ota_patch_init(&patch, &header, read_base, write_target, &context);
+  result = ota_patch_check_base(&patch, p_base->size);
+
+  for(offset = OTA_PATCH_HEADER_SIZE; (offset < size) && (result == ota_patch_busy); offset += chunk)
+  {
+    chunk = ((size - offset) > 1460) ? 1460 : (size - offset);
+    result = ota_patch_feed(&patch, &p_package[offset], chunk);
+  }
+
+  return (result == ota_patch_busy) ? ota_patch_error_size : result;
+}
+
+
+static int command_diff(const char *base_path, const char *target_path, const char *package_path)
+{
+  image_t base;
+  image_t target;
+  output_t package = { NULL, 0, 0 };
+  output_t check = { NULL, 0, 0 };
+  ota_patch_header_t header;
+  ota_patch_result_t result;
+  uint8_t raw_header[OTA_PATCH_HEADER_SIZE];
+
+  if(!load_file(base_path, &base) || !load_file(target_path, &target))
+  {
+    return EXIT_FAILURE;
+  }
+  /* The ESP sees its flash, not the .bin: CRC and copies use the base like the decoder */
+  ota_patch_normalize_base(0, base.p_data, base.size);
+
+  header.base_size = base.size;
+  header.base_crc = ota_patch_crc32(0, base.p_data, base.size);
+  header.target_size = target.size;
+  header.target_crc = ota_patch_crc32(0, target.p_data, target.size);
+  ota_patch_write_header(&header, raw_header);
+  put_bytes(&package, raw_header, sizeof(raw_header));
+  create_delta(&base, &target, &package);
+
+  /* Never ship a package which doesn't rebuild the target */
+  result = apply_delta(&base, package.p_data, package.size, &check);
+  if((result != ota_patch_done) || (check.size != target.size) || (memcmp(check.p_data, target.p_data, target.size) != 0))
+  {
+    fprintf(stderr, "otapack: verification failed (%s)\n", ota_patch_result_name(result));
+    return EXIT_FAILURE;
+  }
+  if(!save_file(package_path, package.p_data, package.size))
+  {
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %lu bytes, %.1f%% of %s (%lu bytes), verified\n", package_path, (unsigned long)package.size,
+         (100.0 * package.size) / (target.size ? target.size : 1), target_path, (unsigned long)target.size);
+  return EXIT_SUCCESS;
+}
+
+
+static int command_apply(const char *base_path, const char *package_path, const char *target_path)
+{
+  image_t base;
+  image_t package;
+  output_t target = { NULL, 0, 0 };
+  ota_patch_result_t result;
+
+  if(!load_file(base_path, &base) || !load_file(package_path, &package))
+  {
+    return EXIT_FAILURE;
+  }
+
+  result = apply_delta(&base, package.p_data, package.size, &target);
+  if(result != ota_patch_done)
+  {
+    fprintf(stderr, "otapack: %s: %s error\n", package_path, ota_patch_result_name(result));
+    return EXIT_FAILURE;
+  }
+  return save_file(target_path, target.p_data, target.size) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int command_info(const char *package_path)
+{
+  image_t package;
+  ota_patch_header_t header;
+
+  if(!load_file(package_path, &package))
+  {
+    return EXIT_FAILURE;
+  }
+  if((package.size < OTA_PATCH_HEADER_SIZE) || !ota_patch_parse_header(&header, package.p_data))
+  {
+    fprintf(stderr, "otapack: %s is no delta package\n", package_path);
+    return EXIT_FAILURE;
+  }
+
+  printf("base:   %lu bytes, crc32 %08lX\n", (unsigned long)header.base_size, (unsigned long)header.base_crc);
+  printf("target: %lu bytes, crc32 %08lX\n", (unsigned long)header.target_size, (unsigned long)header.target_crc);
+  printf("size:   %lu bytes\n", (unsigned long)package.size);
+  return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if((argc == 5) && (strcmp(argv[1], "diff") == 0))
+  {
+    return command_diff(argv[2], argv[3], argv[4]);
+  }
+  if((argc == 5) && (strcmp(argv[1], "apply") == 0))
+  {
+    return command_apply(argv[2], argv[3], argv[4]);
+  }
+  if((argc == 3) && (strcmp(argv[1], "info") == 0))
+  {
+    return command_info(argv[2]);
+  }
+
+  usage(argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,32 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+/*
+ * Host replacement of the parts of the Arduino core which the hardware
+ * independent modules of esp8266/ use. Time is simulated, tests advance it
+ * by setting host_millis.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+extern uint32_t host_millis;
+
+static inline uint32_t millis(void)
+{
+  return host_millis;
+}
+
+/* Like the core, a number below howbig drawn from rand(), 0 if howbig is 0 */
+static inline long random(long howbig)
+{
+  return (howbig > 0) ? (rand() % howbig) : 0;
+}
+
+#endif
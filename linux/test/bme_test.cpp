@@ -0,0 +1,188 @@
+/*
+ * Checks the integer compensation of esp8266/bme280_compensation.cpp against
+ * the example of the datasheet and its floating point formulas, chapter 8.1.
+ */
+
+#include "Arduino.h"
+#include "bme280_compensation.h"
+#include "check.h"
+
+uint32_t host_millis = 0;
+
+typedef struct
+{
+  uint16_t t1;
+  int16_t t2;
+  int16_t t3;
+  uint16_t p1;
+  int16_t p[8];
+  uint8_t h1;
+  int16_t h2;
+  uint8_t h3;
+  int16_t h4;
+  int16_t h5;
+  int8_t h6;
+} calibration_t;
+
+/* Trimming values of the example in the BMP280 datasheet, humidity of a typical BME280 */
+static const calibration_t example = { 27504, 26435, -1000, 36477, { -10685, 3024, 2855, 140, -7, 15500, -14600, 6000 },
+                                       75, 362, 0, 313, 50, 30 };
+
+static void put_u16(uint8_t *p_data, uint16_t value)
+{
+  p_data[0] = (uint8_t)value;
+  p_data[1] = (uint8_t)(value >> 8);
+}
+
+/* Register contents as the sensor stores the calibration */
+static void set_calibration(Bme280Compensation *compensation, const calibration_t *calib)
+{
+  uint8_t calib_00[BME280_CALIB_00_LENGTH];
+  uint8_t calib_26[BME280_CALIB_26_LENGTH];
+
+  memset(calib_00, 0, sizeof(calib_00));
+  put_u16(&calib_00[0], calib->t1);
+  put_u16(&calib_00[2], (uint16_t)calib->t2);
+  put_u16(&calib_00[4], (uint16_t)calib->t3);
+  put_u16(&calib_00[6], calib->p1);
+  for (int i = 0; i < 8; i++)
+  {
+    put_u16(&calib_00[8 + 2 * i], (uint16_t)calib->p[i]);
+  }
+  calib_00[25] = calib->h1;
+
+  put_u16(&calib_26[0], (uint16_t)calib->h2);
+  calib_26[2] = calib->h3;
+  calib_26[3] = (uint8_t)(calib->h4 >> 4);
+  calib_26[4] = (uint8_t)((calib->h4 & 0x0F) | ((calib->h5 & 0x0F) << 4));
+  calib_26[5] = (uint8_t)(calib->h5 >> 4);
+  calib_26[6] = (uint8_t)calib->h6;
+  compensation->set_calibration(calib_00, calib_26);
+}
+
+static void make_data(uint8_t *p_data, int32_t adc_p, int32_t adc_t, int32_t adc_h)
+{
+  p_data[0] = (uint8_t)(adc_p >> 12);
+  p_data[1] = (uint8_t)(adc_p >> 4);
+  p_data[2] = (uint8_t)(adc_p << 4);
+  p_data[3] = (uint8_t)(adc_t >> 12);
+  p_data[4] = (uint8_t)(adc_t >> 4);
+  p_data[5] = (uint8_t)(adc_t << 4);
+  p_data[6] = (uint8_t)(adc_h >> 8);
+  p_data[7] = (uint8_t)adc_h;
+}
+
+/* Floating point compensation of the datasheet */
+static bme_sample_t reference(const calibration_t *c, int32_t adc_p, int32_t adc_t, int32_t adc_h)
+{
+  bme_sample_t sample;
+  double var1;
+  double var2;
+  double t_fine;
+  double p;
+  double h;
+
+  var1 = (adc_t / 16384.0 - c->t1 / 1024.0) * c->t2;
+  var2 = (adc_t / 131072.0 - c->t1 / 8192.0) * (adc_t / 131072.0 - c->t1 / 8192.0) * c->t3;
+  t_fine = var1 + var2;
+  sample.temperature = (float)(t_fine / 5120.0);
+
+  var1 = t_fine / 2.0 - 64000.0;
+  var2 = var1 * var1 * c->p[4] / 32768.0;
+  var2 = var2 + var1 * c->p[3] * 2.0;
+  var2 = var2 / 4.0 + c->p[2] * 65536.0;
+  var1 = (c->p[1] * var1 * var1 / 524288.0 + c->p[0] * var1) / 524288.0;
+  var1 = (1.0 + var1 / 32768.0) * c->p1;
+  p = 1048576.0 - adc_p;
+  p = (p - var2 / 4096.0) * 6250.0 / var1;
+  var1 = c->p[7] * p * p / 2147483648.0;
+  var2 = p * c->p[6] / 32768.0;
+  sample.pressure = (float)((p + (var1 + var2 + c->p[5]) / 16.0) / 100.0);
+
+  h = t_fine - 76800.0;
+  h = (adc_h - (c->h4 * 64.0 + c->h5 / 16384.0 * h)) *
+      (c->h2 / 65536.0 * (1.0 + c->h6 / 67108864.0 * h * (1.0 + c->h3 / 67108864.0 * h)));
+  h = h * (1.0 - c->h1 * h / 524288.0);
+  sample.humidity = (float)((h > 100.0) ? 100.0 : ((h < 0.0) ? 0.0 : h));
+  return sample;
+}
+
+static void test_datasheet_example(void)
+{
+  Bme280Compensation compensation;
+  uint8_t data[BME280_DATA_LENGTH];
+  bme_sample_t sample;
+
+  set_calibration(&compensation, &example);
+  make_data(data, 415148, 519888, 0x6000);
+  sample = compensation.compensate(data);
+  CHECK(fabsf(sample.temperature - 25.08F) < 0.001F);
+  CHECK(fabsf(sample.pressure - 1006.5327F) < 0.001F);
+}
+
+static void test_reference(void)
+{
+  Bme280Compensation compensation;
+  uint8_t data[BME280_DATA_LENGTH];
+  bme_sample_t sample;
+  bme_sample_t expected;
+  float max_temperature = 0.0F;
+  float max_pressure = 0.0F;
+  float max_humidity = 0.0F;
+
+  set_calibration(&compensation, &example);
+  for (int i = 0; i < 1000; i++)
+  {
+    // About -20 to 60 °C, 300 to 1100 hPa and the full humidity range
+    int32_t adc_t = 440000 + (rand() % 160000);
+    int32_t adc_p = 250000 + (rand() % 450000);
+    int32_t adc_h = 20000 + (rand() % 30000);
+
+    make_data(data, adc_p, adc_t, adc_h);
+    sample = compensation.compensate(data);
+    expected = reference(&example, adc_p, adc_t, adc_h);
+    max_temperature = fmaxf(max_temperature, fabsf(sample.temperature - expected.temperature));
+    max_pressure = fmaxf(max_pressure, fabsf(sample.pressure - expected.pressure));
+    max_humidity = fmaxf(max_humidity, fabsf(sample.humidity - expected.humidity));
+  }
+  CHECK(max_temperature <= 0.01F);
+  CHECK(max_pressure <= 0.01F);
+  CHECK(max_humidity <= 0.01F);
+}
+
+static void test_skipped(void)
+{
+  Bme280Compensation compensation;
+  uint8_t data[BME280_DATA_LENGTH];
+  bme_sample_t sample;
+
+  set_calibration(&compensation, &example);
+
+  // Oversampling SAMPLING_NONE leaves the reset value in the register
+  make_data(data, 0x80000, 519888, 0x8000);
+  sample = compensation.compensate(data);
+  CHECK(fabsf(sample.temperature - 25.08F) < 0.001F);
+  CHECK(isnan(sample.pressure));
+  CHECK(isnan(sample.humidity));
+
+  make_data(data, 415148, 0x80000, 0x6000);
+  sample = compensation.compensate(data);
+  CHECK(isnan(sample.temperature) && isnan(sample.pressure) && isnan(sample.humidity));
+
+  // Without calibration nothing divides by zero
+  Bme280Compensation empty;
+  make_data(data, 415148, 519888, 0x6000);
+  sample = empty.compensate(data);
+  CHECK(sample.pressure == 0.0F);
+}
+
+int main(void)
+{
+  srand(1);
+
+  test_datasheet_example();
+  test_reference();
+  test_skipped();
+
+  return check_summary("bme_test");
+}
@@ -0,0 +1,31 @@
+#ifndef Check_h
+#define Check_h
+
+/*
+ * Minimal assertions for the host tests. Failures are counted and reported
+ * instead of aborting, so one run shows all broken cases.
+ */
+
+#include <stdio.h>
+
+static unsigned int check_count = 0;
+static unsigned int check_failures = 0;
+
+#define CHECK(condition) \
+  do \
+  { \
+    check_count++; \
+    if (!(condition)) \
+    { \
+      check_failures++; \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+static int check_summary(const char *name)
+{
+  printf("%s: %u checks, %u failed\n", name, check_count, check_failures);
+  return (check_failures == 0) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,455 @@
+/*
+ * Simulates the master of the Hoermann bus, i.e. the door drive, on ptys.
+ * hoermannd is started on the slave side of the ptys. Every bus alternates
+ * a request and the broadcast status like a drive does: slave scans until
+ * the UAP1 answered, then status requests. The time from the end of each
+ * request to the response is measured. Actions in the status responses
+ * move the simulated doors, so their state changes are broadcast.
+ *
+ * ptys don't transport breaks, hoermannd finds the frames by the gap
+ * between them.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include "hoermann_protocol.h"
+
+
+#define MAX_DOORS                 16
+#define CYCLE_NS                  20000000L   /* request, broadcast */
+#define BROADCAST_OFFSET_NS       10000000L
+#define MOVE_TIME_NS              2000000000L /* door travel time */
+
+#define BROADCAST_ADDR            0x00
+#define MIN_SCAN_ADDR             0x10
+#define MAX_SCAN_ADDR             0x90
+#define CMD_SLAVE_SCAN            0x01
+#define CMD_SLAVE_STATUS_REQUEST  0x20
+#define CMD_SLAVE_STATUS_RESPONSE 0x29
+
+#define STATUS_OPEN               0x01
+#define STATUS_CLOSED             0x02
+#define STATUS_LIGHT              0x08
+#define STATUS_CLOSING            0x20
+#define STATUS_MOVING             0x40
+#define STATUS_VENTING            0x80
+
+#define RESPONSE_DEFAULT          0x1000
+#define RESPONSE_EMERGENCY_STOP   0x0000
+#define RESPONSE_OPEN             0x1001
+#define RESPONSE_CLOSE            0x1002
+#define RESPONSE_IMPULSE          0x1004
+#define RESPONSE_TOGGLE_LIGHT     0x1008
+#define RESPONSE_VENTING          0x1010
+
+
+typedef struct
+{
+  int fd;
+  char link[256];
+  uint8_t counter;
+  uint8_t request_counter;    /* the broadcast increments the counter as well */
+  uint8_t scan_address;
+  bool detected;
+  bool waiting;               /* for the response to the last request */
+  uint8_t expected_length;
+  uint8_t rx_buffer[HOERMANN_MAX_FRAME_LENGTH];
+  uint8_t rx_count;
+  long request_time;          /* ns, end of the request */
+  uint8_t status;             /* d0 of the broadcast */
+  uint8_t target;             /* status after the current movement */
+  long move_end;
+  unsigned long requests;
+  unsigned long responses;
+  unsigned long missing;
+  unsigned long late;
+  unsigned long errors;
+  long latency_min;
+  long latency_max;
+  long long latency_sum;
+} sim_door_t;
+
+
+static sim_door_t doors[MAX_DOORS];
+static unsigned int door_count = 2;
+static long late_limit_ns = 5000000L;
+
+
+static long now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((long)now.tv_sec * 1000000000L) + now.tv_nsec;
+}
+
+
+static void send_frame(sim_door_t *p_door, uint8_t address, const uint8_t *p_data, uint8_t length)
+{
+  uint8_t frame[HOERMANN_MAX_FRAME_LENGTH];
+
+  p_door->counter = (uint8_t)((p_door->counter + 0x10) & 0xF0);
+  frame[0] = address;
+  frame[1] = p_door->counter | length;
+  memcpy(&frame[2], p_data, length);
+  frame[length + 2] = hoermann_crc8(frame, (uint8_t)(length + 2));
+  if(write(p_door->fd, frame, length + 3) != (length + 3))
+  {
+    p_door->errors++;
+  }
+}
+
+
+static void send_request(sim_door_t *p_door)
+{
+  uint8_t data[2];
+  uint8_t address;
+
+  /* Unanswered scans are normal until the daemon runs */
+  if(p_door->waiting && p_door->detected)
+  {
+    p_door->missing++;
+    fprintf(stderr, "%s: no response\n", p_door->link);
+  }
+  p_door->waiting = false;
+
+  if(p_door->detected)
+  {
+    data[0] = CMD_SLAVE_STATUS_REQUEST;
+    send_frame(p_door, HOERMANN_UAP1_ADDR, data, 1);
+    p_door->expected_length = 6;
+  }
+  else
+  {
+    /* Scan the address range from top to bottom like the drive */
+    data[0] = CMD_SLAVE_SCAN;
+    data[1] = HOERMANN_MASTER_ADDR;
+    send_frame(p_door, p_door->scan_address, data, 2);
+    p_door->expected_length = 5;
+    address = p_door->scan_address;
+    p_door->scan_address = (address > MIN_SCAN_ADDR) ? (uint8_t)(address - 1) : MAX_SCAN_ADDR;
+    if(address != HOERMANN_UAP1_ADDR)
+    {
+      /* Other addresses are not emulated, no response expected */
+      return;
+    }
+  }
+
+  p_door->requests++;
+  p_door->request_counter = p_door->counter;
+  p_door->waiting = true;
+  p_door->rx_count = 0;
+  p_door->request_time = now_ns();
+}
+
+
+static void send_broadcast(sim_door_t *p_door)
+{
+  uint8_t data[2];
+
+  data[0] = p_door->status;
+  data[1] = 0x00;
+  send_frame(p_door, BROADCAST_ADDR, data, 2);
+}
+
+
+static void start_move(sim_door_t *p_door, uint8_t target, long now)
+{
+  if(target == STATUS_OPEN)
+  {
+    p_door->status = (uint8_t)((p_door->status & STATUS_LIGHT) | STATUS_MOVING);
+  }
+  else
+  {
+    p_door->status = (uint8_t)((p_door->status & STATUS_LIGHT) | STATUS_MOVING | STATUS_CLOSING);
+  }
+  p_door->target = target;
+  p_door->move_end = now + MOVE_TIME_NS;
+}
+
+
+static void stop_move(sim_door_t *p_door)
+{
+  p_door->status &= STATUS_LIGHT;
+  p_door->move_end = 0;
+}
+
+
+static void handle_action(sim_door_t *p_door, unsigned int index, uint16_t response, long now)
+{
+  const char *name;
+
+  switch(response)
+  {
+    case RESPONSE_DEFAULT:
+      return;
+    case RESPONSE_OPEN:
+      name = "open";
+      start_move(p_door, STATUS_OPEN, now);
+      break;
+    case RESPONSE_CLOSE:
+      name = "close";
+      start_move(p_door, STATUS_CLOSED, now);
+      break;
+    case RESPONSE_IMPULSE:
+      name = "impulse";
+      if((p_door->status & STATUS_MOVING) != 0)
+      {
+        stop_move(p_door);
+      }
+      else
+      {
+        start_move(p_door, ((p_door->status & STATUS_OPEN) != 0) ? STATUS_CLOSED : STATUS_OPEN, now);
+      }
+      break;
+    case RESPONSE_TOGGLE_LIGHT:
+      name = "toggle_light";
+      p_door->status ^= STATUS_LIGHT;
+      break;
+    case RESPONSE_VENTING:
+      name = "venting";
+      p_door->status = (uint8_t)((p_door->status & STATUS_LIGHT) | STATUS_VENTING);
+      p_door->move_end = 0;
+      break;
+    case RESPONSE_EMERGENCY_STOP:
+      name = "emergency_stop";
+      stop_move(p_door);
+      break;
+    default:
+      name = "unknown";
+      break;
+  }
+  printf("door %u: action %s\n", index + 1, name);
+  fflush(stdout);
+}
+
+
+static void check_response(sim_door_t *p_door, unsigned int index, long now)
+{
+  const uint8_t *p_rx = p_door->rx_buffer;
+  uint8_t expected_counter;
+  long latency;
+
+  p_door->waiting = false;
+  expected_counter = (uint8_t)((p_door->request_counter + 0x10) & 0xF0);
+  if((hoermann_crc8(p_rx, p_door->rx_count) != 0x00) || (p_rx[0] != HOERMANN_MASTER_ADDR) || ((p_rx[1] & 0xF0) != expected_counter))
+  {
+    p_door->errors++;
+    fprintf(stderr, "%s: invalid response\n", p_door->link);
+    return;
+  }
+
+  latency = now - p_door->request_time;
+  p_door->responses++;
+  p_door->latency_sum += latency;
+  if((p_door->latency_min == 0) || (latency < p_door->latency_min))
+  {
+    p_door->latency_min = latency;
+  }
+  if(latency > p_door->latency_max)
+  {
+    p_door->latency_max = latency;
+  }
+  if(latency > late_limit_ns)
+  {
+    p_door->late++;
+    fprintf(stderr, "%s: response after %.2f ms\n", p_door->link, latency / 1e6);
+  }
+
+  if(p_door->expected_length == 5)
+  {
+    if((p_rx[2] == HOERMANN_UAP1_TYPE) && (p_rx[3] == HOERMANN_UAP1_ADDR))
+    {
+      p_door->detected = true;
+      printf("door %u: UAP1 detected\n", index + 1);
+      fflush(stdout);
+    }
+  }
+  else if(p_rx[2] == CMD_SLAVE_STATUS_RESPONSE)
+  {
+    handle_action(p_door, index, (uint16_t)(p_rx[3] | (p_rx[4] << 8)), now);
+  }
+}
+
+
+static void receive(sim_door_t *p_door, unsigned int index)
+{
+  uint8_t buffer[64];
+  ssize_t count;
+  ssize_t i;
+  long now;
+
+  /* Latency is measured to the read of the last byte */
+  now = now_ns();
+  while((count = read(p_door->fd, buffer, sizeof(buffer))) > 0)
+  {
+    for(i = 0; i < count; i++)
+    {
+      /* Only responses are expected, everything else is an error */
+      if(!p_door->waiting || (p_door->rx_count >= p_door->expected_length))
+      {
+        p_door->errors++;
+        continue;
+      }
+      p_door->rx_buffer[p_door->rx_count] = buffer[i];
+      p_door->rx_count++;
+      if(p_door->rx_count == p_door->expected_length)
+      {
+        check_response(p_door, index, now);
+      }
+    }
+  }
+}
+
+
+static int open_door(sim_door_t *p_door, const char *directory, unsigned int index)
+{
+  struct termios tty;
+
+  memset(p_door, 0, sizeof(*p_door));
+  p_door->scan_address = MAX_SCAN_ADDR;
+  p_door->status = STATUS_CLOSED;
+  p_door->fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if((p_door->fd < 0) || (grantpt(p_door->fd) != 0) || (unlockpt(p_door->fd) != 0))
+  {
+    return -1;
+  }
+  /* No echo or line editing on the slave side until hoermannd configures it */
+  if(tcgetattr(p_door->fd, &tty) == 0)
+  {
+    cfmakeraw(&tty);
+    tcsetattr(p_door->fd, TCSANOW, &tty);
+  }
+
+  snprintf(p_door->link, sizeof(p_door->link), "%s/door%u", directory, index + 1);
+  unlink(p_door->link);
+  if(symlink(ptsname(p_door->fd), p_door->link) != 0)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options] <directory>\n"
+          "  -n <doors>     Number of buses (default 2), <directory>/door<n> links to their tty\n"
+          "  -t <seconds>   Duration (default 10)\n"
+          "  -w <ms>        Responses later than this count as late (default 5)\n",
+          program);
+}
+
+
+int main(int argc, char *argv[])
+{
+  struct pollfd fds[MAX_DOORS];
+  unsigned int duration = 10;
+  unsigned int i;
+  int option;
+  long start;
+  long now;
+  long next_request;
+  long next_broadcast;
+  long wait_ns;
+  int result = EXIT_SUCCESS;
+
+  while((option = getopt(argc, argv, "n:t:w:h")) != -1)
+  {
+    switch(option)
+    {
+      case 'n': door_count = (unsigned int)atoi(optarg); break;
+      case 't': duration = (unsigned int)atoi(optarg); break;
+      case 'w': late_limit_ns = atol(optarg) * 1000000L; break;
+      default: usage(argv[0]); return EXIT_FAILURE;
+    }
+  }
+  if((optind != (argc - 1)) || (door_count == 0) || (door_count > MAX_DOORS))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(i = 0; i < door_count; i++)
+  {
+    if(open_door(&doors[i], argv[optind], i) != 0)
+    {
+      perror("drive_sim");
+      return EXIT_FAILURE;
+    }
+    fds[i].fd = doors[i].fd;
+    fds[i].events = POLLIN;
+  }
+  printf("ready\n");
+  fflush(stdout);
+
+  start = now_ns();
+  next_request = start;
+  next_broadcast = start + BROADCAST_OFFSET_NS;
+  while((now = now_ns()) < (start + ((long)duration * 1000000000L)))
+  {
+    /* All buses send at the same time, the worst case for the daemon */
+    if(now >= next_request)
+    {
+      for(i = 0; i < door_count; i++)
+      {
+        send_request(&doors[i]);
+      }
+      next_request += CYCLE_NS;
+    }
+    if(now >= next_broadcast)
+    {
+      for(i = 0; i < door_count; i++)
+      {
+        if((doors[i].move_end != 0) && (now >= doors[i].move_end))
+        {
+          doors[i].status = (uint8_t)((doors[i].status & STATUS_LIGHT) | doors[i].target);
+          doors[i].move_end = 0;
+        }
+        send_broadcast(&doors[i]);
+      }
+      next_broadcast += CYCLE_NS;
+    }
+
+    wait_ns = ((next_request < next_broadcast) ? next_request : next_broadcast) - now_ns();
+    if(wait_ns < 0)
+    {
+      wait_ns = 0;
+    }
+    /* poll() has ms resolution, round up so requests are not sent early */
+    if(poll(fds, door_count, (int)((wait_ns + 999999L) / 1000000L)) > 0)
+    {
+      for(i = 0; i < door_count; i++)
+      {
+        if((fds[i].revents & POLLIN) != 0)
+        {
+          receive(&doors[i], i);
+        }
+      }
+    }
+  }
+
+  for(i = 0; i < door_count; i++)
+  {
+    printf("door %u: requests %lu, responses %lu, missing %lu, late %lu, errors %lu, latency min %.2f avg %.2f max %.2f ms\n",
+           i + 1, doors[i].requests, doors[i].responses, doors[i].missing, doors[i].late, doors[i].errors,
+           doors[i].latency_min / 1e6, (doors[i].responses > 0) ? (doors[i].latency_sum / (double)doors[i].responses) / 1e6 : 0.0,
+           doors[i].latency_max / 1e6);
+    if(!doors[i].detected || (doors[i].missing > 0) || (doors[i].late > 0) || (doors[i].errors > 0))
+    {
+      result = EXIT_FAILURE;
+    }
+    unlink(doors[i].link);
+    close(doors[i].fd);
+  }
+  return result;
+}
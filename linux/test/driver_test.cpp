@@ -0,0 +1,404 @@
+/*
+ * Feeds byte streams of the PIC through esp8266/hoermann_driver.h and checks
+ * the decoded states, diagnostics and the action frames. With the argument
+ * "bench" it measures the receive path instead.
+ */
+
+#include <time.h>
+#include "Arduino.h"
+#include "hoermann_driver.h"
+#include "check.h"
+
+#define MAX_PAYLOAD       15
+#define BENCH_BYTES       (64UL * 1024 * 1024)
+
+uint32_t host_millis = 0;
+
+/* Serial port of the PIC, hands out the queued input and records the output */
+class PicStream
+{
+  public:
+    const uint8_t *p_input;
+    size_t input_length;
+    size_t input_position;
+    uint8_t output[64];
+    size_t output_length;
+
+    PicStream() : p_input(nullptr), input_length(0), input_position(0), output_length(0) {}
+
+    void feed(const uint8_t *p_data, size_t length)
+    {
+      p_input = p_data;
+      input_length = length;
+      input_position = 0;
+    }
+
+    int available()
+    {
+      return (int)(input_length - input_position);
+    }
+
+    int read()
+    {
+      return (input_position < input_length) ? p_input[input_position++] : -1;
+    }
+
+    size_t write(const uint8_t *p_data, size_t length)
+    {
+      if ((output_length + length) <= sizeof(output))
+      {
+        memcpy(&output[output_length], p_data, length);
+        output_length += length;
+      }
+      return length;
+    }
+};
+
+typedef HoermannDriver<PicStream, AdditiveChecksum, MAX_PAYLOAD> PicDriver;
+typedef HoermannDriver<PicStream, Crc8Checksum, MAX_PAYLOAD> Crc8Driver;
+
+/* Builds a frame of the PIC, returns its length */
+static size_t make_frame(uint8_t *p_frame, uint8_t cmd, const uint8_t *p_data, uint8_t length)
+{
+  p_frame[0] = HoermannFrame::sync_byte;
+  p_frame[HoermannFrame::offset_cmd] = cmd;
+  p_frame[HoermannFrame::offset_length] = length;
+  memcpy(&p_frame[HoermannFrame::offset_data], p_data, length);
+  p_frame[HoermannFrame::offset_data + length] = AdditiveChecksum::calc(p_frame, HoermannFrame::offset_data + length);
+  return length + HoermannFrame::overhead;
+}
+
+/* Runs the driver until all input is consumed */
+template<class Driver>
+static void receive(Driver *driver, PicStream *pic, const uint8_t *p_data, size_t length)
+{
+  pic->feed(p_data, length);
+  do
+  {
+    driver->loop();
+  } while (pic->available() > 0);
+}
+
+/* Straightforward decoding of docs/hoermann.md to compare the table against */
+static cover_state_t reference_cover(uint8_t status)
+{
+  if (status & 0x01)
+  {
+    return cover_open;
+  }
+  if (status & 0x02)
+  {
+    return cover_closed;
+  }
+  if ((status & 0x40) == 0)
+  {
+    return cover_stopped;
+  }
+  return (status & 0x20) ? cover_closing : cover_opening;
+}
+
+static void test_status(void)
+{
+  const uint8_t data[] = { 0x48, 0x01 };
+  uint8_t frame[HoermannFrame::overhead + MAX_PAYLOAD];
+  hoermann_state_t state;
+  HoermannDoor door;
+  PicStream pic;
+  PicDriver driver(&pic, &door);
+  size_t length;
+
+  CHECK(!door.get_state().data_valid);
+  length = make_frame(frame, HoermannFrame::cmd_status, data, sizeof(data));
+  receive(&driver, &pic, frame, length);
+  state = door.get_state();
+  CHECK(state.data_valid);
+  CHECK(state.cover == cover_opening);
+  CHECK(state.light);
+  CHECK(state.prewarn);
+  CHECK(!state.venting);
+  CHECK(!state.error);
+  CHECK(!state.option_relay);
+}
+
+static void test_decode_table(void)
+{
+  uint8_t data[2] = { 0, 0 };
+  hoermann_state_t state;
+  bool all_equal = true;
+
+  for (unsigned int status = 0; status < 256; status++)
+  {
+    data[0] = (uint8_t)status;
+    HoermannStatusDecoder::decode(data, &state);
+    all_equal = all_equal && (state.cover == reference_cover((uint8_t)status));
+  }
+  CHECK(all_equal);
+}
+
+static void test_framing(void)
+{
+  const uint8_t open[] = { 0x01, 0x00 };
+  const uint8_t closed[] = { 0x02, 0x00 };
+  uint8_t stream[64];
+  uint8_t frame[HoermannFrame::overhead + MAX_PAYLOAD];
+  HoermannDoor door;
+  PicStream pic;
+  PicDriver driver(&pic, &door);
+  size_t length;
+  size_t i;
+
+  // Byte by byte, as from a slow UART
+  length = make_frame(frame, HoermannFrame::cmd_status, open, sizeof(open));
+  for (i = 0; i < length; i++)
+  {
+    receive(&driver, &pic, &frame[i], 1);
+  }
+  CHECK(door.get_state().cover == cover_open);
+
+  // Wrong checksum is dropped
+  length = make_frame(frame, HoermannFrame::cmd_status, closed, sizeof(closed));
+  frame[length - 1]++;
+  receive(&driver, &pic, frame, length);
+  CHECK(door.get_state().cover == cover_open);
+
+  // Garbage and a length beyond MaxPayload before a valid frame
+  length = 0;
+  stream[length++] = 0x12;
+  stream[length++] = HoermannFrame::sync_byte;
+  stream[length++] = HoermannFrame::cmd_status;
+  stream[length++] = MAX_PAYLOAD + 1;
+  length += make_frame(&stream[length], HoermannFrame::cmd_status, closed, sizeof(closed));
+  receive(&driver, &pic, stream, length);
+  CHECK(door.get_state().cover == cover_closed);
+
+  // Two frames in one read, the last one counts
+  length = make_frame(stream, HoermannFrame::cmd_status, open, sizeof(open));
+  length += make_frame(&stream[length], HoermannFrame::cmd_status, closed, sizeof(closed));
+  receive(&driver, &pic, stream, length);
+  CHECK(door.get_state().cover == cover_closed);
+
+  // Unknown commands and a status with the wrong length don't change the state
+  length = make_frame(stream, 0x7F, open, sizeof(open));
+  length += make_frame(&stream[length], HoermannFrame::cmd_status, open, 1);
+  receive(&driver, &pic, stream, length);
+  CHECK(door.get_state().cover == cover_closed);
+}
+
+static void test_diagnostics(void)
+{
+  const uint8_t load[] = { 37 };
+  const uint8_t bus[] = { 21, 0x02, 0x12, 0x05, 0x00, 0x03, 2, 1, 4, 5, 0xE8, 0x03, 0xFF, 0x06, 9 };
+  uint8_t frame[HoermannFrame::overhead + MAX_PAYLOAD];
+  hoermann_diagnostics_t diagnostics;
+  HoermannDoor door;
+  PicStream pic;
+  PicDriver driver(&pic, &door);
+  size_t length;
+
+  CHECK(!door.get_diagnostics().valid);
+
+  // Older PIC firmware only sends the load
+  length = make_frame(frame, HoermannFrame::cmd_diagnostics, load, sizeof(load));
+  receive(&driver, &pic, frame, length);
+  diagnostics = door.get_diagnostics();
+  CHECK(diagnostics.valid);
+  CHECK(!diagnostics.bus_valid);
+  CHECK(!diagnostics.slaves_valid);
+  CHECK(!diagnostics.stray_valid);
+  CHECK(diagnostics.active_percent == 37);
+
+  // PIC firmware with supervisor but without the slave table check
+  length = make_frame(frame, HoermannFrame::cmd_diagnostics, bus, HoermannFrame::diagnostics_bus_length);
+  receive(&driver, &pic, frame, length);
+  diagnostics = door.get_diagnostics();
+  CHECK(diagnostics.bus_valid);
+  CHECK(!diagnostics.slaves_valid);
+
+  // PIC firmware without the stray byte counter
+  length = make_frame(frame, HoermannFrame::cmd_diagnostics, bus, HoermannFrame::diagnostics_slaves_length);
+  receive(&driver, &pic, frame, length);
+  diagnostics = door.get_diagnostics();
+  CHECK(diagnostics.slaves_valid);
+  CHECK(!diagnostics.stray_valid);
+
+  // All fields
+  length = make_frame(frame, HoermannFrame::cmd_diagnostics, bus, sizeof(bus));
+  receive(&driver, &pic, frame, length);
+  diagnostics = door.get_diagnostics();
+  CHECK(diagnostics.bus_valid);
+  CHECK(diagnostics.active_percent == 21);
+  CHECK(diagnostics.bus_level == hoermann_bus_uart_reinit);
+  CHECK(diagnostics.master_age == 0x0512);
+  CHECK(diagnostics.response_age == 0x0300);
+  CHECK(diagnostics.receiver_resets == 2);
+  CHECK(diagnostics.uart_reinits == 1);
+  CHECK(diagnostics.watchdog_resets == 4);
+  CHECK(diagnostics.overruns == 5);
+  CHECK(diagnostics.recoveries == 0xE8);
+  CHECK(diagnostics.mean_recovery_time == 0xFF03);
+  CHECK(diagnostics.slaves_valid);
+  CHECK(diagnostics.rejected_slaves == 0x06);
+  CHECK(diagnostics.stray_valid);
+  CHECK(diagnostics.stray_bytes == 9);
+}
+
+static void test_action(void)
+{
+  HoermannDoor door;
+  PicStream pic;
+  PicDriver driver(&pic, &door);
+
+  driver.loop();
+  CHECK(pic.output_length == 0);
+
+  door.trigger_action(hoermann_action_venting);
+  driver.loop();
+  CHECK(pic.output_length == 5);
+  CHECK(pic.output[0] == HoermannFrame::sync_byte);
+  CHECK(pic.output[1] == HoermannFrame::cmd_action);
+  CHECK(pic.output[2] == 0x01);
+  CHECK(pic.output[3] == hoermann_action_venting);
+  CHECK(pic.output[4] == (uint8_t)(0x55 + 0x01 + 0x01 + hoermann_action_venting));
+
+  // Sent only once, a new trigger replaces a pending one
+  driver.loop();
+  CHECK(pic.output_length == 5);
+  door.trigger_action(hoermann_action_open);
+  door.trigger_action(hoermann_action_close);
+  driver.loop();
+  CHECK(pic.output_length == 10);
+  CHECK(pic.output[8] == hoermann_action_close);
+}
+
+static void test_restore(void)
+{
+  const uint8_t data[] = { 0x02, 0x00 };
+  uint8_t frame[HoermannFrame::overhead + MAX_PAYLOAD];
+  hoermann_state_t restored;
+  HoermannDoor door;
+  PicStream pic;
+  PicDriver driver(&pic, &door);
+  size_t length;
+
+  restored = HoermannStateCodec::unpack(HoermannStateCodec::pack({ cover_open, true, false, false, true, false, true }));
+  door.restore_state(restored);
+  CHECK(door.get_state().data_valid);
+  CHECK(door.get_state().cover == cover_open);
+  CHECK(door.get_state().venting);
+  CHECK(door.get_state().light);
+
+  // The PIC has the last word
+  length = make_frame(frame, HoermannFrame::cmd_status, data, sizeof(data));
+  receive(&driver, &pic, frame, length);
+  CHECK(door.get_state().cover == cover_closed);
+  CHECK(!door.get_state().venting);
+  door.restore_state(restored);
+  CHECK(door.get_state().cover == cover_closed);
+}
+
+/* Bitwise CRC8 of the bus to compare the table against */
+static uint8_t reference_crc8(const uint8_t *p_data, uint8_t length)
+{
+  uint8_t crc = 0xF3;
+
+  for (uint8_t i = 0; i < length; i++)
+  {
+    crc ^= p_data[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static void test_crc8(void)
+{
+  // Examples of docs/hoermann.md, broadcast status and slave status response
+  const uint8_t broadcast[] = { 0x00, 0x52, 0x01, 0x02 };
+  const uint8_t response[] = { 0x80, 0x63, 0x29, 0x01, 0x10 };
+  const uint8_t data[] = { 0x02, 0x00 };
+  uint8_t frame[HoermannFrame::overhead + MAX_PAYLOAD];
+  uint8_t bytes[256];
+  bool all_equal = true;
+  HoermannDoor door;
+  PicStream pic;
+  Crc8Driver driver(&pic, &door);
+  size_t length;
+
+  CHECK(Crc8Checksum::calc(broadcast, sizeof(broadcast)) == 0xD0);
+  CHECK(Crc8Checksum::calc(response, sizeof(response)) == 0x4B);
+  for (unsigned int i = 0; i < sizeof(bytes); i++)
+  {
+    bytes[i] = (uint8_t)(i * 37 + 11);
+    all_equal = all_equal && (Crc8Checksum::calc(bytes, (uint8_t)i) == reference_crc8(bytes, (uint8_t)i));
+  }
+  CHECK(all_equal);
+
+  // The driver uses the policy in both directions, an additive checksum is dropped
+  length = make_frame(frame, HoermannFrame::cmd_status, data, sizeof(data));
+  receive(&driver, &pic, frame, length);
+  CHECK(!door.get_state().data_valid);
+  frame[length - 1] = Crc8Checksum::calc(frame, (uint8_t)(length - 1));
+  receive(&driver, &pic, frame, length);
+  CHECK(door.get_state().cover == cover_closed);
+
+  door.trigger_action(hoermann_action_open);
+  driver.loop();
+  CHECK(pic.output_length == 5);
+  CHECK(pic.output[4] == Crc8Checksum::calc(pic.output, 4));
+}
+
+/* Receive path throughput with a stream of status and diagnostics frames */
+static void bench(void)
+{
+  const uint8_t status[] = { 0x48, 0x00 };
+  const uint8_t bus[] = { 21, 0x02, 0x12, 0x05, 0x00, 0x03, 2, 1, 4, 5, 0xE8, 0x03, 0xFF };
+  static uint8_t stream[4096];
+  struct timespec start;
+  struct timespec end;
+  size_t length = 0;
+  size_t total = 0;
+  double seconds;
+  HoermannDoor door;
+  PicStream pic;
+  PicDriver driver(&pic, &door);
+
+  while ((length + 2 * (HoermannFrame::overhead + MAX_PAYLOAD)) < sizeof(stream))
+  {
+    length += make_frame(&stream[length], HoermannFrame::cmd_status, status, sizeof(status));
+    length += make_frame(&stream[length], HoermannFrame::cmd_diagnostics, bus, sizeof(bus));
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (total < BENCH_BYTES)
+  {
+    receive(&driver, &pic, stream, length);
+    total += length;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("driver_test bench: %zu bytes in %.3f s, %.1f MB/s, %.2f ns/byte\n",
+         total, seconds, total / seconds / 1e6, seconds * 1e9 / total);
+  CHECK(door.get_diagnostics().bus_valid && door.get_state().light);
+}
+
+int main(int argc, char *argv[])
+{
+  if ((argc > 1) && (strcmp(argv[1], "bench") == 0))
+  {
+    bench();
+    return check_summary("driver_test bench");
+  }
+
+  test_status();
+  test_decode_table();
+  test_framing();
+  test_diagnostics();
+  test_action();
+  test_restore();
+  test_crc8();
+
+  return check_summary("driver_test");
+}
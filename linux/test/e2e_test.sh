@@ -0,0 +1,75 @@
+#!/bin/sh
+# End-to-end test of hoermannd. test/drive_sim plays the door drives on ptys
+# and checks that every request is answered in time.
+#
+#   1. MQTT server unreachable: the buses must be served without a miss.
+#   2. With a local mosquitto: discovery, a command from MQTT moves the
+#      simulated door and its new position is published. Skipped if the
+#      mosquitto broker and clients are not installed.
+#
+# Usage: test/e2e_test.sh [doors] [seconds] [window_ms]
+#
+# The window is wider than the response delay, the simulator shares the CPU
+# with the daemon and its own wake-ups are late as well on a loaded host.
+
+DOORS=${1:-4}
+SECONDS_PER_RUN=${2:-10}
+WINDOW=${3:-20}
+PORT=18830
+ID=e2e
+
+cd "$(dirname "$0")/.." || exit 1
+DIR=$(mktemp -d)
+trap 'kill $DAEMON $BROKER $SUB 2>/dev/null; rm -rf "$DIR"' EXIT
+
+# Starts the drive simulator, then hoermannd on its ptys, waits for the simulator
+run()
+{
+  test/drive_sim -n "$DOORS" -t "$SECONDS_PER_RUN" -w "$WINDOW" "$DIR" > "$DIR/sim.out" &
+  SIM=$!
+  while ! grep -q ready "$DIR/sim.out" 2>/dev/null; do sleep 0.1; done
+  TTYS=""
+  i=1
+  while [ "$i" -le "$DOORS" ]; do TTYS="$TTYS $DIR/door$i"; i=$((i + 1)); done
+  ./hoermannd -i "$ID" "$@" $TTYS > "$DIR/daemon.out" 2>&1 &
+  DAEMON=$!
+}
+
+finish()
+{
+  wait "$SIM"
+  RESULT=$?
+  kill "$DAEMON" 2>/dev/null
+  wait "$DAEMON" 2>/dev/null
+  grep "requests" "$DIR/sim.out"
+  return $RESULT
+}
+
+echo "MQTT server unreachable"
+run -H 10.255.255.1
+finish || { echo "FAILED: requests missed while the MQTT server is unreachable"; exit 1; }
+
+if ! command -v mosquitto > /dev/null || ! command -v mosquitto_pub > /dev/null; then
+  echo "mosquitto not installed, MQTT round trip skipped"
+  exit 0
+fi
+
+echo "MQTT round trip"
+mosquitto -p $PORT > "$DIR/broker.out" 2>&1 &
+BROKER=$!
+sleep 0.5
+mosquitto_sub -p $PORT -v -t "homeassistant/#" > "$DIR/sub.out" &
+SUB=$!
+run -H localhost -p $PORT
+sleep 2
+# The first door has no number in its id
+mosquitto_pub -p $PORT -t "homeassistant/cover/${ID}_cover/command" -m OPEN
+finish || { echo "FAILED: requests missed while connected"; exit 1; }
+
+FAILED=0
+grep -q "^homeassistant/cover/${ID}_cover/config " "$DIR/sub.out" || { echo "FAILED: no discovery"; FAILED=1; }
+grep -q "^homeassistant/cover/${ID}_cover/availability online" "$DIR/sub.out" || { echo "FAILED: not online"; FAILED=1; }
+grep -q "^door 1: action open" "$DIR/sim.out" || { echo "FAILED: command not sent to the drive"; FAILED=1; }
+grep -q "^homeassistant/cover/${ID}_cover/position 100" "$DIR/sub.out" || { echo "FAILED: position not published"; FAILED=1; }
+[ $FAILED -eq 0 ] && echo "passed"
+exit $FAILED
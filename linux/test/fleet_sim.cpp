@@ -0,0 +1,496 @@
+/*
+ * Simulates a fleet of ESP8266 units on one MQTT broker. Every unit runs
+ * esp8266/connection_manager.cpp, the reconnect and discovery logic of
+ * setup() and connection_task() of esp8266.ino, and performs its actions
+ * like the firmware.
+ *
+ * Without -b the broker and time are simulated: the broker is down for the
+ * first outage ms and accepts a limited number of connects per second,
+ * attempts beyond it time out on the unit. With -b every unit connects to a
+ * real broker in real time, test/fleet_test.sh stops and starts mosquitto
+ * around it.
+ *
+ *   power    power cut, the units boot within the boot spread, connect and
+ *            send their discovery
+ *   restart  broker restart, all units were connected and lose it at the
+ *            same moment, their session is kept
+ *
+ * It reports the connect attempts and published messages per second and the
+ * time until the fleet has converged, i.e. all units are connected and have
+ * sent their discovery. "-m 0 -M 0 -d 0" behaves like the firmware without
+ * backoff: an attempt on every run of the connection task and the discovery
+ * right after the first connect.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "Arduino.h"
+#include "connection_manager.h"
+
+// Defaults of esp8266.ino
+#define CONNECTION_TASK_PERIOD    500
+#define MQTT_RECONNECT_MIN_DELAY  1000
+#define MQTT_RECONNECT_MAX_DELAY  60000
+#define DISCOVERY_MAX_DELAY       10000
+#define RECONNECT_LIMIT           100
+#define CONNECT_MESSAGES          1     // availability
+#define DISCOVERY_MESSAGES        8     // DISCOVERY_DOOR_ENTITY_COUNT, one door without BME280
+
+#define BOOT_SPREAD               2000  // WiFi association after power up
+#define CONNACK_TIMEOUT           1000  // ms a unit waits for the broker on a real connect
+
+uint32_t host_millis = 0;
+
+enum scenario_t
+{
+  scenario_power,
+  scenario_restart
+};
+
+struct Unit
+{
+  ConnectionManager connection;
+  bool booted;
+  bool connected;
+  uint32_t boot_time;
+  uint32_t next_run;
+  uint32_t connect_time;
+  int fd;
+
+  Unit(uint32_t min_delay, uint32_t max_delay, uint32_t discovery_max_delay)
+    : connection(min_delay, max_delay, discovery_max_delay, RECONNECT_LIMIT), booted(false), connected(false),
+      boot_time(0), next_run(0), connect_time(0), fd(-1) {}
+};
+
+static uint32_t min_delay = MQTT_RECONNECT_MIN_DELAY;
+static uint32_t max_delay = MQTT_RECONNECT_MAX_DELAY;
+static uint32_t discovery_max_delay = DISCOVERY_MAX_DELAY;
+static uint32_t outage = 30000;
+static unsigned int capacity = 0;
+static struct addrinfo *p_broker = NULL;
+
+static std::vector<unsigned int> attempts_per_second;
+static std::vector<unsigned int> accepted_per_second;
+static std::vector<unsigned int> messages_per_second;
+static unsigned long attempts = 0;
+static unsigned long failures = 0;
+static unsigned long restarts = 0;
+
+
+static uint32_t real_millis(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+/* Fixed header and a remaining length below 128, which all packets here have */
+static size_t mqtt_header(uint8_t *p_packet, uint8_t type, size_t length)
+{
+  p_packet[0] = type;
+  p_packet[1] = (uint8_t)length;
+  return 2;
+}
+
+static size_t mqtt_string(uint8_t *p_packet, const char *p_string)
+{
+  size_t length = strlen(p_string);
+
+  p_packet[0] = (uint8_t)(length >> 8);
+  p_packet[1] = (uint8_t)length;
+  memcpy(&p_packet[2], p_string, length);
+  return length + 2;
+}
+
+static void mqtt_close(Unit *unit)
+{
+  if (unit->fd >= 0)
+  {
+    close(unit->fd);
+    unit->fd = -1;
+  }
+}
+
+/* CONNECT with a clean session and without keep alive, waits for CONNACK */
+static bool mqtt_connect(Unit *unit, unsigned int index)
+{
+  static const uint8_t variable_header[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x00 };
+  struct timeval timeout = { CONNACK_TIMEOUT / 1000, (CONNACK_TIMEOUT % 1000) * 1000 };
+  uint8_t packet[64];
+  uint8_t connack[4];
+  char client_id[16];
+  size_t length;
+
+  snprintf(client_id, sizeof(client_id), "fleet%u", index);
+  length = sizeof(variable_header) + 2 + strlen(client_id);
+  length = mqtt_header(packet, 0x10, length);
+  memcpy(&packet[length], variable_header, sizeof(variable_header));
+  length += sizeof(variable_header);
+  length += mqtt_string(&packet[length], client_id);
+
+  unit->fd = socket(p_broker->ai_family, p_broker->ai_socktype, p_broker->ai_protocol);
+  if ((unit->fd < 0) ||
+      (setsockopt(unit->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) ||
+      (connect(unit->fd, p_broker->ai_addr, p_broker->ai_addrlen) != 0) ||
+      (send(unit->fd, packet, length, MSG_NOSIGNAL) != (ssize_t)length) ||
+      (recv(unit->fd, connack, sizeof(connack), MSG_WAITALL) != sizeof(connack)) ||
+      (connack[0] != 0x20) || (connack[3] != 0x00))
+  {
+    mqtt_close(unit);
+    return false;
+  }
+  return true;
+}
+
+/* QoS 0, a failed send is a lost connection like in PubSubClient */
+static bool mqtt_publish(Unit *unit, unsigned int index, unsigned int message)
+{
+  uint8_t packet[64];
+  char topic[32];
+  size_t length;
+
+  snprintf(topic, sizeof(topic), "fleet/%u/%u", index, message);
+  length = mqtt_header(packet, 0x30, strlen(topic) + 2 + 2);
+  length += mqtt_string(&packet[length], topic);
+  memcpy(&packet[length], "on", 2);
+  length += 2;
+  return send(unit->fd, packet, length, MSG_NOSIGNAL) == (ssize_t)length;
+}
+
+/* client.connected(): the broker closed the connection if it reads as EOF */
+static bool mqtt_connected(Unit *unit)
+{
+  uint8_t data[64];
+  ssize_t result;
+
+  while ((result = recv(unit->fd, data, sizeof(data), MSG_DONTWAIT)) > 0)
+  {
+  }
+  return (result < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+}
+
+/* Broker side of a connect attempt */
+static bool broker_connect(Unit *unit, unsigned int index, uint32_t now)
+{
+  uint32_t second = now / 1000;
+  bool accepted;
+
+  attempts++;
+  attempts_per_second[second]++;
+  if (p_broker != NULL)
+  {
+    accepted = mqtt_connect(unit, index);
+  }
+  else
+  {
+    accepted = (now >= outage) && ((capacity == 0) || (accepted_per_second[second] < capacity));
+  }
+  if (!accepted)
+  {
+    failures++;
+    return false;
+  }
+  accepted_per_second[second]++;
+  return true;
+}
+
+static void publish(Unit *unit, unsigned int index, uint32_t now, unsigned int count)
+{
+  unsigned int i;
+
+  messages_per_second[now / 1000] += count;
+  for (i = 0; (p_broker != NULL) && unit->connected && (i < count); i++)
+  {
+    if (!mqtt_publish(unit, index, i))
+    {
+      mqtt_close(unit);
+      unit->connected = false;
+    }
+  }
+}
+
+/* reconnect_mqtt() and the connect in setup() */
+static void connect_unit(Unit *unit, unsigned int index, uint32_t now)
+{
+  if (broker_connect(unit, index, now))
+  {
+    unit->connection.connected(now);
+    unit->connected = true;
+    unit->connect_time = now;
+    publish(unit, index, now, CONNECT_MESSAGES);
+  }
+  else
+  {
+    unit->connection.failed(now);
+  }
+}
+
+/* Power up or ESP.restart(), the session is gone */
+static void boot(Unit *unit, uint32_t now)
+{
+  mqtt_close(unit);
+  unit->booted = false;
+  unit->connected = false;
+  unit->boot_time = now + 1 + random(BOOT_SPREAD);
+  unit->connection = ConnectionManager(min_delay, max_delay, discovery_max_delay, RECONNECT_LIMIT);
+}
+
+static void setup(Unit *unit, unsigned int index, uint32_t now)
+{
+  unit->booted = true;
+  unit->next_run = now + CONNECTION_TASK_PERIOD;
+  unit->connection.begin(now, false);
+  connect_unit(unit, index, now);
+}
+
+static void connection_task(Unit *unit, unsigned int index, uint32_t now)
+{
+  if (unit->connected && (p_broker != NULL) && !mqtt_connected(unit))
+  {
+    mqtt_close(unit);
+    unit->connected = false;
+  }
+
+  switch (unit->connection.run(now, true, unit->connected))
+  {
+    case connection_connect_mqtt:
+      connect_unit(unit, index, now);
+      break;
+    case connection_send_discovery:
+      publish(unit, index, now, DISCOVERY_MESSAGES);
+      break;
+    case connection_restart:
+      restarts++;
+      boot(unit, now);
+      break;
+    default:
+      break;
+  }
+}
+
+static unsigned int percentile(std::vector<unsigned int> values, unsigned int percent)
+{
+  if (values.empty())
+  {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[((values.size() - 1) * percent) / 100];
+}
+
+static bool resolve_broker(const char *p_address)
+{
+  struct addrinfo hints;
+  char host[256];
+  const char *p_port;
+
+  p_port = strrchr(p_address, ':');
+  if ((p_port == NULL) || ((size_t)(p_port - p_address) >= sizeof(host)))
+  {
+    return false;
+  }
+  memcpy(host, p_address, p_port - p_address);
+  host[p_port - p_address] = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  return getaddrinfo(host, p_port + 1, &hints, &p_broker) == 0;
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -s <scenario>  power or restart (default power)\n"
+          "  -n <units>     Number of units (default 200)\n"
+          "  -o <ms>        Broker down from the start (default 30000)\n"
+          "  -c <connects>  Connects per second the broker accepts, 0 unlimited (default 0)\n"
+          "  -m <ms>        MQTT_RECONNECT_MIN_DELAY (default %u)\n"
+          "  -M <ms>        MQTT_RECONNECT_MAX_DELAY (default %u)\n"
+          "  -d <ms>        DISCOVERY_MAX_DELAY (default %u)\n"
+          "  -t <seconds>   Time limit (default 3600)\n"
+          "  -r <seed>      Seed of the random numbers (default 1)\n"
+          "  -b <host:port> Real MQTT broker in real time instead of the simulated one, -o is\n"
+          "                 when the caller brings it back, -c isn't available. The restart\n"
+          "                 scenario connects all units and prints \"ready\" before the time starts\n",
+          program, MQTT_RECONNECT_MIN_DELAY, MQTT_RECONNECT_MAX_DELAY, DISCOVERY_MAX_DELAY);
+}
+
+int main(int argc, char *argv[])
+{
+  scenario_t scenario = scenario_power;
+  unsigned int unit_count = 200;
+  unsigned int limit = 3600;
+  unsigned int seed = 1;
+  const char *p_address = NULL;
+  std::vector<Unit> units;
+  std::vector<unsigned int> connect_times;
+  std::vector<unsigned int> busy_seconds;
+  uint32_t start = 0;
+  uint32_t now;
+  uint32_t converged = 0;
+  bool all_done;
+  unsigned int i;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:n:o:c:m:M:d:t:r:b:h")) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        if (strcmp(optarg, "power") == 0)
+        {
+          scenario = scenario_power;
+        }
+        else if (strcmp(optarg, "restart") == 0)
+        {
+          scenario = scenario_restart;
+        }
+        else
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'n': unit_count = (unsigned int)atoi(optarg); break;
+      case 'o': outage = (uint32_t)atol(optarg); break;
+      case 'c': capacity = (unsigned int)atoi(optarg); break;
+      case 'm': min_delay = (uint32_t)atol(optarg); break;
+      case 'M': max_delay = (uint32_t)atol(optarg); break;
+      case 'd': discovery_max_delay = (uint32_t)atol(optarg); break;
+      case 't': limit = (unsigned int)atoi(optarg); break;
+      case 'r': seed = (unsigned int)atoi(optarg); break;
+      case 'b': p_address = optarg; break;
+      default: usage(argv[0]); return EXIT_FAILURE;
+    }
+  }
+  if ((optind != argc) || (unit_count == 0) || (limit == 0) || ((outage / 1000) >= limit) ||
+      ((p_address != NULL) && (capacity > 0)))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if ((p_address != NULL) && !resolve_broker(p_address))
+  {
+    fprintf(stderr, "%s: can't resolve %s\n", argv[0], p_address);
+    return EXIT_FAILURE;
+  }
+
+  srand(seed);
+  attempts_per_second.assign(limit + 1, 0);
+  accepted_per_second.assign(limit + 1, 0);
+  messages_per_second.assign(limit + 1, 0);
+  units.assign(unit_count, Unit(min_delay, max_delay, discovery_max_delay));
+  for (i = 0; i < unit_count; i++)
+  {
+    Unit &unit = units[i];
+
+    if (scenario == scenario_power)
+    {
+      boot(&unit, 0);
+    }
+    else
+    {
+      // Connected with discovery sent, the connection task runs at any phase
+      unit.booted = true;
+      unit.next_run = random(CONNECTION_TASK_PERIOD);
+      unit.connection.begin(0, true);
+      unit.connection.connected(0);
+      if ((p_broker != NULL) && !(unit.connected = mqtt_connect(&unit, i)))
+      {
+        fprintf(stderr, "%s: unit %u can't connect to %s\n", argv[0], i, p_address);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  if (p_broker != NULL)
+  {
+    if (scenario == scenario_restart)
+    {
+      printf("ready\n");
+      fflush(stdout);
+    }
+    start = real_millis();
+  }
+
+  for (now = 0; now < (limit * 1000); now++)
+  {
+    if (p_broker != NULL)
+    {
+      usleep(1000);
+      now = real_millis() - start;
+      if (now >= (limit * 1000))
+      {
+        break;
+      }
+    }
+    host_millis = now;
+    all_done = true;
+    for (i = 0; i < unit_count; i++)
+    {
+      Unit &unit = units[i];
+
+      if (!unit.booted)
+      {
+        if ((int32_t)(now - unit.boot_time) >= 0)
+        {
+          setup(&unit, i, now);
+        }
+      }
+      else if ((int32_t)(now - unit.next_run) >= 0)
+      {
+        unit.next_run += CONNECTION_TASK_PERIOD;
+        connection_task(&unit, i, now);
+      }
+      all_done = all_done && unit.connected && !unit.connection.is_discovery_pending();
+    }
+    if (all_done && (now >= outage))
+    {
+      converged = now;
+      break;
+    }
+  }
+
+  for (Unit &unit : units)
+  {
+    if (unit.connected)
+    {
+      connect_times.push_back(unit.connect_time - outage);
+    }
+    mqtt_close(&unit);
+  }
+  if (p_broker != NULL)
+  {
+    freeaddrinfo(p_broker);
+  }
+  for (uint32_t second = 0; second <= (now / 1000); second++)
+  {
+    busy_seconds.push_back(attempts_per_second[second]);
+  }
+
+  printf("fleet_sim: %s, %u units, broker down for %.1f s, %u connects/s, backoff %u-%u ms, discovery within %u ms%s%s\n",
+         (scenario == scenario_power) ? "power" : "restart", unit_count, outage / 1000.0, capacity,
+         min_delay, max_delay, discovery_max_delay, (p_address != NULL) ? ", broker " : "", (p_address != NULL) ? p_address : "");
+  printf("connect attempts %lu, failed %lu, restarts %lu\n", attempts, failures, restarts);
+  printf("attempts per second: peak %u, p90 %u, p50 %u\n",
+         percentile(busy_seconds, 100), percentile(busy_seconds, 90), percentile(busy_seconds, 50));
+  printf("messages per second: peak %u\n",
+         *std::max_element(messages_per_second.begin(), messages_per_second.end()));
+  printf("connected after the broker came back: p50 %.1f s, p90 %.1f s, max %.1f s\n",
+         percentile(connect_times, 50) / 1000.0, percentile(connect_times, 90) / 1000.0, percentile(connect_times, 100) / 1000.0);
+  if (converged == 0)
+  {
+    printf("not converged within %u s\n", limit);
+    return EXIT_FAILURE;
+  }
+  printf("converged after %.1f s, %.1f s after the broker came back\n", converged / 1000.0, (converged - outage) / 1000.0);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#!/bin/sh
+# Runs test/fleet_sim against a local mosquitto in real time, the units
+# connect and publish over TCP like the firmware. Skipped if the mosquitto
+# broker is not installed.
+#
+#   1. Power cut: the broker starts after the outage, the units boot at once.
+#   2. Broker restart: all units are connected, the broker is killed and
+#      started again after the outage.
+#
+# Usage: test/fleet_test.sh [units] [outage_seconds] [limit_seconds]
+
+UNITS=${1:-50}
+OUTAGE=${2:-10}
+LIMIT=${3:-300}
+PORT=18831
+BROKER_ADDRESS=localhost:$PORT
+
+cd "$(dirname "$0")/.." || exit 1
+
+if ! command -v mosquitto > /dev/null; then
+  echo "mosquitto not installed, fleet run against a broker skipped"
+  exit 0
+fi
+
+DIR=$(mktemp -d)
+trap 'kill $BROKER $SIM 2>/dev/null; rm -rf "$DIR"' EXIT
+
+start_broker()
+{
+  mosquitto -p $PORT > "$DIR/broker.out" 2>&1 &
+  BROKER=$!
+}
+
+stop_broker()
+{
+  kill "$BROKER" 2>/dev/null
+  wait "$BROKER" 2>/dev/null
+}
+
+FAILED=0
+
+echo "Power cut, broker back after $OUTAGE s"
+test/fleet_sim -s power -n "$UNITS" -o $((OUTAGE * 1000)) -t "$LIMIT" -b $BROKER_ADDRESS > "$DIR/power.out" &
+SIM=$!
+sleep "$OUTAGE"
+start_broker
+wait "$SIM" || { echo "FAILED: fleet not converged after the power cut"; FAILED=1; }
+cat "$DIR/power.out"
+stop_broker
+
+echo "Broker restart, down for $OUTAGE s"
+start_broker
+sleep 0.5
+test/fleet_sim -s restart -n "$UNITS" -o $((OUTAGE * 1000)) -t "$LIMIT" -b $BROKER_ADDRESS > "$DIR/restart.out" &
+SIM=$!
+while ! grep -q ready "$DIR/restart.out" 2>/dev/null; do
+  kill -0 "$SIM" 2>/dev/null || break
+  sleep 0.1
+done
+stop_broker
+sleep "$OUTAGE"
+start_broker
+wait "$SIM" || { echo "FAILED: fleet not converged after the broker restart"; FAILED=1; }
+grep -v "^ready" "$DIR/restart.out"
+stop_broker
+
+[ $FAILED -eq 0 ] && echo "passed"
+exit $FAILED
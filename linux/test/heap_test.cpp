@@ -0,0 +1,188 @@
+/*
+ * Soak test of the steady state paths of the ESP modules: topics, discovery
+ * and state payloads in TextBuffer, the journal, the rules and the PIC
+ * driver. malloc and operator new are counted, after the first round no
+ * path may allocate anymore.
+ */
+
+#include <new>
+#include "Arduino.h"
+#include "text_buffer.h"
+#include "door_channel.h"
+#include "discovery.h"
+#include "journal.h"
+#include "rules.h"
+#include "hoermann_driver.h"
+#include "check.h"
+
+#define ROUNDS            1000
+#define PAYLOAD_SIZE      2112
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p_memory, size_t size);
+extern "C" void __libc_free(void *p_memory);
+
+uint32_t host_millis = 0;
+
+static unsigned long allocations = 0;
+
+/* Like umm_malloc with UMM_STATS_FULL on the ESP, every allocation is counted */
+extern "C" void *malloc(size_t size)
+{
+  allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *p_memory, size_t size)
+{
+  allocations++;
+  return __libc_realloc(p_memory, size);
+}
+
+extern "C" void free(void *p_memory)
+{
+  __libc_free(p_memory);
+}
+
+void *operator new(size_t size)
+{
+  void *p_memory = malloc(size);
+
+  if (p_memory == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return p_memory;
+}
+
+void operator delete(void *p_memory) noexcept
+{
+  free(p_memory);
+}
+
+void operator delete(void *p_memory, size_t) noexcept
+{
+  free(p_memory);
+}
+
+/* Serial port of the PIC which repeats a status frame */
+class PicStream
+{
+  public:
+    uint8_t frame[HoermannFrame::overhead + HoermannFrame::status_length];
+    size_t position;
+
+    PicStream() : position(sizeof(frame)) {}
+
+    void send_status(uint8_t status)
+    {
+      frame[0] = HoermannFrame::sync_byte;
+      frame[HoermannFrame::offset_cmd] = HoermannFrame::cmd_status;
+      frame[HoermannFrame::offset_length] = HoermannFrame::status_length;
+      frame[HoermannFrame::offset_data] = status;
+      frame[HoermannFrame::offset_data + 1] = 0x00;
+      frame[HoermannFrame::offset_data + 2] = AdditiveChecksum::calc(frame, HoermannFrame::offset_data + 2);
+      position = 0;
+    }
+
+    int available()
+    {
+      return (int)(sizeof(frame) - position);
+    }
+
+    int read()
+    {
+      return (position < sizeof(frame)) ? frame[position++] : -1;
+    }
+
+    size_t write(const uint8_t *, size_t length)
+    {
+      return length;
+    }
+};
+
+static char payload_buffer[PAYLOAD_SIZE];
+static TextBuffer payload(payload_buffer, sizeof(payload_buffer));
+static DoorChannel channel;
+static Journal journal;
+
+/* One round of everything the tasks do between two metrics periods */
+static bool run_round(PicStream *pic, HoermannDriver<PicStream, AdditiveChecksum, 15> *driver, unsigned int round)
+{
+  const uint8_t statuses[] = { 0x01, 0x40, 0x02, 0x60, 0x09 };
+  char topic[TOPIC_SIZE];
+  discovery_device_t device;
+  hoermann_state_t state;
+  const journal_entry_t *entry;
+  bool valid = true;
+
+  // Door task: status of the PIC, rules, journal
+  pic->send_status(statuses[round % sizeof(statuses)]);
+  host_millis += 5;
+  driver->loop();
+  state = channel.door.get_state();
+  channel.rules.update(state);
+  channel.rules.run();
+  journal.add_door_state(0, state);
+  journal.add_bme_sample(21.5F + (round % 10), 45.0F, 1013.2F);
+
+  // Topics after a reconnect, discovery, state and history payloads
+  channel.setup_topics("hoermann_door_a1b2c3d4e5f6", 0);
+  device.unique_id = channel.unique_id;
+  device.object_id = "hoermann_door";
+  device.description = "\"dev\":{\"ids\":\"hoermann_door_a1b2c3d4e5f6\",\"name\":\"Garage door\"}";
+  device.avty_topic = channel.cover_pos_topic;
+  for (uint8_t i = 0; i < DISCOVERY_DOOR_ENTITY_COUNT; i++)
+  {
+    valid = discovery_door_entity(&device, i, topic, &payload) && valid;
+  }
+  for (uint8_t i = 0; i < DISCOVERY_BME_ENTITY_COUNT; i++)
+  {
+    valid = discovery_bme_entity(&device, channel.cover_pos_topic, channel.cover_pos_topic, i, topic, &payload) && valid;
+  }
+  payload.clear();
+  payload.appendf("{ \"temperature_C\" : %.1f, \"humidity\" : %.1f, \"pressure_hPa\" : %.1f }", 21.5, 45.0, 1013.2);
+  payload.clear();
+  payload.appendf("{ \"dropped\" : %lu, \"events\" : [", (unsigned long)journal.get_dropped());
+  for (uint16_t i = 0; i < journal.get_count(); i++)
+  {
+    entry = journal.peek(i);
+    payload.appendf("%s{ \"t\" : %lu, \"up\" : %lu, \"type\" : %u }", (i > 0) ? "," : "",
+                    (unsigned long)entry->time, (unsigned long)entry->uptime, entry->type);
+  }
+  payload.append(" ] }");
+  journal.remove(journal.get_count());
+  return valid && !payload.overflow();
+}
+
+int main(void)
+{
+  PicStream pic;
+  HoermannDriver<PicStream, AdditiveChecksum, 15> driver(&pic, &channel.door);
+  unsigned long after_first_round;
+  bool valid;
+
+  // Configuration from MQTT, not part of the steady state
+  CHECK(channel.rules.load("open for 600 do close; opening & !light do toggle_light"));
+
+  valid = run_round(&pic, &driver, 0);
+  after_first_round = allocations;
+  for (unsigned int round = 1; round < ROUNDS; round++)
+  {
+    valid = run_round(&pic, &driver, round) && valid;
+  }
+  CHECK(valid);
+  CHECK(channel.door.get_state().data_valid);
+  CHECK(allocations == after_first_round);
+  printf("heap_test: %lu allocations in the first round, %lu in %u rounds after it\n",
+         after_first_round, allocations - after_first_round, ROUNDS - 1);
+
+  return check_summary("heap_test");
+}
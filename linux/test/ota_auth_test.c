@@ -0,0 +1,140 @@
+/*
+ * Checks the HMAC-SHA256 of esp8266/ota_auth.c against RFC 4231 and the
+ * authentication of the OTA command from MQTT.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ota_auth.h"
+#include "check.h"
+
+
+#define KEY     "Your OTA password"
+#define URL     "http://192.168.1.10:8000/firmware.hdp"
+#define MD5     "0123456789abcdef0123456789abcdef"
+
+
+static bool mac_equals(const uint8_t *p_mac, const char *p_hex)
+{
+  char hex[2 * OTA_AUTH_MAC_SIZE + 1];
+  int i;
+
+  for (i = 0; i < OTA_AUTH_MAC_SIZE; i++)
+  {
+    sprintf(&hex[2 * i], "%02x", p_mac[i]);
+  }
+  return strcmp(hex, p_hex) == 0;
+}
+
+/* "<text> <mac>" with the MAC of text under key */
+static void make_command(char *p_command, const char *p_text, const char *p_key)
+{
+  uint8_t mac[OTA_AUTH_MAC_SIZE];
+  int i;
+
+  ota_auth_hmac(p_key, (const uint8_t *)p_text, strlen(p_text), mac);
+  strcpy(p_command, p_text);
+  strcat(p_command, " ");
+  for (i = 0; i < OTA_AUTH_MAC_SIZE; i++)
+  {
+    sprintf(&p_command[strlen(p_command)], "%02x", mac[i]);
+  }
+}
+
+static void test_rfc4231(void)
+{
+  const char *p_data;
+  char key[132];
+  uint8_t mac[OTA_AUTH_MAC_SIZE];
+
+  /* Test case 2 */
+  p_data = "what do ya want for nothing?";
+  ota_auth_hmac("Jefe", (const uint8_t *)p_data, strlen(p_data), mac);
+  CHECK(mac_equals(mac, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"));
+
+  /* Test case 1, key of 20 bytes 0x0b */
+  memset(key, 0x0B, 20);
+  key[20] = '\0';
+  p_data = "Hi There";
+  ota_auth_hmac(key, (const uint8_t *)p_data, strlen(p_data), mac);
+  CHECK(mac_equals(mac, "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7"));
+
+  /* Test case 6, key longer than a block is hashed */
+  memset(key, 0xAA, 131);
+  key[131] = '\0';
+  p_data = "Test Using Larger Than Block-Size Key - Hash Key First";
+  ota_auth_hmac(key, (const uint8_t *)p_data, strlen(p_data), mac);
+  CHECK(mac_equals(mac, "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"));
+}
+
+static void test_command(void)
+{
+  char command[256];
+  const char *p_url = NULL;
+  const char *p_md5 = NULL;
+  size_t length;
+
+  make_command(command, URL " " MD5, KEY);
+  CHECK(ota_auth_check_command(command, KEY, &p_url, &p_md5));
+  CHECK((p_url != NULL) && (strcmp(p_url, URL) == 0));
+  CHECK((p_md5 != NULL) && (strcmp(p_md5, MD5) == 0));
+
+  /* Upper case digits of the MAC are accepted */
+  make_command(command, URL " " MD5, KEY);
+  for (length = strlen(command) - 64; command[length] != '\0'; length++)
+  {
+    if ((command[length] >= 'a') && (command[length] <= 'f'))
+    {
+      command[length] = (char)(command[length] - 'a' + 'A');
+    }
+  }
+  CHECK(ota_auth_check_command(command, KEY, &p_url, &p_md5));
+}
+
+static void test_rejected(void)
+{
+  char command[256];
+  const char *p_url;
+  const char *p_md5;
+
+  /* Plain URL and MD5 as before, without MAC */
+  strcpy(command, URL " " MD5);
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+
+  /* Other password */
+  make_command(command, URL " " MD5, "other password");
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+
+  /* URL and MD5 changed after signing */
+  make_command(command, URL " " MD5, KEY);
+  command[7] = '8';
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+  make_command(command, URL " " MD5, KEY);
+  command[strlen(URL) + 1] = 'f';
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+
+  /* Last digit of the MAC flipped, MAC truncated */
+  make_command(command, URL " " MD5, KEY);
+  command[strlen(command) - 1] ^= 0x01;
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+  make_command(command, URL " " MD5, KEY);
+  command[strlen(command) - 2] = '\0';
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+
+  /* Signed, but without MD5 nothing protects the download */
+  make_command(command, URL, KEY);
+  CHECK(!ota_auth_check_command(command, KEY, &p_url, &p_md5));
+
+  /* Updates over MQTT are disabled with an empty password */
+  make_command(command, URL " " MD5, "");
+  CHECK(!ota_auth_check_command(command, "", &p_url, &p_md5));
+}
+
+int main(void)
+{
+  test_rfc4231();
+  test_command();
+  test_rejected();
+
+  return check_summary("ota_auth_test");
+}
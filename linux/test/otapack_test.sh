@@ -0,0 +1,116 @@
+#!/bin/sh
+# Round trips of otapack: diff, apply and compare for identical, slightly
+# changed, shifted and unrelated images, also against a base with the flash
+# header rewritten like on the ESP. Truncated, corrupted and packages
+# for another base have to be rejected without writing an image.
+#
+# Usage: test/otapack_test.sh [otapack]
+
+OTAPACK=${1:-./otapack}
+SIZE=262144
+CHECKS=0
+FAILED=0
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+fail()
+{
+  echo "FAILED: $1"
+  FAILED=$((FAILED + 1))
+}
+
+# Writes count bytes of value at offset into file, without truncating it
+poke()
+{
+  printf "$(printf '\\%03o' "$3")" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+
+peek()
+{
+  od -An -tu1 -j "$2" -N1 "$1" | tr -d ' '
+}
+
+# name base target max_percent: package has to rebuild target and stay below max_percent of it
+round_trip()
+{
+  CHECKS=$((CHECKS + 1))
+  if ! "$OTAPACK" diff "$2" "$3" "$DIR/$1.hdp" > /dev/null; then
+    fail "$1: diff"
+    return
+  fi
+  rm -f "$DIR/$1.out"
+  if ! "$OTAPACK" apply "$2" "$DIR/$1.hdp" "$DIR/$1.out" || ! cmp -s "$3" "$DIR/$1.out"; then
+    fail "$1: apply"
+    return
+  fi
+  PACKAGE=$(wc -c < "$DIR/$1.hdp")
+  TARGET=$(wc -c < "$3")
+  if [ $((PACKAGE * 100)) -gt $((TARGET * $4 + 100)) ]; then
+    fail "$1: package has $PACKAGE bytes for $TARGET"
+  fi
+}
+
+# name base package: apply has to fail and must not leave an image
+rejected()
+{
+  CHECKS=$((CHECKS + 1))
+  rm -f "$DIR/rejected.out"
+  if "$OTAPACK" apply "$2" "$3" "$DIR/rejected.out" 2> /dev/null || [ -e "$DIR/rejected.out" ]; then
+    fail "$1: accepted"
+  fi
+}
+
+head -c $SIZE /dev/urandom > "$DIR/base.bin"
+head -c $((SIZE + 4096)) /dev/urandom > "$DIR/random.bin"
+
+cp "$DIR/base.bin" "$DIR/changed.bin"
+poke "$DIR/changed.bin" 16 0x00
+poke "$DIR/changed.bin" $((SIZE / 2)) 0x5A
+poke "$DIR/changed.bin" $((SIZE - 1)) 0xFF
+
+# Code inserted in the middle shifts everything behind it
+{ head -c $((SIZE / 3)) "$DIR/base.bin"; printf 'inserted function'; tail -c +$((SIZE / 3 + 1)) "$DIR/base.bin"; } > "$DIR/shifted.bin"
+head -c $((SIZE - 1000)) "$DIR/base.bin" > "$DIR/shrunk.bin"
+
+round_trip identical "$DIR/base.bin" "$DIR/base.bin" 1
+round_trip changed "$DIR/base.bin" "$DIR/changed.bin" 1
+round_trip shifted "$DIR/base.bin" "$DIR/shifted.bin" 1
+round_trip shrunk "$DIR/base.bin" "$DIR/shrunk.bin" 1
+round_trip random "$DIR/base.bin" "$DIR/random.bin" 102
+
+# esptool and Update write flash mode and size into bytes 2 and 3 of the
+# running sketch, a package built from the .bin has to apply to it
+cp "$DIR/base.bin" "$DIR/flashed.bin"
+poke "$DIR/flashed.bin" 2 $(($(peek "$DIR/base.bin" 2) ^ 0x03))
+poke "$DIR/flashed.bin" 3 $(($(peek "$DIR/base.bin" 3) ^ 0x40))
+CHECKS=$((CHECKS + 1))
+rm -f "$DIR/flashed.out"
+if ! "$OTAPACK" apply "$DIR/flashed.bin" "$DIR/changed.hdp" "$DIR/flashed.out" || ! cmp -s "$DIR/changed.bin" "$DIR/flashed.out"; then
+  fail "patched flash header: apply"
+fi
+
+PACKAGE="$DIR/changed.hdp"
+LENGTH=$(wc -c < "$PACKAGE")
+for CUT in 10 $((LENGTH / 2)) $((LENGTH - 1)); do
+  head -c "$CUT" "$PACKAGE" > "$DIR/truncated.hdp"
+  rejected "truncated to $CUT bytes" "$DIR/base.bin" "$DIR/truncated.hdp"
+done
+
+for OFFSET in 0 $((LENGTH / 2)) $((LENGTH - 1)); do
+  cp "$PACKAGE" "$DIR/corrupted.hdp"
+  poke "$DIR/corrupted.hdp" "$OFFSET" $(($(peek "$PACKAGE" "$OFFSET") ^ 0x01))
+  rejected "bit flipped at $OFFSET" "$DIR/base.bin" "$DIR/corrupted.hdp"
+done
+
+PACKAGE="$DIR/random.hdp"
+LENGTH=$(wc -c < "$PACKAGE")
+cp "$PACKAGE" "$DIR/corrupted.hdp"
+poke "$DIR/corrupted.hdp" $((LENGTH / 2)) $(($(peek "$PACKAGE" $((LENGTH / 2))) ^ 0x80))
+rejected "bit flipped in literal data" "$DIR/base.bin" "$DIR/corrupted.hdp"
+
+rejected "other base" "$DIR/changed.bin" "$DIR/changed.hdp"
+rejected "full image" "$DIR/base.bin" "$DIR/random.bin"
+
+echo "otapack_test: $CHECKS checks, $FAILED failed"
+[ $FAILED -eq 0 ]
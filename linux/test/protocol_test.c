@@ -0,0 +1,124 @@
+/*
+ * Checks the bus slave of pic16/hoermann_protocol.c, which the PIC and
+ * hoermannd share: scan and status responses, and that a response is only
+ * repeated for an unchanged repeated request.
+ */
+
+#include <string.h>
+#include "hoermann_protocol.h"
+#include "check.h"
+
+
+#define CMD_SLAVE_SCAN            0x01
+#define CMD_SLAVE_STATUS_REQUEST  0x20
+#define CMD_SLAVE_STATUS_RESPONSE 0x29
+
+#define RESPONSE_DEFAULT          0x1000
+#define RESPONSE_OPEN             0x1001
+#define RESPONSE_CLOSE            0x1002
+
+
+static uint8_t tx_buffer[HOERMANN_MAX_FRAME_LENGTH];
+static uint8_t delay;
+
+static uint8_t send_frame(hoermann_bus_t *p_bus, uint8_t counter, const uint8_t *p_data, uint8_t length)
+{
+  uint8_t frame[HOERMANN_MAX_FRAME_LENGTH];
+
+  frame[0] = HOERMANN_UAP1_ADDR;
+  frame[1] = (uint8_t)((counter << 4) | length);
+  memcpy(&frame[2], p_data, length);
+  frame[length + 2] = hoermann_crc8(frame, length + 2);
+  memset(tx_buffer, 0, sizeof(tx_buffer));
+  return hoermann_handle_frame(p_bus, frame, tx_buffer, &delay);
+}
+
+static uint16_t status_request(hoermann_bus_t *p_bus, uint8_t counter)
+{
+  const uint8_t request[] = { CMD_SLAVE_STATUS_REQUEST };
+
+  if(send_frame(p_bus, counter, request, sizeof(request)) != 6)
+  {
+    return 0xFFFF;
+  }
+  return (uint16_t)(tx_buffer[3] | (tx_buffer[4] << 8));
+}
+
+static void scan(hoermann_bus_t *p_bus, uint8_t counter)
+{
+  const uint8_t request[] = { CMD_SLAVE_SCAN, HOERMANN_MASTER_ADDR };
+
+  CHECK(send_frame(p_bus, counter, request, sizeof(request)) == 5);
+  CHECK((tx_buffer[2] == HOERMANN_UAP1_TYPE) && (tx_buffer[3] == HOERMANN_UAP1_ADDR));
+}
+
+static void setup(hoermann_bus_t *p_bus)
+{
+  hoermann_bus_init(p_bus);
+  CHECK(hoermann_add_slave(p_bus, HOERMANN_UAP1_ADDR, HOERMANN_UAP1_TYPE, HOERMANN_RESPONSE_DELAY));
+}
+
+static void test_status_response(void)
+{
+  hoermann_bus_t bus;
+
+  setup(&bus);
+  scan(&bus, 1);
+  CHECK(delay == HOERMANN_RESPONSE_DELAY);
+  CHECK(tx_buffer[1] == (0x02 | 0x20));
+  CHECK(hoermann_crc8(tx_buffer, 5) == 0x00);
+
+  CHECK(status_request(&bus, 2) == RESPONSE_DEFAULT);
+  CHECK((tx_buffer[0] == HOERMANN_MASTER_ADDR) && (tx_buffer[2] == CMD_SLAVE_STATUS_RESPONSE));
+  CHECK(hoermann_crc8(tx_buffer, 6) == 0x00);
+  hoermann_set_action(&bus, hoermann_action_open);
+  CHECK(status_request(&bus, 3) == RESPONSE_OPEN);
+  CHECK(status_request(&bus, 4) == RESPONSE_DEFAULT);
+}
+
+static void test_repeated_request(void)
+{
+  hoermann_bus_t bus;
+
+  /* The master missed the response, the action is sent again and not lost */
+  setup(&bus);
+  CHECK(status_request(&bus, 5) == RESPONSE_DEFAULT);
+  hoermann_set_action(&bus, hoermann_action_open);
+  CHECK(status_request(&bus, 6) == RESPONSE_OPEN);
+  CHECK(status_request(&bus, 6) == RESPONSE_OPEN);
+  CHECK(status_request(&bus, 7) == RESPONSE_DEFAULT);
+  CHECK(status_request(&bus, 7) == RESPONSE_DEFAULT);
+}
+
+static void test_different_request(void)
+{
+  hoermann_bus_t bus;
+  const uint8_t unknown[] = { 0x30, 0x00 };
+  const uint8_t long_request[] = { CMD_SLAVE_STATUS_REQUEST, 0x00, 0x00, 0x00 };
+
+  /* Same counter, but a scan in between: the status request is new */
+  setup(&bus);
+  hoermann_set_action(&bus, hoermann_action_open);
+  CHECK(status_request(&bus, 6) == RESPONSE_OPEN);
+  scan(&bus, 6);
+  hoermann_set_action(&bus, hoermann_action_close);
+  CHECK(status_request(&bus, 6) == RESPONSE_CLOSE);
+
+  /* A request which isn't answered counts as well */
+  hoermann_set_action(&bus, hoermann_action_open);
+  CHECK(send_frame(&bus, 6, unknown, sizeof(unknown)) == 0);
+  CHECK(status_request(&bus, 6) == RESPONSE_OPEN);
+
+  /* Requests longer than the stored bytes never match */
+  CHECK(send_frame(&bus, 6, long_request, sizeof(long_request)) == 0);
+  CHECK(status_request(&bus, 6) == RESPONSE_DEFAULT);
+}
+
+int main(void)
+{
+  test_status_response();
+  test_repeated_request();
+  test_different_request();
+
+  return check_summary("protocol_test");
+}
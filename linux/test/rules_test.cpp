@@ -0,0 +1,251 @@
+/*
+ * Runs rule sets of esp8266/rules.cpp against simulated door state streams.
+ * The door task feeds the engine every 5 ms and the rules task runs it once
+ * per second, like on the ESP. Actions are taken from the frames the driver
+ * sends to the PIC.
+ */
+
+#include <time.h>
+#include "Arduino.h"
+#include "hoermann_driver.h"
+#include "rules.h"
+#include "check.h"
+
+#define DOOR_TASK_PERIOD    5
+#define RULES_TASK_PERIOD   1000
+#define MAX_ACTIONS         16
+
+uint32_t host_millis = 0;
+
+typedef struct
+{
+  uint32_t time;        // ms
+  hoermann_state_t state;
+} state_event_t;
+
+typedef struct
+{
+  uint32_t time;
+  hoermann_action_t action;
+} action_event_t;
+
+/* Collects the action frames of the driver */
+class PicStream
+{
+  public:
+    action_event_t actions[MAX_ACTIONS];
+    uint8_t count;
+
+    PicStream() : count(0) {}
+
+    int available()
+    {
+      return 0;
+    }
+
+    int read()
+    {
+      return -1;
+    }
+
+    size_t write(const uint8_t *p_data, size_t length)
+    {
+      if ((length == 5) && (p_data[1] == HoermannFrame::cmd_action) && (count < MAX_ACTIONS))
+      {
+        actions[count].time = host_millis;
+        actions[count].action = (hoermann_action_t)p_data[3];
+        count++;
+      }
+      return length;
+    }
+};
+
+typedef HoermannDriver<PicStream, AdditiveChecksum, 15> PicDriver;
+
+static hoermann_state_t make_state(cover_state_t cover, bool venting, bool light)
+{
+  hoermann_state_t state;
+
+  state.cover = cover;
+  state.venting = venting;
+  state.light = light;
+  state.error = false;
+  state.prewarn = false;
+  state.option_relay = false;
+  state.data_valid = true;
+  return state;
+}
+
+/* Replays the events until end_time, returns the number of actions sent */
+static uint8_t simulate(const char *rules, const state_event_t *events, size_t event_count, uint32_t end_time, PicStream *pic)
+{
+  HoermannDoor door;
+  PicDriver driver(pic, &door);
+  RuleEngine engine(&door);
+  hoermann_state_t state;
+  size_t next = 0;
+
+  state.data_valid = false;
+  host_millis = 0;
+  CHECK(engine.load(rules));
+
+  for (host_millis = 0; host_millis <= end_time; host_millis += DOOR_TASK_PERIOD)
+  {
+    while ((next < event_count) && (events[next].time <= host_millis))
+    {
+      state = events[next].state;
+      next++;
+    }
+    engine.update(state);
+    if ((host_millis % RULES_TASK_PERIOD) == 0)
+    {
+      engine.run();
+    }
+    driver.loop();
+  }
+
+  return pic->count;
+}
+
+static void test_load(void)
+{
+  HoermannDoor door;
+  RuleEngine engine(&door);
+
+  CHECK(engine.load("venting for 600 do close; opening & !light do toggle_light"));
+  CHECK(engine.get_rule_count() == 2);
+  CHECK(engine.get_error_rule() == -1);
+
+  // Empty rules and newlines as separator
+  CHECK(engine.load(";\nopen do close;;  \n"));
+  CHECK(engine.get_rule_count() == 1);
+
+  // Errors name the rule and keep the previous set
+  CHECK(!engine.load("open do close; open do jump"));
+  CHECK(engine.get_error_rule() == 1);
+  CHECK(engine.get_rule_count() == 1);
+  CHECK(!engine.load("do close"));
+  CHECK(engine.get_error_rule() == 0);
+  CHECK(!engine.load("open do close now"));
+  CHECK(!engine.load("open for 70000 do close"));
+  CHECK(!engine.load("open for x do close"));
+  CHECK(!engine.load("open between 22:00 do close"));
+  CHECK(!engine.load("open between 24:00-06:00 do close"));
+  CHECK(!engine.load("open"));
+  CHECK(!engine.load("open; open; open; open; open; open; open; open; open do close"));
+  CHECK(engine.get_rule_count() == 1);
+
+  engine.clear();
+  CHECK(engine.get_rule_count() == 0);
+}
+
+static void test_hold_time(void)
+{
+  // Venting for 10 minutes, the door is closed after 600 s
+  const state_event_t events[] = {
+    { 0, make_state(cover_closed, false, false) },
+    { 2000, make_state(cover_stopped, true, false) },
+    { 700000, make_state(cover_closed, false, false) }
+  };
+  PicStream pic;
+
+  CHECK(simulate("venting for 600 do close", events, 3, 800000, &pic) == 1);
+  CHECK(pic.actions[0].action == hoermann_action_close);
+  CHECK(pic.actions[0].time >= 602000);
+  CHECK(pic.actions[0].time <= 603000);
+}
+
+static void test_hold_interrupted(void)
+{
+  // Venting ends before the hold time, nothing happens
+  const state_event_t events[] = {
+    { 0, make_state(cover_stopped, true, false) },
+    { 300000, make_state(cover_closed, false, false) },
+    { 400000, make_state(cover_stopped, true, false) }
+  };
+  PicStream pic;
+
+  CHECK(simulate("venting for 600 do close", events, 3, 900000, &pic) == 0);
+}
+
+static void test_transition(void)
+{
+  // Fired on the transition, not with the next run of the rules task
+  const state_event_t events[] = {
+    { 0, make_state(cover_closed, false, false) },
+    { 1502, make_state(cover_opening, false, false) },
+    { 20000, make_state(cover_open, false, true) },
+    { 30000, make_state(cover_closing, false, true) },
+    { 40000, make_state(cover_opening, false, true) }
+  };
+  PicStream pic;
+
+  CHECK(simulate("opening & !light do toggle_light", events, 5, 60000, &pic) == 1);
+  CHECK(pic.actions[0].action == hoermann_action_toggle_light);
+  CHECK(pic.actions[0].time == 1505);
+}
+
+static void test_rearm(void)
+{
+  // Every new match fires again, a lasting match only once
+  const state_event_t events[] = {
+    { 0, make_state(cover_open, false, false) },
+    { 10000, make_state(cover_closing, false, false) },
+    { 20000, make_state(cover_open, false, false) }
+  };
+  PicStream pic;
+
+  CHECK(simulate("open for 5 do close", events, 3, 60000, &pic) == 2);
+  CHECK(pic.actions[0].time == 5000);
+  CHECK(pic.actions[1].time == 25000);
+}
+
+static void test_invalid_state(void)
+{
+  // Without a status from the PIC nothing matches, not even negated conditions
+  const state_event_t events[] = {
+    { 0, { cover_stopped, false, false, false, false, false, false } }
+  };
+  PicStream pic;
+
+  CHECK(simulate("!open do close", events, 1, 10000, &pic) == 0);
+}
+
+static void test_window(void)
+{
+  char rules[80];
+  const state_event_t events[] = {
+    { 0, make_state(cover_open, false, false) }
+  };
+  struct tm local;
+  time_t now;
+  int minute;
+  PicStream inside;
+  PicStream outside;
+
+  // Time windows use the real clock of the host, one around now and one far from it
+  now = time(NULL);
+  localtime_r(&now, &local);
+  minute = local.tm_hour * 60 + local.tm_min;
+
+  snprintf(rules, sizeof(rules), "open between %02d:%02d-%02d:%02d do close",
+           ((minute + 1438) % 1440) / 60, ((minute + 1438) % 1440) % 60, ((minute + 3) % 1440) / 60, ((minute + 3) % 1440) % 60);
+  CHECK(simulate(rules, events, 1, 5000, &inside) == 1);
+
+  snprintf(rules, sizeof(rules), "open between %02d:%02d-%02d:%02d do close",
+           ((minute + 600) % 1440) / 60, ((minute + 600) % 1440) % 60, ((minute + 720) % 1440) / 60, ((minute + 720) % 1440) % 60);
+  CHECK(simulate(rules, events, 1, 5000, &outside) == 0);
+}
+
+int main(void)
+{
+  test_load();
+  test_hold_time();
+  test_hold_interrupted();
+  test_transition();
+  test_rearm();
+  test_invalid_state();
+  test_window();
+
+  return check_summary("rules_test");
+}
@@ -0,0 +1,281 @@
+/*
+ * Runs esp8266/warm_start.cpp against a simulated RTC memory. A restart is a
+ * new WarmStart on the same memory, a power cycle fills it with random data.
+ */
+
+#include "Arduino.h"
+#include "warm_start.h"
+#include "check.h"
+
+#define RTC_SIZE          512
+#define OTA_RESERVED      128   // eboot command and the rest of the blocks of the core
+
+uint32_t host_millis = 0;
+
+class HostRtcStorage : public RtcStorage
+{
+  public:
+    uint8_t memory[RTC_SIZE];
+    unsigned int writes;
+
+    HostRtcStorage() : writes(0)
+    {
+      power_cycle();
+    }
+
+    void power_cycle()
+    {
+      for (size_t i = 0; i < sizeof(memory); i++)
+      {
+        memory[i] = (uint8_t)rand();
+      }
+    }
+
+    bool read(uint32_t offset, uint32_t *data, size_t size) override
+    {
+      if (((offset % 4) != 0) || ((size % 4) != 0) || ((offset + size) > sizeof(memory)))
+      {
+        return false;
+      }
+      memcpy(data, &memory[offset], size);
+      return true;
+    }
+
+    bool write(uint32_t offset, uint32_t *data, size_t size) override
+    {
+      if (((offset % 4) != 0) || ((size % 4) != 0) || ((offset + size) > sizeof(memory)))
+      {
+        return false;
+      }
+      memcpy(&memory[offset], data, size);
+      writes++;
+      return true;
+    }
+};
+
+static hoermann_state_t make_state(cover_state_t cover, bool venting, bool light)
+{
+  hoermann_state_t state;
+
+  state.cover = cover;
+  state.venting = venting;
+  state.light = light;
+  state.error = false;
+  state.prewarn = false;
+  state.option_relay = false;
+  state.data_valid = true;
+  return state;
+}
+
+/* Status frame of the PIC as the driver hands it to the door */
+static void receive_status(HoermannDoor *door, uint8_t status)
+{
+  uint8_t frame[HoermannFrame::overhead + HoermannFrame::status_length];
+
+  frame[0] = HoermannFrame::sync_byte;
+  frame[HoermannFrame::offset_cmd] = HoermannFrame::cmd_status;
+  frame[HoermannFrame::offset_length] = HoermannFrame::status_length;
+  frame[HoermannFrame::offset_data] = status;
+  frame[HoermannFrame::offset_data + 1] = 0x00;
+  frame[HoermannFrame::offset_data + 2] = AdditiveChecksum::calc(frame, HoermannFrame::offset_data + 2);
+  door->handle_frame(frame);
+}
+
+static void test_power_up(void)
+{
+  HostRtcStorage rtc;
+  WarmStart warm_start(&rtc);
+  hoermann_state_t state;
+  uint8_t bssid[6];
+  uint8_t channel;
+
+  CHECK(!warm_start.restore());
+  CHECK(!warm_start.is_restored());
+  CHECK(!warm_start.get_door_state(0, &state));
+  CHECK(!warm_start.get_wifi(bssid, &channel));
+  CHECK(!warm_start.get_mqtt_session());
+}
+
+static void test_restart(void)
+{
+  const uint8_t ap[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+  HostRtcStorage rtc;
+  WarmStart before(&rtc);
+  WarmStart after(&rtc);
+  hoermann_state_t state;
+  uint8_t bssid[6];
+  uint8_t channel;
+
+  before.restore();
+  before.set_door_state(0, make_state(cover_open, false, true));
+  before.set_door_state(2, make_state(cover_stopped, true, false));
+  before.set_wifi(ap, 11);
+  before.set_mqtt_session(true);
+  CHECK(before.save());
+
+  CHECK(after.restore());
+  CHECK(after.is_restored());
+  CHECK(after.get_door_state(0, &state));
+  CHECK((state.cover == cover_open) && state.light && !state.venting);
+  CHECK(!after.get_door_state(1, &state));
+  CHECK(after.get_door_state(2, &state));
+  CHECK((state.cover == cover_stopped) && state.venting);
+  CHECK(after.get_wifi(bssid, &channel));
+  CHECK((channel == 11) && (memcmp(bssid, ap, sizeof(ap)) == 0));
+  CHECK(after.get_mqtt_session());
+
+  // Out of range doors are ignored
+  after.set_door_state(WARM_START_MAX_DOORS, make_state(cover_open, false, false));
+  CHECK(!after.get_door_state(WARM_START_MAX_DOORS, &state));
+
+  // A power cycle destroys it
+  rtc.power_cycle();
+  CHECK(!after.restore());
+  CHECK(!after.get_door_state(0, &state));
+}
+
+static void test_published(void)
+{
+  HostRtcStorage rtc;
+  WarmStart before(&rtc);
+  WarmStart after(&rtc);
+  hoermann_state_t state;
+
+  // Door closed while the broker was unreachable, the broker still retains open
+  before.restore();
+  before.set_published_state(0, make_state(cover_open, false, false));
+  before.set_door_state(0, make_state(cover_closed, false, false));
+  CHECK(before.save());
+
+  CHECK(after.restore());
+  CHECK(after.get_published_state(0, &state));
+  CHECK(state.cover == cover_open);
+  CHECK(after.get_door_state(0, &state));
+  CHECK(state.cover == cover_closed);
+
+  // Nothing published yet for the other doors, everything is sent
+  CHECK(!after.get_published_state(1, &state));
+  CHECK(!after.get_published_state(WARM_START_MAX_DOORS, &state));
+  state.data_valid = false;
+  after.set_published_state(0, state);
+  CHECK(after.save());
+  CHECK(before.restore());
+  CHECK(!before.get_published_state(0, &state));
+}
+
+static void test_ota_blocks(void)
+{
+  uint8_t reserved[OTA_RESERVED];
+  HostRtcStorage rtc;
+  WarmStart before(&rtc);
+  WarmStart after(&rtc);
+  hoermann_state_t state;
+
+  // Saving leaves the blocks of the eboot command alone
+  memcpy(reserved, rtc.memory, sizeof(reserved));
+  before.restore();
+  before.set_door_state(0, make_state(cover_closed, false, false));
+  CHECK(before.save());
+  CHECK(memcmp(reserved, rtc.memory, sizeof(reserved)) == 0);
+
+  // Update.end() writing the eboot command doesn't destroy the snapshot
+  memset(rtc.memory, 0xA5, OTA_RESERVED);
+  CHECK(after.restore());
+  CHECK(after.get_door_state(0, &state));
+  CHECK(state.cover == cover_closed);
+}
+
+static void test_dirty(void)
+{
+  HostRtcStorage rtc;
+  WarmStart warm_start(&rtc);
+  unsigned int writes;
+
+  warm_start.restore();
+  CHECK(warm_start.save());
+  writes = rtc.writes;
+
+  // The door task saves every 5 ms, only changes are written
+  warm_start.set_door_state(0, make_state(cover_closed, false, false));
+  CHECK(warm_start.save());
+  CHECK(warm_start.save());
+  CHECK(rtc.writes == (writes + 1));
+  warm_start.set_door_state(0, make_state(cover_closed, false, false));
+  warm_start.set_mqtt_session(false);
+  warm_start.clear_wifi();
+  CHECK(warm_start.save());
+  CHECK(rtc.writes == (writes + 1));
+  warm_start.set_mqtt_session(true);
+  CHECK(warm_start.save());
+  CHECK(rtc.writes == (writes + 2));
+}
+
+static void test_corruption(void)
+{
+  HostRtcStorage rtc;
+  WarmStart before(&rtc);
+  WarmStart after(&rtc);
+  hoermann_state_t state;
+
+  before.restore();
+  before.set_door_state(0, make_state(cover_open, false, false));
+  before.set_mqtt_session(true);
+  CHECK(before.save());
+
+  // One flipped bit and nothing of it is used
+  rtc.memory[WARM_START_OFFSET + sizeof(warm_start_snapshot_t) - 8] ^= 0x01;
+  CHECK(!after.restore());
+  CHECK(!after.get_door_state(0, &state));
+  CHECK(!after.get_mqtt_session());
+
+  // Invalidated snapshots restore empty
+  CHECK(before.save());
+  before.invalidate();
+  CHECK(after.restore());
+  CHECK(!after.get_door_state(0, &state));
+  CHECK(!after.get_mqtt_session());
+}
+
+static void test_restore_door(void)
+{
+  HostRtcStorage rtc;
+  WarmStart before(&rtc);
+  WarmStart after(&rtc);
+  hoermann_state_t state;
+  HoermannDoor door;
+
+  before.restore();
+  before.set_door_state(0, make_state(cover_open, false, true));
+  CHECK(before.save());
+
+  // Like restore_door_states(), the state is valid before the PIC reported it
+  CHECK(after.restore());
+  CHECK(after.get_door_state(0, &state));
+  door.restore_state(state);
+  CHECK(door.get_state().data_valid);
+  CHECK(door.get_state().cover == cover_open);
+  CHECK(!door.has_status());
+
+  // The first status replaces it and a later restore doesn't override the PIC
+  receive_status(&door, 0x02);
+  CHECK(door.has_status());
+  CHECK(door.get_state().cover == cover_closed);
+  CHECK(!door.get_state().light);
+  door.restore_state(state);
+  CHECK(door.get_state().cover == cover_closed);
+}
+
+int main(void)
+{
+  srand(1);
+
+  test_power_up();
+  test_restart();
+  test_published();
+  test_ota_blocks();
+  test_dirty();
+  test_corruption();
+  test_restore_door();
+
+  return check_summary("warm_start_test");
+}
@@ -3,12 +3,18 @@
 #include <stdbool.h>
 #include "sysconfig.h"
 #include "hoermann.h"
+#include "power.h"
+#include "supervisor.h"
 
 
 #define RS232_BRGVAL          (uint16_t)(((float)FCY/(4.0 * (float)RS232_BAUDRATE))-0.5)
 
 #define SYNC_BYTE             0x55
 #define STATUS_SEND_INTERVAL  5000
+#define DIAGNOSTICS_SEND_TIME (STATUS_SEND_INTERVAL / 2)  /* Between two status messages */
+
+#define CMD_STATUS            0x00
+#define CMD_DIAGNOSTICS       0x02
 
 
 static uint8_t rx_buffer[15+3] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
@@ -83,30 +89,63 @@ static void parse_message(void)
 }
 
 
+static void start_sending(uint8_t length)
+{
+  tx_buffer[length] = calc_checksum(tx_buffer, length);
+  tx_length = length + 1;
+  
+  /* Start with Syncbyte */
+  tx_counter = 0;
+  TX2REG = SYNC_BYTE;
+
+  /* Activate transmit interrupt */
+  TX2IE = 1;
+}
+
+
 static void send_status(void)
 {
   uint16_t broadcast;
   broadcast = hoermann_get_broadcast();
   
-  tx_buffer[0] = 0x00;
+  tx_buffer[0] = CMD_STATUS;
   tx_buffer[1] = 0x02;
   tx_buffer[2] = (uint8_t)broadcast;
   tx_buffer[3] = (uint8_t)(broadcast>>8);
-  tx_buffer[4] = calc_checksum(tx_buffer, 4);
-  tx_length = 5;
-  
-  /* Start with Syncbyte */
-  tx_counter = 0;
-  TX2REG = SYNC_BYTE;
+  start_sending(4);
+}
 
-  /* Activate transmit interrupt */
-  TX2IE = 1;
+
+static void send_diagnostics(void)
+{
+  supervisor_report_t report;
+  supervisor_get_report(&report);
+  
+  tx_buffer[0] = CMD_DIAGNOSTICS;
+  tx_buffer[1] = 0x0F;
+  tx_buffer[2] = power_get_active_percent();
+  tx_buffer[3] = (uint8_t)report.level;
+  tx_buffer[4] = (uint8_t)report.master_age;
+  tx_buffer[5] = (uint8_t)(report.master_age>>8);
+  tx_buffer[6] = (uint8_t)report.response_age;
+  tx_buffer[7] = (uint8_t)(report.response_age>>8);
+  tx_buffer[8] = report.receiver_resets;
+  tx_buffer[9] = report.uart_reinits;
+  tx_buffer[10] = report.watchdog_resets;
+  tx_buffer[11] = report.overruns;
+  tx_buffer[12] = report.recoveries;
+  tx_buffer[13] = (uint8_t)report.mean_recovery_time;
+  tx_buffer[14] = (uint8_t)(report.mean_recovery_time>>8);
+  tx_buffer[15] = hoermann_get_rejected_slaves();
+  tx_buffer[16] = report.stray_bytes;
+  start_sending(17);
 }
 
 
-void esp_interface_run(void)
+void esp_interface_run(uint8_t ms)
 {
   static uint16_t ms_counter = 0;
+  uint16_t previous;
   
   if(rx_message_ready)
   {
@@ -114,15 +153,26 @@ void esp_interface_run(void)
     rx_message_ready = false;
   }  
 
-  ms_counter++;
-  if(ms_counter == STATUS_SEND_INTERVAL)
+  previous = ms_counter;
+  ms_counter += ms;
+  if((previous < DIAGNOSTICS_SEND_TIME) && (ms_counter >= DIAGNOSTICS_SEND_TIME))
+  {
+    send_diagnostics();
+  }
+  if(ms_counter >= STATUS_SEND_INTERVAL)
   {
-    ms_counter = 0;
+    ms_counter -= STATUS_SEND_INTERVAL;
     send_status();
   }
 }
 
 
+bool esp_interface_message_pending(void)
+{
+  return rx_message_ready;
+}
+
+
 void esp_rx_isr(void)
 {
   static int8_t counter = -1;
@@ -1,6 +1,7 @@
 
 
 extern void esp_interface_init(void);
-extern void esp_interface_run(void);
+extern void esp_interface_run(uint8_t ms);
+extern bool esp_interface_message_pending(void);
 extern void esp_rx_isr(void);
 extern void esp_tx_isr(void);
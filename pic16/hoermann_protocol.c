@@ -0,0 +1,269 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "hoermann_protocol.h"
+
+
+#define BROADCAST_ADDR            0x00
+#define MIN_SLAVE_ADDR            0x10
+#define MAX_SLAVE_ADDR            0x90
+
+#define CMD_SLAVE_SCAN            0x01
+#define CMD_SLAVE_STATUS_REQUEST  0x20
+#define CMD_SLAVE_STATUS_RESPONSE 0x29
+
+#define RESPONSE_DEFAULT          0x1000
+#define RESPONSE_EMERGENCY_STOP   0x0000
+#define RESPONSE_OPEN             0x1001
+#define RESPONSE_CLOSE            0x1002
+#define RESPONSE_VENTING          0x1010
+#define RESPONSE_TOGGLE_LIGHT     0x1008
+#define RESPONSE_IMPULSE          0x1004
+
+#define NO_REQUEST                0xFF  /* LEN of a request with 15 data bytes, which is never stored */
+
+/* CRC table for polynomial 0x07 */
+const uint8_t hoermann_crc_table[256] = {
+  0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+  0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+  0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+  0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+  0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+  0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+  0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+  0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+  0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+  0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+  0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+  0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+  0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+  0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+  0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+  0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3
+};
+
+
+void hoermann_bus_init(hoermann_bus_t *p_bus)
+{
+  uint8_t i;
+  
+  p_bus->slave_count = 0;
+  p_bus->broadcast_status = 0;
+  for(i = 0; i < HOERMANN_SLAVE_LOOKUP_SIZE; i++)
+  {
+    p_bus->lookup[i] = 0;
+  }
+}
+
+
+/* Registers a virtual slave. The first slave receives the actions. Fails if
+ * the registry is full or the lookup slot of the address is taken. */
+bool hoermann_add_slave(hoermann_bus_t *p_bus, uint8_t address, uint8_t type, uint8_t response_delay)
+{
+  hoermann_slave_t *p_slave;
+  uint8_t slot;
+  
+  slot = address & (HOERMANN_SLAVE_LOOKUP_SIZE - 1);
+  if((p_bus->slave_count >= HOERMANN_MAX_SLAVES) || (p_bus->lookup[slot] != 0) ||
+     (address < MIN_SLAVE_ADDR) || (address > MAX_SLAVE_ADDR))
+  {
+    return false;
+  }
+  
+  p_slave = &p_bus->slaves[p_bus->slave_count];
+  p_slave->address = address;
+  p_slave->type = type;
+  p_slave->response_delay = response_delay;
+  p_slave->last_request[0] = NO_REQUEST;
+  p_slave->response_data = RESPONSE_DEFAULT;
+  p_slave->last_response = RESPONSE_DEFAULT;
+  
+  p_bus->slave_count++;
+  p_bus->lookup[slot] = p_bus->slave_count;
+  return true;
+}
+
+
+static hoermann_slave_t *find_slave(hoermann_bus_t *p_bus, uint8_t address)
+{
+  uint8_t index;
+  
+  /* Direct mapped, one compare independent of the number of slaves */
+  index = p_bus->lookup[address & (HOERMANN_SLAVE_LOOKUP_SIZE - 1)];
+  if((index == 0) || (p_bus->slaves[index - 1].address != address))
+  {
+    return 0;
+  }
+  return &p_bus->slaves[index - 1];
+}
+
+
+/* Compares the request with the previous one to the slave and stores it.
+ * The master repeats a request with the same counter and the same bytes if
+ * it missed the response. A different request, e.g. a scan in between or
+ * after a restart of the master, is new even if the counter matches. */
+static bool is_repeated_request(hoermann_slave_t *p_slave, const uint8_t *p_rx)
+{
+  uint8_t length;
+  uint8_t i;
+  bool repeated = true;
+  
+  length = (p_rx[1] & 0x0F) + 1;  /* LEN + data */
+  if(length > HOERMANN_REQUEST_SIZE)
+  {
+    p_slave->last_request[0] = NO_REQUEST;
+    return false;
+  }
+  for(i = 0; i < length; i++)
+  {
+    if(p_rx[1 + i] != p_slave->last_request[i])
+    {
+      repeated = false;
+      p_slave->last_request[i] = p_rx[1 + i];
+    }
+  }
+  return repeated;
+}
+
+
+uint8_t hoermann_crc8(const uint8_t *p_data, uint8_t length)
+{
+  uint8_t i;
+  uint8_t data;
+  uint8_t crc = HOERMANN_CRC8_INITIAL_VALUE;
+  
+  for(i = 0; i < length; i++)
+  {
+    /* XOR-in next input byte */
+    data = *p_data ^ crc;
+    p_data++;
+    /* get current CRC value = remainder */
+    crc = hoermann_crc_table[data];
+  }
+  
+  return crc;
+}
+
+
+uint8_t hoermann_frame_length(uint8_t length_byte)
+{
+  return (length_byte & 0x0F) + 3; /* 3 = ADR + LEN + CRC */
+}
+
+
+/* Processes a complete frame with valid CRC. Returns the length of the
+ * response written to p_tx, 0 if no response has to be sent. p_delay is set
+ * to the time in ms the response has to be delayed. */
+uint8_t hoermann_handle_frame(hoermann_bus_t *p_bus, const uint8_t *p_rx, uint8_t *p_tx, uint8_t *p_delay)
+{
+  hoermann_slave_t *p_slave;
+  uint8_t length;
+  uint8_t counter;
+  bool repeated;
+  
+  length = p_rx[1] & 0x0F;
+  counter = (p_rx[1] & 0xF0) + 0x10;
+  
+  if(p_rx[0] == BROADCAST_ADDR)
+  {
+    if(length == 0x02)
+    {
+      p_bus->broadcast_status = p_rx[2];
+      p_bus->broadcast_status |= (uint16_t)p_rx[3] << 8;
+    }
+    return 0;
+  }
+  
+  p_slave = find_slave(p_bus, p_rx[0]);
+  if(p_slave == 0)
+  {
+    return 0;
+  }
+  *p_delay = p_slave->response_delay;
+  repeated = is_repeated_request(p_slave, p_rx);
+  
+  /* Bus scan command? */
+  if((length == 0x02) && (p_rx[2] == CMD_SLAVE_SCAN))
+  {
+    p_tx[0] = HOERMANN_MASTER_ADDR;
+    p_tx[1] = 0x02 | counter;
+    p_tx[2] = p_slave->type;
+    p_tx[3] = p_slave->address;
+    p_tx[4] = hoermann_crc8(p_tx, 4);
+    return 5;
+  }
+  /* Slave status request command? */
+  if((length == 0x01) && (p_rx[2] == CMD_SLAVE_STATUS_REQUEST))
+  {
+    /* A repeated request means the master missed our response, so the
+     * same response is sent again instead of losing a pending action */
+    if(!repeated)
+    {
+      p_slave->last_response = p_slave->response_data;
+      p_slave->response_data = RESPONSE_DEFAULT;
+    }
+    p_tx[0] = HOERMANN_MASTER_ADDR;
+    p_tx[1] = 0x03 | counter;
+    p_tx[2] = CMD_SLAVE_STATUS_RESPONSE;
+    p_tx[3] = (uint8_t)p_slave->last_response;
+    p_tx[4] = (uint8_t)(p_slave->last_response>>8);
+    p_tx[5] = hoermann_crc8(p_tx, 5);
+    return 6;
+  }
+  
+  return 0;
+}
+
+
+void hoermann_set_action(hoermann_bus_t *p_bus, hoermann_action_t action)
+{
+  hoermann_slave_t *p_slave;
+  
+  if(p_bus->slave_count == 0)
+  {
+    return;
+  }
+  p_slave = &p_bus->slaves[0];
+  
+  switch(action)
+  {
+    case hoermann_action_stop:
+    {
+      /* Motor needs only to be stopped if it is running */
+      if (((p_bus->broadcast_status & 0x60) == 0x40) || ((p_bus->broadcast_status & 0x60) == 0x60))
+      {
+        p_slave->response_data = RESPONSE_IMPULSE;
+      }
+      break;
+    }
+    case hoermann_action_open:
+    {
+      p_slave->response_data = RESPONSE_OPEN;
+      break;
+    }
+    case hoermann_action_close:
+    {
+      p_slave->response_data = RESPONSE_CLOSE;
+      break;
+    }
+    case hoermann_action_venting:
+    {
+      p_slave->response_data = RESPONSE_VENTING;
+      break;
+    }
+    case hoermann_action_toggle_light:
+    {
+      p_slave->response_data = RESPONSE_TOGGLE_LIGHT;
+      break;
+    }
+    case hoermann_action_emergency_stop:
+    {
+      p_slave->response_data = RESPONSE_EMERGENCY_STOP;
+      break;
+    }
+    case hoermann_action_impulse:
+    {
+      p_slave->response_data = RESPONSE_IMPULSE;
+      break;
+    }
+  }
+}
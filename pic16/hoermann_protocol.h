@@ -0,0 +1,62 @@
+#ifndef HOERMANN_PROTOCOL_H
+#define HOERMANN_PROTOCOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Hardware independent part of the Hoermann bus slave. Used by the PIC and
+ * by the Linux gateway daemon. */
+
+#define HOERMANN_MAX_FRAME_LENGTH   (15+3)  /* ADR + LEN + 15 data bytes + CRC */
+#define HOERMANN_RESPONSE_DELAY     3       /* ms between end of request and start of response */
+#define HOERMANN_CRC8_INITIAL_VALUE 0xF3
+
+#define HOERMANN_MASTER_ADDR        0x80
+#define HOERMANN_UAP1_ADDR          0x28
+#define HOERMANN_UAP1_TYPE          0x14
+
+#ifndef HOERMANN_MAX_SLAVES
+#define HOERMANN_MAX_SLAVES         4       /* Virtual slaves per bus */
+#endif
+#define HOERMANN_SLAVE_LOOKUP_SIZE  16      /* Power of two, addresses must differ in the lower 4 bits */
+#define HOERMANN_REQUEST_SIZE       3       /* LEN + data of the longest request a slave answers (scan) */
+
+typedef enum
+{
+  hoermann_action_stop = 0,
+  hoermann_action_open = 1,
+  hoermann_action_close = 2,
+  hoermann_action_venting = 3,
+  hoermann_action_toggle_light = 4,
+  hoermann_action_emergency_stop = 5,
+  hoermann_action_impulse = 6
+} hoermann_action_t;
+
+typedef struct
+{
+  uint8_t address;
+  uint8_t type;
+  uint8_t response_delay;   /* ms */
+  uint8_t last_request[HOERMANN_REQUEST_SIZE];  /* LEN (with counter) and data of the last request, LEN 0xFF = none */
+  uint16_t response_data;   /* Sent with the next status request */
+  uint16_t last_response;   /* Repeated if the master repeats a request */
+} hoermann_slave_t;
+
+typedef struct
+{
+  hoermann_slave_t slaves[HOERMANN_MAX_SLAVES];
+  uint8_t slave_count;
+  uint8_t lookup[HOERMANN_SLAVE_LOOKUP_SIZE];  /* Index + 1 of the slave, 0 = free */
+  uint16_t broadcast_status;
+} hoermann_bus_t;
+
+extern const uint8_t hoermann_crc_table[256];
+
+extern void hoermann_bus_init(hoermann_bus_t *p_bus);
+extern bool hoermann_add_slave(hoermann_bus_t *p_bus, uint8_t address, uint8_t type, uint8_t response_delay);
+extern uint8_t hoermann_crc8(const uint8_t *p_data, uint8_t length);
+extern uint8_t hoermann_frame_length(uint8_t length_byte);
+extern uint8_t hoermann_handle_frame(hoermann_bus_t *p_bus, const uint8_t *p_rx, uint8_t *p_tx, uint8_t *p_delay);
+extern void hoermann_set_action(hoermann_bus_t *p_bus, hoermann_action_t action);
+
+#endif
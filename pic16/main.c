@@ -44,6 +44,13 @@
 #include "sysconfig.h"
 #include "hoermann.h"
 #include "esp_interface.h"
+#include "power.h"
+
+
+#define MAX_WAKEUPS_WITHOUT_TICK  200
+#define TASK_PERIOD               10    /* ms the periodic work is deferred while no frame is handled */
+
+static volatile uint8_t pending_ticks = 0;
 
 
 static void pins_init(void)
@@ -100,26 +107,88 @@ static void timer_init(void)
   /*         '--------- T0EN - The module is enabled and operating */
 }
 
+/* Has to be called with GIE = 0 */
+static bool tasks_due(uint8_t ticks)
+{
+  if(hoermann_message_pending() || esp_interface_message_pending())
+  {
+    /* Received frames are handled at once, not on the next tick */
+    return true;
+  }
+  if(ticks == 0)
+  {
+    return false;
+  }
+  /* The response delay and the transmission need every tick, the timeouts
+   * and intervals only the elapsed time */
+  return hoermann_is_busy() || (ticks >= TASK_PERIOD);
+}
+
 int main(void)
 {
+  uint8_t wakeups = 0;
+  uint8_t ticks;
+  bool due;
+  
   pins_init();
   timer_init();
   hoermann_init();
   esp_interface_init();
+  power_init();
   
-   /* Enable interrupts */
+   /* Enable interrupts, Timer0 wakes the CPU every 1ms */
+  TMR0IE = 1;
   PEIE = 1;
   GIE = 1;
   
   while(1)
   {
-    if(TMR0IF == 1)
+    GIE = 0;
+    ticks = pending_ticks;
+    due = tasks_due(ticks);
+    if(due)
     {
-      /* 1ms Task */
-      TMR0IF = 0;
-      CLRWDT();
-      hoermann_run();
-      esp_interface_run();
+      pending_ticks = 0;
+    }
+    else
+    {
+      /* Nothing to do, bytes are handled completely by the UART interrupts.
+       * A tick only counts, the ISR is all the CPU runs for it. */
+      power_idle();
+      if(STATUSbits.nTO == 0)
+      {
+        /* Woken by the watchdog instead of Timer0 */
+        RESET();
+      }
+    }
+    GIE = 1;
+    
+    if(due)
+    {
+      if(ticks > 0)
+      {
+        wakeups = 0;
+        /* Only cleared if the timer is alive and the tasks are running.
+         * SLEEP clears the watchdog too, so a hanging task is still detected,
+         * a stopped timer is checked below. */
+        CLRWDT();
+      }
+      hoermann_run(ticks);
+      esp_interface_run(ticks);
+      power_tick(ticks);
+    }
+    else if(pending_ticks != ticks)
+    {
+      wakeups = 0;
+    }
+    else
+    {
+      wakeups++;
+      if(wakeups > MAX_WAKEUPS_WITHOUT_TICK)
+      {
+        /* UART interrupts keep waking the CPU, but Timer0 stopped */
+        RESET();
+      }
     }
   }
   
@@ -128,6 +197,11 @@ int main(void)
 
 void __interrupt() isr(void)
 {
+  if(TMR0IF == 1)
+  {
+    TMR0IF = 0;
+    pending_ticks++;
+  }
   if(RC1IF == 1)
   {
     hoermann_rx_isr();
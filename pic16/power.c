@@ -0,0 +1,74 @@
+#include <xc.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sysconfig.h"
+#include "power.h"
+
+
+#define MEASUREMENT_TICKS     1000  /* Active time is evaluated once per second */
+
+
+static uint32_t idle_counts = 0;
+static uint16_t tick_counter = 0;
+static uint8_t active_percent = 100;
+
+
+void power_init(void)
+{
+  /* SLEEP enters IDLE instead of Sleep. The CPU stops, but the system clock
+   * keeps running, so the UARTs and Timer0 work and wake the CPU with their
+   * interrupts. */
+  CPUDOZEbits.IDLEN = 1;
+}
+
+
+void power_idle(void)
+{
+  uint8_t start;
+  uint8_t stop;
+  
+  /* Timer0 counts from 0 to TMR0H within one tick and is used to measure
+   * the time spent in IDLE. Has to be called with GIE = 0, a pending
+   * interrupt then wakes the CPU immediately and is serviced after GIE is
+   * set again. */
+  start = TMR0L;
+  SLEEP();
+  NOP();
+  stop = TMR0L;
+  
+  if(stop >= start)
+  {
+    idle_counts += (uint8_t)(stop - start);
+  }
+  else
+  {
+    /* Woken by the timer interrupt, the counter wrapped around */
+    idle_counts += ((uint16_t)TMR0H + 1) - start + stop;
+  }
+}
+
+
+void power_tick(uint8_t ms)
+{
+  uint32_t counts;
+  
+  tick_counter += ms;
+  if(tick_counter >= MEASUREMENT_TICKS)
+  {
+    counts = (uint32_t)tick_counter * ((uint16_t)TMR0H + 1);
+    if(idle_counts > counts)
+    {
+      idle_counts = counts;
+    }
+    active_percent = (uint8_t)(100 - ((idle_counts * 100) / counts));
+    
+    idle_counts = 0;
+    tick_counter = 0;
+  }
+}
+
+
+uint8_t power_get_active_percent(void)
+{
+  return active_percent;
+}
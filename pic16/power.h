@@ -0,0 +1,5 @@
+
+extern void power_init(void);
+extern void power_idle(void);
+extern void power_tick(uint8_t ms);
+extern uint8_t power_get_active_percent(void);
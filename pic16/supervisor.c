@@ -0,0 +1,280 @@
+#include <xc.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sysconfig.h"
+#include "supervisor.h"
+
+
+#define MASTER_TIMEOUT        50    /* ms without master frame until the receiver is reset */
+#define RESPONSE_TIMEOUT      20    /* ms a queued response may take until it is sent completely */
+#define FRAMING_ERROR_LIMIT   8     /* Sync breaks without a valid frame in between */
+#define UART_REINIT_TIME      150   /* ms after the start of a fault */
+#define WATCHDOG_RESET_TIME   1000  /* ms after the start of a fault */
+#define UART_RETRY_TIME       1000  /* ms between reinits after the watchdog reset didn't help */
+#define WATCHDOG_PERIOD       1057  /* ms, WDTCPS_10 with 31kHz LFINTOSC */
+
+
+/* Survive the controlled watchdog reset, initialised in supervisor_init() */
+static __persistent supervisor_action_t level;
+static __persistent uint16_t fault_time;
+static __persistent uint8_t receiver_resets;
+static __persistent uint8_t uart_reinits;
+static __persistent uint8_t watchdog_resets;
+static __persistent uint8_t overruns;
+static __persistent uint8_t stray_bytes;
+static __persistent uint16_t recoveries;
+static __persistent uint32_t recovery_time;
+
+static uint16_t master_age = 0;
+static uint16_t response_age = UINT16_MAX;
+static bool response_pending = false;
+static uint8_t response_wait = 0;
+static bool overrun_pending = false;
+static uint8_t framing_errors = 0;
+static uint16_t retry_time = 0;
+
+
+static void count(uint8_t *p_counter)
+{
+  if(*p_counter < UINT8_MAX)
+  {
+    (*p_counter)++;
+  }
+}
+
+
+static void add_time(uint16_t *p_time, uint8_t ms)
+{
+  if(*p_time < (UINT16_MAX - ms))
+  {
+    *p_time += ms;
+  }
+  else
+  {
+    *p_time = UINT16_MAX;
+  }
+}
+
+
+void supervisor_init(void)
+{
+  if((PCON0bits.nPOR == 0) || (PCON0bits.nBOR == 0))
+  {
+    /* Persistent variables are undefined after power up */
+    level = supervisor_ok;
+    fault_time = 0;
+    receiver_resets = 0;
+    uart_reinits = 0;
+    watchdog_resets = 0;
+    overruns = 0;
+    stray_bytes = 0;
+    recoveries = 0;
+    recovery_time = 0;
+  }
+  else if((PCON0bits.nRWDT == 0) && (level == supervisor_watchdog_reset))
+  {
+    /* Our own reset, the fault continues and is measured further */
+    if(fault_time < (UINT16_MAX - WATCHDOG_PERIOD))
+    {
+      fault_time += WATCHDOG_PERIOD;
+    }
+  }
+  else
+  {
+    /* Any other reset keeps the counters but ends the fault */
+    level = supervisor_ok;
+    fault_time = 0;
+  }
+
+  PCON0bits.nPOR = 1;
+  PCON0bits.nBOR = 1;
+  PCON0bits.nRWDT = 1;
+  PCON0bits.nRI = 1;
+}
+
+
+void supervisor_master_frame(void)
+{
+  master_age = 0;
+  framing_errors = 0;
+
+  if(level != supervisor_ok)
+  {
+    if(recoveries < UINT16_MAX)
+    {
+      recoveries++;
+      recovery_time += fault_time;
+    }
+    level = supervisor_ok;
+    fault_time = 0;
+  }
+}
+
+
+void supervisor_response_queued(void)
+{
+  response_pending = true;
+  response_wait = 0;
+}
+
+
+void supervisor_response_sent(void)
+{
+  response_pending = false;
+  response_age = 0;
+}
+
+
+void supervisor_uart_errors(bool overrun, uint8_t framing_error_count, uint8_t stray_byte_count)
+{
+  if(overrun)
+  {
+    overrun_pending = true;
+    count(&overruns);
+  }
+  if(framing_errors < (UINT8_MAX - framing_error_count))
+  {
+    framing_errors += framing_error_count;
+  }
+  if(stray_bytes < (UINT8_MAX - stray_byte_count))
+  {
+    stray_bytes += stray_byte_count;
+  }
+  else
+  {
+    stray_bytes = UINT8_MAX;
+  }
+}
+
+
+supervisor_action_t supervisor_tick(uint8_t ms)
+{
+  supervisor_action_t action = supervisor_ok;
+
+  add_time(&master_age, ms);
+  add_time(&response_age, ms);
+
+  /* Error streaks and timeouts which start a fault */
+  if(overrun_pending)
+  {
+    /* OERR stops the receiver until CREN is cleared */
+    overrun_pending = false;
+    action = supervisor_receiver_reset;
+  }
+  if(framing_errors >= FRAMING_ERROR_LIMIT)
+  {
+    framing_errors = 0;
+    action = supervisor_receiver_reset;
+  }
+  if((level == supervisor_ok) && (master_age >= MASTER_TIMEOUT))
+  {
+    action = supervisor_receiver_reset;
+  }
+  if(response_pending)
+  {
+    if(response_wait < (UINT8_MAX - ms))
+    {
+      response_wait += ms;
+    }
+    else
+    {
+      response_wait = UINT8_MAX;
+    }
+    if(response_wait >= RESPONSE_TIMEOUT)
+    {
+      /* Transmitter is stuck, resetting the receiver doesn't help */
+      response_pending = false;
+      action = supervisor_uart_reinit;
+    }
+  }
+
+  /* Escalation of an ongoing fault */
+  if(level != supervisor_ok)
+  {
+    add_time(&fault_time, ms);
+    if((level < supervisor_uart_reinit) && (fault_time >= UART_REINIT_TIME))
+    {
+      action = supervisor_uart_reinit;
+    }
+    else if((level < supervisor_watchdog_reset) && (fault_time >= WATCHDOG_RESET_TIME))
+    {
+      action = supervisor_watchdog_reset;
+    }
+    else if(level == supervisor_watchdog_reset)
+    {
+      /* Reset once per fault only, e.g. if the bus is disconnected */
+      add_time(&retry_time, ms);
+      if(retry_time >= UART_RETRY_TIME)
+      {
+        retry_time = 0;
+        action = supervisor_uart_reinit;
+      }
+    }
+  }
+
+  if(action != supervisor_ok)
+  {
+    if(level == supervisor_ok)
+    {
+      fault_time = 0;
+    }
+    if(action > level)
+    {
+      level = action;
+    }
+  }
+
+  switch(action)
+  {
+    case supervisor_receiver_reset:
+      count(&receiver_resets);
+      break;
+    case supervisor_uart_reinit:
+      count(&uart_reinits);
+      break;
+    case supervisor_watchdog_reset:
+      count(&watchdog_resets);
+      break;
+    default:
+      break;
+  }
+
+  return action;
+}
+
+
+void supervisor_force_reset(void)
+{
+  /* CLRWDT and SLEEP aren't executed anymore, the watchdog resets the PIC
+   * after its period. supervisor_init() then continues the fault. */
+  GIE = 0;
+  while(1)
+  {
+  }
+}
+
+
+void supervisor_get_report(supervisor_report_t *p_report)
+{
+  uint32_t mean = 0;
+
+  if(recoveries > 0)
+  {
+    mean = recovery_time / recoveries;
+    if(mean > UINT16_MAX)
+    {
+      mean = UINT16_MAX;
+    }
+  }
+
+  p_report->level = level;
+  p_report->master_age = master_age;
+  p_report->response_age = response_age;
+  p_report->receiver_resets = receiver_resets;
+  p_report->uart_reinits = uart_reinits;
+  p_report->watchdog_resets = watchdog_resets;
+  p_report->overruns = overruns;
+  p_report->stray_bytes = stray_bytes;
+  p_report->recoveries = (recoveries > UINT8_MAX) ? UINT8_MAX : (uint8_t)recoveries;
+  p_report->mean_recovery_time = (uint16_t)mean;
+}
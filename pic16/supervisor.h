@@ -0,0 +1,34 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Recovery steps of the bus supervisor, ordered by escalation */
+typedef enum
+{
+  supervisor_ok = 0,
+  supervisor_receiver_reset = 1,
+  supervisor_uart_reinit = 2,
+  supervisor_watchdog_reset = 3
+} supervisor_action_t;
+
+typedef struct
+{
+  supervisor_action_t level;    /* Highest step of the ongoing fault */
+  uint16_t master_age;          /* ms since the last valid master frame */
+  uint16_t response_age;        /* ms since the last response was sent */
+  uint8_t receiver_resets;
+  uint8_t uart_reinits;
+  uint8_t watchdog_resets;
+  uint8_t overruns;
+  uint8_t stray_bytes;          /* Received outside of a frame */
+  uint8_t recoveries;
+  uint16_t mean_recovery_time;  /* ms */
+} supervisor_report_t;
+
+extern void supervisor_init(void);
+extern void supervisor_master_frame(void);
+extern void supervisor_response_queued(void);
+extern void supervisor_response_sent(void);
+extern void supervisor_uart_errors(bool overrun, uint8_t framing_error_count, uint8_t stray_byte_count);
+extern supervisor_action_t supervisor_tick(uint8_t ms);
+extern void supervisor_force_reset(void);
+extern void supervisor_get_report(supervisor_report_t *p_report);
@@ -6,3 +6,9 @@
 
 #define NOT_READ_ENABLE     LATC3
 #define DRIVER_ENABLE       LATC2
+
+
+/* Virtual slaves emulated on the Hoermann bus as { address, type }. The
+ * first one receives the actions of the ESP. The lower 4 bits of the
+ * addresses have to differ, see HOERMANN_SLAVE_LOOKUP_SIZE. */
+#define HOERMANN_SLAVES     { { HOERMANN_UAP1_ADDR, HOERMANN_UAP1_TYPE } }